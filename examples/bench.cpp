@@ -0,0 +1,1141 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "ptl.hpp"
+#include "ptl/bit_reader.hpp"
+#include "ptl/bit_writer.hpp"
+#include "ptl/buffer_pool.hpp"
+#include "ptl/capture_reader.hpp"
+#include "ptl/checksum.hpp"
+#include "ptl/flow_key.hpp"
+#include "ptl/header_template.hpp"
+#include "ptl/packed_vector.hpp"
+#include "ptl/parallel_decode.hpp"
+#include "ptl/segmented_header.hpp"
+#include "ptl/sequence_tracker.hpp"
+#include "ptl/stack.hpp"
+#include "ptl/ts_demux.hpp"
+#include "ptl/udp_batch_io.hpp"
+#include "test_protocol.hpp"
+
+using namespace std;
+using namespace ptl;
+
+// RFC 3550 RTP fixed header
+using rtp_tpl = tuple<field<2, uint8_t>,    // Version
+		      field<1, bool>,       // Padding bit
+		      field<1, bool>,       // Extension bit
+		      field<4, uint8_t>,    // CSRC count
+		      field<1, bool>,       // Marker bit
+		      field<7, uint8_t>,    // Payload type
+		      field<16, uint16_t>,  // Sequence number
+		      field<32, uint32_t>,  // Timestamp
+		      field<32, uint32_t>   // SSRC
+		      >;
+
+using rtp = protocol<rtp_tpl>;
+
+// Partial MPEG 2 transport stream header
+using mpeg2_ts_tpl = tuple<field<8, unsigned char>,  // sync byte
+			   field<1, bool>,           // transport error indicator
+			   field<1, bool>,           // payload unit start indicator
+			   field<1, bool>,           // transport priority
+			   field<13, unsigned short> // PID
+			   >;
+
+using ts_proto = protocol<mpeg2_ts_tpl>;
+
+// RFC 791 IPv4 header without options
+using ipv4_tpl = tuple<field<4, uint8_t>,    // Version
+		       field<4, uint8_t>,    // IHL
+		       field<6, uint8_t>,    // DSCP
+		       field<2, uint8_t>,    // ECN
+		       field<16, uint16_t>,  // Total length
+		       field<16, uint16_t>,  // Identification
+		       field<3, uint8_t>,    // Flags
+		       field<13, uint16_t>,  // Fragment offset
+		       field<8, uint8_t>,    // TTL
+		       field<8, uint8_t>,    // Protocol
+		       field<16, uint16_t>,  // Header checksum
+		       field<32, uint32_t>,  // Source address
+		       field<32, uint32_t>   // Destination address
+		       >;
+
+using ipv4 = protocol<ipv4_tpl>;
+using ipv4_checksum = internet_checksum_field<ipv4, 10>;
+
+// Number of distinct buffers each benchmark cycles through
+static constexpr size_t buffers = 1024;
+
+struct result
+{
+	string name;
+	double ns_per_op;
+};
+
+static vector<result> results;
+
+// Keeps the compiler from discarding the benchmarked work
+static volatile uint64_t sink;
+
+/** Runs op over every buffer until at least min_ops have been performed
+ *
+ *  op is passed the buffer and the buffer's index, and returns a value
+ *  that's accumulated into sink.
+ */
+template <class Buffer, class Op>
+static void measure(string const & name, vector<Buffer> & bufs, Op op, const size_t min_ops = 1 << 22)
+{
+	const size_t rounds = (min_ops + bufs.size() - 1) / bufs.size();
+	uint64_t acc = 0;
+	const auto start = chrono::steady_clock::now();
+	for (size_t r = 0; r < rounds; ++r) {
+		for (size_t i = 0; i < bufs.size(); ++i) {
+			acc += op(bufs[i].data(), i + r);
+		}
+	}
+	const auto end = chrono::steady_clock::now();
+	sink = acc;
+
+	results.push_back({name,
+			   chrono::duration<double, nano>(end - start).count() / (rounds * bufs.size())});
+}
+
+template <class Buffer>
+static vector<Buffer> make_buffers()
+{
+	vector<Buffer> bufs(buffers);
+	for (size_t i = 0; i < bufs.size(); ++i) {
+		for (size_t j = 0; j < bufs[i].size(); ++j) {
+			bufs[i][j] = static_cast<unsigned char>(i * 31 + j * 7);
+		}
+	}
+	return bufs;
+}
+
+template <class T>
+static char const * type_name()
+{
+	return is_same<T, bool>::value ? "bool" :
+		numeric_limits<T>::digits == 8 ? "uint8" :
+		numeric_limits<T>::digits == 16 ? "uint16" :
+		numeric_limits<T>::digits == 32 ? "uint32" : "uint64";
+}
+
+// Benchmarks field_value get and set for every field of the test protocol
+template <size_t I>
+struct bench_test_field
+{
+	static void run(vector<test_proto::traits::array_type> & bufs) {
+		using traits = test_proto::field_traits<I>;
+		using value_type = typename traits::type::value_type;
+
+		stringstream name;
+		name << "test/field" << I
+		     << "/bits" << traits::type::bits
+		     << "/offset" << traits::byte_bit_offset
+		     << "/" << type_name<value_type>();
+
+		measure(name.str() + "/get", bufs, [](unsigned char const * const buf, size_t) {
+				return static_cast<uint64_t>(test_proto::field_value<I>(buf));
+			});
+		measure(name.str() + "/set", bufs, [](unsigned char * const buf, size_t i) {
+				test_proto::field_value<I>(buf, static_cast<value_type>(i));
+				return static_cast<uint64_t>(buf[traits::byte_index]);
+			});
+
+		bench_test_field<I - 1>::run(bufs);
+	}
+};
+
+template <>
+struct bench_test_field<static_cast<size_t>(-1)>
+{
+	static void run(vector<test_proto::traits::array_type> &) {}
+};
+
+static void bench_rtp()
+{
+	auto bufs = make_buffers<rtp::traits::array_type>();
+
+	measure("rtp/get/field_value", bufs, [](unsigned char const * const buf, size_t) {
+			return uint64_t(rtp::field_value<0>(buf)) + rtp::field_value<1>(buf) +
+				rtp::field_value<2>(buf) + rtp::field_value<3>(buf) +
+				rtp::field_value<4>(buf) + rtp::field_value<5>(buf) +
+				rtp::field_value<6>(buf) + rtp::field_value<7>(buf) +
+				rtp::field_value<8>(buf);
+		});
+
+	measure("rtp/get/unpack", bufs, [](unsigned char const * const buf, size_t) {
+			const auto v = rtp::unpack(buf);
+			return uint64_t(get<0>(v)) + get<1>(v) + get<2>(v) + get<3>(v) +
+				get<4>(v) + get<5>(v) + get<6>(v) + get<7>(v) + get<8>(v);
+		});
+
+	measure("rtp/get/baseline", bufs, [](unsigned char const * const buf, size_t) {
+			return uint64_t(buf[0] >> 6) + ((buf[0] >> 5) & 1) + ((buf[0] >> 4) & 1) +
+				(buf[0] & 0xf) + (buf[1] >> 7) + (buf[1] & 0x7f) +
+				((uint32_t(buf[2]) << 8) | buf[3]) +
+				((uint32_t(buf[4]) << 24) | (uint32_t(buf[5]) << 16) | (uint32_t(buf[6]) << 8) | buf[7]) +
+				((uint32_t(buf[8]) << 24) | (uint32_t(buf[9]) << 16) | (uint32_t(buf[10]) << 8) | buf[11]);
+		});
+
+	measure("rtp/set/field_value", bufs, [](unsigned char * const buf, size_t i) {
+			rtp::field_value<0>(buf, 2);
+			rtp::field_value<1>(buf, false);
+			rtp::field_value<2>(buf, false);
+			rtp::field_value<3>(buf, 0);
+			rtp::field_value<4>(buf, i & 1);
+			rtp::field_value<5>(buf, 96);
+			rtp::field_value<6>(buf, static_cast<uint16_t>(i));
+			rtp::field_value<7>(buf, static_cast<uint32_t>(i * 3000));
+			rtp::field_value<8>(buf, 0x12345678);
+			return uint64_t(buf[1]) + buf[3] + buf[7];
+		});
+
+	measure("rtp/set/pack", bufs, [](unsigned char * const buf, size_t i) {
+			rtp::pack(buf, 2, false, false, 0, i & 1, 96, static_cast<uint16_t>(i),
+				  static_cast<uint32_t>(i * 3000), 0x12345678);
+			return uint64_t(buf[1]) + buf[3] + buf[7];
+		});
+
+	static constexpr header_template<rtp, 4, 6, 7> rtp_template(2, false, false, 0, false, 96, 0, 0, 0x12345678);
+	measure("rtp/set/header_template", bufs, [](unsigned char * const buf, size_t i) {
+			rtp_template.emit(buf, i & 1, static_cast<uint16_t>(i), static_cast<uint32_t>(i * 3000));
+			return uint64_t(buf[1]) + buf[3] + buf[7];
+		});
+
+	measure("rtp/set/baseline", bufs, [](unsigned char * const buf, size_t i) {
+			const uint16_t seq = static_cast<uint16_t>(i);
+			const uint32_t ts = static_cast<uint32_t>(i * 3000);
+			const uint32_t ssrc = 0x12345678;
+			buf[0] = 2 << 6;
+			buf[1] = static_cast<unsigned char>(((i & 1) << 7) | 96);
+			buf[2] = static_cast<unsigned char>(seq >> 8);
+			buf[3] = static_cast<unsigned char>(seq);
+			buf[4] = static_cast<unsigned char>(ts >> 24);
+			buf[5] = static_cast<unsigned char>(ts >> 16);
+			buf[6] = static_cast<unsigned char>(ts >> 8);
+			buf[7] = static_cast<unsigned char>(ts);
+			buf[8] = static_cast<unsigned char>(ssrc >> 24);
+			buf[9] = static_cast<unsigned char>(ssrc >> 16);
+			buf[10] = static_cast<unsigned char>(ssrc >> 8);
+			buf[11] = static_cast<unsigned char>(ssrc);
+			return uint64_t(buf[1]) + buf[3] + buf[7];
+		});
+}
+
+static void bench_ts()
+{
+	// Whole 188 byte packets, so every header is on its own cache line
+	using packet = array<unsigned char, 188>;
+	auto bufs = make_buffers<packet>();
+
+	measure("ts/get_pid/field_value", bufs, [](unsigned char const * const buf, size_t) {
+			return uint64_t(ts_proto::field_value<4>(buf));
+		});
+
+	measure("ts/get_pid/baseline", bufs, [](unsigned char const * const buf, size_t) {
+			return uint64_t(((buf[1] & 0x1f) << 8) | buf[2]);
+		});
+
+	measure("ts/get_all/unpack", bufs, [](unsigned char const * const buf, size_t) {
+			const auto v = ts_proto::unpack(buf);
+			return uint64_t(get<0>(v)) + get<1>(v) + get<2>(v) + get<3>(v) + get<4>(v);
+		});
+
+	measure("ts/set_pid/field_value", bufs, [](unsigned char * const buf, size_t i) {
+			ts_proto::field_value<4>(buf, static_cast<unsigned short>(i));
+			return uint64_t(buf[2]);
+		});
+
+	measure("ts/set_pid/baseline", bufs, [](unsigned char * const buf, size_t i) {
+			buf[1] = static_cast<unsigned char>((buf[1] & 0xe0) | ((i >> 8) & 0x1f));
+			buf[2] = static_cast<unsigned char>(i);
+			return uint64_t(buf[2]);
+		});
+
+	// One batch call per round over all of the packets
+	vector<vector<unsigned char>> batch(1, vector<unsigned char>(buffers * sizeof(packet)));
+	for (size_t i = 0; i < buffers; ++i) {
+		memcpy(batch[0].data() + i * sizeof(packet), bufs[i].data(), sizeof(packet));
+	}
+	vector<unsigned short> pids(buffers);
+	measure("ts/extract_pid/batch_of_1024", batch, [&pids](unsigned char const * const buf, size_t) {
+			ts_proto::extract<4>(buf, sizeof(packet), buffers, pids.data());
+			return uint64_t(pids[buffers - 1]);
+		}, 1 << 12);
+	results.back().ns_per_op /= buffers;
+}
+
+static void bench_checksum()
+{
+	auto headers = make_buffers<ipv4::traits::array_type>();
+	for (auto & header : headers) {
+		ipv4_checksum::update(header.data());
+	}
+
+	// The index is summed in so the sums can't be hoisted out of the rounds
+	measure("checksum/ipv4/internet_checksum_field", headers, [](unsigned char const * const buf, size_t i) {
+			return uint64_t(ipv4_checksum::compute(buf, ipv4::traits::bytes, i & 1));
+		});
+
+	measure("checksum/ipv4/baseline", headers, [](unsigned char const * const buf, size_t i) {
+			uint32_t sum = i & 1;
+			for (size_t i = 0; i < ipv4::traits::bytes; i += 2) {
+				sum += i == 10 ? 0 : (uint32_t(buf[i]) << 8) | buf[i + 1];
+			}
+			sum = (sum >> 16) + (sum & 0xffff);
+			sum = (sum >> 16) + (sum & 0xffff);
+			return uint64_t(static_cast<uint16_t>(~sum));
+		});
+
+	measure("checksum/ipv4_ttl/incremental", headers, [](unsigned char * const buf, size_t i) {
+			ipv4_checksum::field_value<8>(buf, static_cast<uint8_t>(i));
+			return uint64_t(buf[10]);
+		});
+
+	measure("checksum/ipv4_ttl/update", headers, [](unsigned char * const buf, size_t i) {
+			ipv4::field_value<8>(buf, static_cast<uint8_t>(i));
+			ipv4_checksum::update(buf);
+			return uint64_t(buf[10]);
+		});
+
+	// PSI sections are at most 1024 bytes
+	using section = array<unsigned char, 1024>;
+	vector<section> sections(64);
+	for (size_t i = 0; i < sections.size(); ++i) {
+		for (size_t j = 0; j < sections[i].size(); ++j) {
+			sections[i][j] = static_cast<unsigned char>(i * 31 + j * 7);
+		}
+	}
+
+	measure("checksum/crc32_1k/slicing_by_8", sections, [](unsigned char const * const buf, size_t) {
+			return uint64_t(crc32_mpeg2(buf, sizeof(section)));
+		}, 1 << 16);
+
+	// The usual one table, one byte at a time CRC
+	static uint32_t table[256];
+	for (uint32_t b = 0; b < 256; ++b) {
+		uint32_t crc = b << 24;
+		for (int bit = 0; bit < 8; ++bit) {
+			crc = (crc & 0x80000000) ? (crc << 1) ^ crc32_mpeg2_polynomial : crc << 1;
+		}
+		table[b] = crc;
+	}
+	measure("checksum/crc32_1k/baseline", sections, [](unsigned char const * const buf, size_t) {
+			uint32_t crc = 0xffffffff;
+			for (size_t i = 0; i < sizeof(section); ++i) {
+				crc = (crc << 8) ^ table[(crc >> 24) ^ buf[i]];
+			}
+			return uint64_t(crc);
+		}, 1 << 16);
+}
+
+// Runs op once, recording its time divided by ops
+template <class Op>
+static void measure_once(string const & name, const size_t ops, Op op)
+{
+	const auto start = chrono::steady_clock::now();
+	sink = op();
+	const auto end = chrono::steady_clock::now();
+	results.push_back({name, chrono::duration<double, nano>(end - start).count() / ops});
+}
+
+static void bench_bitstream()
+{
+	// Slice header like codes: a flag, a ue(v), an se(v) and a 5 bit field
+	static constexpr size_t groups = 1 << 20;
+	vector<unsigned char> stream;
+	size_t bits = 0;
+	auto append = [&](const uint64_t value, const size_t n) {
+		for (size_t i = n; i-- > 0; ++bits) {
+			if (bits % 8 == 0) {
+				stream.push_back(0);
+			}
+			stream.back() |= static_cast<unsigned char>(((value >> i) & 1) << (7 - bits % 8));
+		}
+	};
+	auto append_ue = [&](const uint32_t value) {
+		const uint64_t code = static_cast<uint64_t>(value) + 1;
+		size_t n = 0;
+		while ((code >> n) > 1) {
+			++n;
+		}
+		append(0, n);
+		append(code, n + 1);
+	};
+	for (size_t i = 0; i < groups; ++i) {
+		append(i & 1, 1);
+		append_ue(static_cast<uint32_t>((i * 7919) % 300));
+		append_ue(static_cast<uint32_t>((i * 104729) % 60));
+		append(i, 5);
+	}
+
+	measure_once("bitstream/slice_codes/bit_reader", groups * 4, [&stream]() {
+			bit_reader reader(stream.data(), stream.size());
+			uint64_t acc = 0;
+			for (size_t i = 0; i < groups; ++i) {
+				acc += reader.read_flag();
+				acc += reader.read_ue();
+				acc += static_cast<uint64_t>(reader.read_se());
+				acc += reader.read<5>();
+			}
+			return acc;
+		});
+
+	// One bit at a time from the stream's bytes
+	measure_once("bitstream/slice_codes/baseline", groups * 4, [&stream]() {
+			size_t pos = 0;
+			auto bit = [&]() {
+				const uint64_t b = (stream[pos / 8] >> (7 - pos % 8)) & 1;
+				++pos;
+				return b;
+			};
+			auto bits_value = [&](size_t n) {
+				uint64_t v = 0;
+				while (n-- > 0) {
+					v = (v << 1) | bit();
+				}
+				return v;
+			};
+			auto ue = [&]() {
+				size_t zeros = 0;
+				while (bit() == 0) {
+					++zeros;
+				}
+				return ((uint64_t(1) << zeros) | bits_value(zeros)) - 1;
+			};
+			uint64_t acc = 0;
+			for (size_t i = 0; i < groups; ++i) {
+				acc += bit();
+				acc += ue();
+				const uint64_t code = ue();
+				acc += static_cast<uint64_t>((code & 1) ? int64_t(code / 2 + 1) : -int64_t(code / 2));
+				acc += bits_value(5);
+			}
+			return acc;
+		});
+
+	vector<unsigned char> written(stream.size());
+	measure_once("bitstream/write_slice_codes/bit_writer", groups * 4, [&written]() {
+			bit_writer writer(written.data(), written.size());
+			for (size_t i = 0; i < groups; ++i) {
+				writer.write_flag(i & 1);
+				writer.write_ue(static_cast<uint32_t>((i * 7919) % 300));
+				writer.write_se(static_cast<int32_t>((i * 104729) % 60 + 1) / 2 * ((i * 104729) % 2 ? 1 : -1));
+				writer.write<5>(i);
+			}
+			return uint64_t(writer.flush());
+		});
+
+	// One bit at a time ORed into the stream's bytes
+	measure_once("bitstream/write_slice_codes/baseline", groups * 4, [&written]() {
+			fill(written.begin(), written.end(), 0);
+			size_t pos = 0;
+			auto put = [&](const uint64_t value, size_t n) {
+				while (n-- > 0) {
+					written[pos / 8] |= static_cast<unsigned char>(((value >> n) & 1) << (7 - pos % 8));
+					++pos;
+				}
+			};
+			auto ue = [&](const uint32_t value) {
+				const uint64_t code = uint64_t(value) + 1;
+				size_t n = 0;
+				while ((code >> n) > 1) {
+					++n;
+				}
+				put(0, n);
+				put(code, n + 1);
+			};
+			for (size_t i = 0; i < groups; ++i) {
+				put(i & 1, 1);
+				ue(static_cast<uint32_t>((i * 7919) % 300));
+				const int32_t se = static_cast<int32_t>((i * 104729) % 60 + 1) / 2 * ((i * 104729) % 2 ? 1 : -1);
+				ue(se > 0 ? uint32_t(se) * 2 - 1 : uint32_t(-se) * 2);
+				put(i, 5);
+			}
+			return uint64_t(pos);
+		});
+}
+
+static void bench_demux()
+{
+	// 1024 packets on 64 PIDs, routed to 4 consumers
+	static constexpr size_t packets = 1024;
+	static constexpr size_t rounds = 4096;
+	vector<unsigned char> stream(packets * 188);
+	for (size_t i = 0; i < packets; ++i) {
+		ts_proto::pack(stream.data() + i * 188, 0x47, false, false, false,
+			       static_cast<unsigned short>(0x100 + (i * 7) % 64));
+	}
+
+	ts_demux<ts_proto, 4> demux(4, packets);
+	for (unsigned short pid = 0x100; pid < 0x140; ++pid) {
+		demux.route(pid, pid % 4);
+	}
+	measure_once("demux/ts_1024/ts_demux", packets * rounds, [&]() {
+			uint64_t acc = 0;
+			for (size_t r = 0; r < rounds; ++r) {
+				demux.demux(stream.data(), 188, packets);
+				for (size_t c = 0; c < 4; ++c) {
+					acc += demux.queue(c).consume([](unsigned char const *) {});
+				}
+			}
+			return acc;
+		});
+
+	// A hash map of PID to queue
+	unordered_map<unsigned short, vector<unsigned char const *>> queues;
+	for (unsigned short pid = 0x100; pid < 0x140; ++pid) {
+		queues[pid].reserve(packets);
+	}
+	measure_once("demux/ts_1024/baseline", packets * rounds, [&]() {
+			uint64_t acc = 0;
+			for (size_t r = 0; r < rounds; ++r) {
+				for (size_t i = 0; i < packets; ++i) {
+					unsigned char const * const packet = stream.data() + i * 188;
+					auto queue = queues.find(static_cast<unsigned short>(((packet[1] & 0x1f) << 8) | packet[2]));
+					if (queue != queues.end()) {
+						queue->second.push_back(packet);
+					}
+				}
+				for (auto & queue : queues) {
+					acc += queue.second.size();
+					queue.second.clear();
+				}
+			}
+			return acc;
+		});
+}
+
+static void bench_sequence()
+{
+	// 64 packets of each of 50000 RTP streams, interleaved
+	static constexpr size_t streams = 50000;
+	static constexpr size_t packets = 64 * streams;
+	vector<unsigned char> headers(packets * rtp::traits::bytes);
+	for (size_t i = 0; i < packets; ++i) {
+		rtp::pack(headers.data() + i * rtp::traits::bytes, 2, false, false, 0, false, 96,
+			  static_cast<uint16_t>(i / streams), 0, static_cast<uint32_t>((i * 7919) % streams * 2654435761u));
+	}
+
+	sequence_tracker<rtp, 8, 6> tracker(1, streams);
+	measure_once("sequence/rtp_50k_streams/sequence_tracker", packets, [&]() {
+			tracker.update(0, headers.data(), rtp::traits::bytes, packets);
+			return tracker.stats(0).received;
+		});
+
+	// A hash map of SSRC to the highest sequence number and counters
+	struct stream_state
+	{
+		uint16_t highest;
+		uint64_t received;
+		uint64_t lost;
+	};
+	unordered_map<uint32_t, stream_state> states;
+	states.reserve(streams);
+	measure_once("sequence/rtp_50k_streams/baseline", packets, [&]() {
+			for (size_t i = 0; i < packets; ++i) {
+				unsigned char const * const header = headers.data() + i * rtp::traits::bytes;
+				const uint16_t sequence = static_cast<uint16_t>((header[2] << 8) | header[3]);
+				const uint32_t ssrc = (uint32_t(header[8]) << 24) | (uint32_t(header[9]) << 16) |
+					(uint32_t(header[10]) << 8) | header[11];
+				auto found = states.find(ssrc);
+				if (found == states.end()) {
+					states.emplace(ssrc, stream_state{sequence, 1, 0});
+					continue;
+				}
+				const uint16_t delta = static_cast<uint16_t>(sequence - found->second.highest);
+				if (delta != 0 && delta < 0x8000) {
+					found->second.lost += delta - 1;
+					found->second.highest = sequence;
+				}
+				++found->second.received;
+			}
+			return uint64_t(states.size());
+		});
+}
+
+static void bench_stack()
+{
+	using ethernet = protocol<tuple<field<48, uint64_t>, field<48, uint64_t>, field<16, uint16_t>>>;
+	using udp = protocol<tuple<field<16, uint16_t>, field<16, uint16_t>, field<16, uint16_t>, field<16, uint16_t>>>;
+	using rtp_stack = ptl::stack<ethernet, ipv4, udp, rtp>;
+
+	auto bufs = make_buffers<rtp_stack::traits::array_type>();
+
+	measure("stack/rtp_over_udp/unpack", bufs, [](unsigned char const * const buf, size_t) {
+			const auto v = rtp_stack::unpack(buf);
+			return uint64_t(get<2>(v)) + get<14>(v) + get<15>(v) + get<17>(v) +
+				get<25>(v) + get<27>(v) + get<28>(v);
+		});
+
+	measure("stack/rtp_over_udp/layers", bufs, [](unsigned char const * const buf, size_t) {
+			const auto e = ethernet::unpack(buf);
+			const auto i = ipv4::unpack(buf + ethernet::traits::bytes);
+			const auto u = udp::unpack(buf + ethernet::traits::bytes + ipv4::traits::bytes);
+			const auto r = rtp::unpack(buf + ethernet::traits::bytes + ipv4::traits::bytes + udp::traits::bytes);
+			return uint64_t(get<2>(e)) + get<11>(i) + get<12>(i) + get<1>(u) +
+				get<6>(r) + get<7>(r) + get<8>(r);
+		});
+}
+
+static void bench_flow_key()
+{
+	using udp = protocol<tuple<field<16, uint16_t>, field<16, uint16_t>, field<16, uint16_t>, field<16, uint16_t>>>;
+	using ipv4_udp = ptl::stack<ipv4, udp>;
+	// Protocol, source and destination addresses and ports
+	using five_tuple = flow_key<ipv4_udp, 9, 11, 12, 13, 14>;
+
+	auto bufs = make_buffers<ipv4_udp::traits::array_type>();
+
+	measure("flow_key/five_tuple/hash", bufs, [](unsigned char const * const buf, size_t) {
+			return uint64_t(five_tuple::hash(buf));
+		});
+
+	// The fields are read into a struct that's hashed
+	measure("flow_key/five_tuple/baseline", bufs, [](unsigned char const * const buf, size_t) {
+			struct key
+			{
+				uint32_t source;
+				uint32_t destination;
+				uint16_t source_port;
+				uint16_t destination_port;
+				uint8_t protocol;
+			} k{ipv4_udp::field_value<11>(buf), ipv4_udp::field_value<12>(buf),
+			    ipv4_udp::field_value<13>(buf), ipv4_udp::field_value<14>(buf),
+			    ipv4_udp::field_value<9>(buf)};
+			size_t h = hash<uint32_t>()(k.source);
+			h ^= hash<uint32_t>()(k.destination) + 0x9e3779b9 + (h << 6) + (h >> 2);
+			h ^= hash<uint16_t>()(k.source_port) + 0x9e3779b9 + (h << 6) + (h >> 2);
+			h ^= hash<uint16_t>()(k.destination_port) + 0x9e3779b9 + (h << 6) + (h >> 2);
+			h ^= hash<uint8_t>()(k.protocol) + 0x9e3779b9 + (h << 6) + (h >> 2);
+			return uint64_t(h);
+		});
+
+	// One batch call per round over all of the packets
+	vector<vector<unsigned char>> batch(1, vector<unsigned char>(buffers * ipv4_udp::traits::bytes));
+	for (size_t i = 0; i < buffers; ++i) {
+		memcpy(batch[0].data() + i * ipv4_udp::traits::bytes, bufs[i].data(), ipv4_udp::traits::bytes);
+	}
+	vector<uint32_t> hashes(buffers);
+	measure("flow_key/five_tuple/hash_batch_of_1024", batch, [&hashes](unsigned char const * const buf, size_t) {
+			five_tuple::hash(buf, ipv4_udp::traits::bytes, buffers, hashes.data());
+			return uint64_t(hashes[0]) + hashes[buffers - 1];
+		}, 1 << 12);
+}
+
+static void bench_packed_vector()
+{
+	// An index of 16M 13 bit PIDs
+	static constexpr size_t count = 1 << 24;
+	static constexpr size_t chunk = 4096;
+	packed_vector<field<13, uint16_t>> packed;
+	vector<uint16_t> pids(count);
+	packed.reserve(count);
+	for (size_t i = 0; i < count; ++i) {
+		pids[i] = static_cast<uint16_t>((i * 2654435761u) >> 19);
+		packed.push_back(pids[i]);
+	}
+
+	measure_once("packed_vector/scan_13_bit/get", count, [&]() {
+			uint64_t sum = 0;
+			for (size_t i = 0; i < count; ++i) {
+				sum += packed.get(i);
+			}
+			return sum;
+		});
+
+	measure_once("packed_vector/scan_13_bit/unpack", count, [&]() {
+			uint16_t out[chunk];
+			uint64_t sum = 0;
+			for (size_t i = 0; i < count; i += chunk) {
+				packed.unpack(i, chunk, out);
+				for (size_t j = 0; j < chunk; ++j) {
+					sum += out[j];
+				}
+			}
+			return sum;
+		});
+
+	measure_once("packed_vector/scan_13_bit/baseline", count, [&]() {
+			uint64_t sum = 0;
+			for (size_t i = 0; i < count; ++i) {
+				sum += pids[i];
+			}
+			return sum;
+		});
+
+	measure_once("packed_vector/pack_13_bit/pack", count, [&]() {
+			for (size_t i = 0; i < count; i += chunk) {
+				packed.pack(i, chunk, pids.data() + i);
+			}
+			return uint64_t(packed.get(count - 1));
+		});
+
+	measure_once("packed_vector/pack_13_bit/set", count, [&]() {
+			for (size_t i = 0; i < count; ++i) {
+				packed.set(i, pids[i]);
+			}
+			return uint64_t(packed.get(count - 1));
+		});
+}
+
+static void bench_buffer_pool()
+{
+	// Bursts of 32 RTP packet buffers are allocated, written and released
+	static constexpr size_t burst = 32;
+	static constexpr size_t bursts = 1 << 16;
+	using pool_type = buffer_pool<rtp, 1388>;
+	pool_type pool(4096);
+
+	measure_once("buffer_pool/burst_of_32/buffer_pool", bursts * burst, [&]() {
+			uint64_t acc = 0;
+			pool_type::buffer buffers[burst];
+			for (size_t b = 0; b < bursts; ++b) {
+				for (size_t i = 0; i < burst; ++i) {
+					buffers[i] = pool.allocate();
+					rtp::field_value<6>(buffers[i].header(), static_cast<uint16_t>(i));
+				}
+				for (size_t i = 0; i < burst; ++i) {
+					acc += rtp::field_value<6>(buffers[i].header());
+					buffers[i].reset();
+				}
+			}
+			return acc;
+		});
+
+	measure_once("buffer_pool/burst_of_32/baseline", bursts * burst, [&]() {
+			uint64_t acc = 0;
+			unsigned char * buffers[burst];
+			for (size_t b = 0; b < bursts; ++b) {
+				for (size_t i = 0; i < burst; ++i) {
+					buffers[i] = new unsigned char[pool_type::buffer_bytes];
+					rtp::field_value<6>(buffers[i], static_cast<uint16_t>(i));
+				}
+				for (size_t i = 0; i < burst; ++i) {
+					acc += rtp::field_value<6>(buffers[i]);
+					delete[] buffers[i];
+				}
+			}
+			return acc;
+		});
+
+	// A producer thread allocates buffers that a consumer thread releases
+	static constexpr size_t packets = 1 << 20;
+	measure_once("buffer_pool/handoff/buffer_pool", packets, [&]() {
+			spsc_ring<uint32_t> queue(1024);
+			thread consumer([&]() {
+					size_t released = 0;
+					while (released < packets) {
+						released += queue.consume([&](const uint32_t index) {
+								pool.adopt(index).reset();
+							});
+					}
+				});
+			for (size_t i = 0; i < packets; ++i) {
+				pool_type::buffer buffer;
+				while (!(buffer = pool.allocate())) {
+					this_thread::yield();
+				}
+				const uint32_t index = buffer.release();
+				while (!queue.try_push(index)) {
+					this_thread::yield();
+				}
+			}
+			consumer.join();
+			return uint64_t(packets);
+		});
+
+	measure_once("buffer_pool/handoff/baseline", packets, [&]() {
+			spsc_ring<unsigned char *> queue(1024);
+			thread consumer([&]() {
+					size_t released = 0;
+					while (released < packets) {
+						released += queue.consume([](unsigned char * const buffer) {
+								delete[] buffer;
+							});
+					}
+				});
+			for (size_t i = 0; i < packets; ++i) {
+				unsigned char * const buffer = new unsigned char[pool_type::buffer_bytes];
+				while (!queue.try_push(buffer)) {
+					this_thread::yield();
+				}
+			}
+			consumer.join();
+			return uint64_t(packets);
+		});
+}
+
+static void bench_segmented_header()
+{
+	// RTP headers wrapped around the end of a ring buffer at every byte
+	static constexpr size_t bytes = rtp::traits::bytes;
+	struct wrapped
+	{
+		array<unsigned char, bytes> tail;
+		array<unsigned char, bytes> head;
+		struct iovec segments[2];
+	};
+	vector<wrapped> headers(buffers);
+	auto bufs = make_buffers<rtp::traits::array_type>();
+	for (size_t i = 0; i < buffers; ++i) {
+		const size_t split = i % (bytes + 1);
+		copy(bufs[i].begin(), bufs[i].begin() + split, headers[i].tail.begin());
+		copy(bufs[i].begin() + split, bufs[i].end(), headers[i].head.begin());
+		headers[i].segments[0] = {headers[i].tail.data(), split};
+		headers[i].segments[1] = {headers[i].head.data(), bytes - split};
+	}
+	vector<array<unsigned char, 1>> indices(buffers);
+
+	measure("segmented/rtp_wrapped/segmented_header", indices, [&headers](unsigned char const *, size_t i) {
+			const segmented_header<rtp> header(headers[i % buffers].segments, 2);
+			return uint64_t(header.field_value<5>()) + header.field_value<6>() +
+				header.field_value<7>() + header.field_value<8>();
+		});
+
+	measure("segmented/rtp_wrapped/baseline", indices, [&headers](unsigned char const *, size_t i) {
+			// Copies the header before reading it
+			wrapped const & w = headers[i % buffers];
+			rtp::traits::array_type header;
+			memcpy(header.data(), w.segments[0].iov_base, w.segments[0].iov_len);
+			memcpy(header.data() + w.segments[0].iov_len, w.segments[1].iov_base, w.segments[1].iov_len);
+			return uint64_t(rtp::field_value<5>(header.data())) + rtp::field_value<6>(header.data()) +
+				rtp::field_value<7>(header.data()) + rtp::field_value<8>(header.data());
+		});
+
+	// Headers within one segment take the protocol's accessors
+	for (size_t i = 0; i < buffers; ++i) {
+		headers[i].segments[0] = {bufs[i].data(), bytes};
+		headers[i].segments[1] = {nullptr, 0};
+	}
+	measure("segmented/rtp_contiguous/segmented_header", indices, [&headers](unsigned char const *, size_t i) {
+			const segmented_header<rtp> header(headers[i % buffers].segments, 2);
+			return uint64_t(header.field_value<5>()) + header.field_value<6>() +
+				header.field_value<7>() + header.field_value<8>();
+		});
+
+	measure("segmented/rtp_contiguous/baseline", indices, [&headers](unsigned char const *, size_t i) {
+			unsigned char const * const header = static_cast<unsigned char const *>(
+				headers[i % buffers].segments[0].iov_base);
+			return uint64_t(rtp::field_value<5>(header)) + rtp::field_value<6>(header) +
+				rtp::field_value<7>(header) + rtp::field_value<8>(header);
+		});
+}
+
+// Waits up to 100ms for a datagram, returns false if none arrives
+static bool wait_readable(const int fd)
+{
+	struct pollfd readable = {fd, POLLIN, 0};
+	return poll(&readable, 1, 100) > 0;
+}
+
+static void bench_udp()
+{
+	// Bursts of 32 RTP datagrams with 160 byte payloads are sent
+	// and received over loopback
+	static constexpr size_t burst = 32;
+	static constexpr size_t bursts = 1 << 13;
+	static constexpr size_t payload_bytes = 160;
+	static constexpr size_t datagram_bytes = rtp::traits::bytes + payload_bytes;
+	// Received into buffers with room for an Ethernet MTU's RTP payload
+	static constexpr size_t buffer_payload_bytes = 1388;
+	using io_type = udp_batch_io<rtp, buffer_payload_bytes, burst>;
+
+	// Datagrams lost by loopback are skipped once the receiver has
+	// waited for them, rather than hanging the benchmark
+	const int receiver = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+	const int sender = socket(AF_INET, SOCK_DGRAM, 0);
+	struct sockaddr_in address = {};
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	socklen_t length = sizeof(address);
+	if (receiver < 0 || sender < 0 ||
+	    bind(receiver, reinterpret_cast<struct sockaddr *>(&address), sizeof(address)) != 0 ||
+	    getsockname(receiver, reinterpret_cast<struct sockaddr *>(&address), &length) != 0 ||
+	    connect(sender, reinterpret_cast<struct sockaddr *>(&address), sizeof(address)) != 0) {
+		cerr << "unable to create loopback sockets" << endl;
+		close(receiver);
+		close(sender);
+		return;
+	}
+
+	vector<array<unsigned char, datagram_bytes>> datagrams(burst);
+	unsigned char const * data[burst];
+	size_t bytes[burst];
+	for (size_t i = 0; i < burst; ++i) {
+		rtp::pack(datagrams[i].data(), 2, false, false, 0, false, 96, static_cast<uint16_t>(i),
+			  static_cast<uint32_t>(i * 3000), static_cast<uint32_t>(i % 4));
+		data[i] = datagrams[i].data();
+		bytes[i] = datagrams[i].size();
+	}
+
+	size_t lost = 0;
+	io_type::pool_type pool(256);
+	io_type in(receiver, pool), out(sender, pool);
+	measure_once("udp/loopback_rtp_burst_of_32/udp_batch_io", bursts * burst, [&]() {
+			uint64_t acc = 0;
+			for (size_t b = 0; b < bursts; ++b) {
+				const size_t sent = out.send(data, bytes, burst);
+				lost += burst - sent;
+				for (size_t received = 0; received < sent; ) {
+					const size_t n = in.receive([&acc](io_type::batch & batch) {
+							for (size_t i = 0; i < batch.size(); ++i) {
+								acc += batch.field_value<8>(i);
+							}
+						});
+					if (n == 0 && !wait_readable(receiver)) {
+						lost += sent - received;
+						break;
+					}
+					received += n;
+				}
+			}
+			return acc;
+		});
+
+	measure_once("udp/loopback_rtp_burst_of_32/per_packet", bursts * burst, [&]() {
+			uint64_t acc = 0;
+			array<unsigned char, io_type::buffer_bytes> buffer;
+			for (size_t b = 0; b < bursts; ++b) {
+				size_t sent = 0;
+				for (size_t i = 0; i < burst; ++i) {
+					if (send(sender, data[i], bytes[i], 0) == static_cast<ssize_t>(bytes[i])) {
+						++sent;
+					}
+				}
+				lost += burst - sent;
+				for (size_t received = 0; received < sent; ) {
+					struct sockaddr_storage source;
+					socklen_t source_length = sizeof(source);
+					const ssize_t n = recvfrom(receiver, buffer.data(), buffer.size(), 0,
+								   reinterpret_cast<struct sockaddr *>(&source), &source_length);
+					if (n < 0) {
+						if (!wait_readable(receiver)) {
+							lost += sent - received;
+							break;
+						}
+						continue;
+					}
+					if (static_cast<size_t>(n) >= rtp::traits::bytes) {
+						acc += rtp::field_value<8>(buffer.data());
+					}
+					++received;
+				}
+			}
+			return acc;
+		});
+
+	// The burst is sent as one message split by UDP GSO, and received
+	// coalesced by UDP GRO where they're available
+	using gro_type = udp_batch_io<rtp, io_type::gro_bytes, burst>;
+	gro_type::pool_type gro_pool(64);
+	gro_type gro_in(receiver, gro_pool);
+	if (gro_in.enable_gro()) {
+		vector<unsigned char> segments(burst * datagram_bytes);
+		for (size_t i = 0; i < burst; ++i) {
+			copy(datagrams[i].begin(), datagrams[i].end(), segments.begin() + i * datagram_bytes);
+		}
+		measure_once("udp/loopback_rtp_burst_of_32/udp_batch_io_gso_gro", bursts * burst, [&]() {
+				uint64_t acc = 0;
+				for (size_t b = 0; b < bursts; ++b) {
+					const size_t sent = out.send_segments(segments.data(), segments.size(), datagram_bytes);
+					lost += burst - sent;
+					for (size_t received = 0; received < sent; ) {
+						const size_t n = gro_in.receive([&acc](gro_type::batch & batch) {
+								for (size_t i = 0; i < batch.size(); ++i) {
+									acc += batch.field_value<8>(i);
+								}
+							});
+						if (n == 0 && !wait_readable(receiver)) {
+							lost += sent - received;
+							break;
+						}
+						received += n;
+					}
+				}
+				return acc;
+			});
+	}
+	if (lost != 0) {
+		cerr << "udp: " << lost << " datagrams were lost" << endl;
+	}
+
+	close(receiver);
+	close(sender);
+}
+
+static void bench_capture()
+{
+	// Ethernet, IPv4 and UDP headers precede each RTP header
+	static constexpr size_t rtp_offset = 42;
+	static constexpr size_t packet_bytes = 1400;
+	static constexpr size_t records = 1 << 16;
+
+	char path[] = "/tmp/ptl-bench-XXXXXX";
+	const int fd = mkstemp(path);
+	if (fd < 0) {
+		cerr << "unable to create a temporary capture file" << endl;
+		return;
+	}
+
+	// Host byte order pcap file of RTP packets
+	vector<unsigned char> file(24 + records * (16 + packet_bytes));
+	const uint32_t header[] = {0xa1b2c3d4, 0x00040002, 0, 0, 65535, 1};
+	memcpy(file.data(), header, sizeof(header));
+	for (size_t i = 0; i < records; ++i) {
+		unsigned char * const record = file.data() + 24 + i * (16 + packet_bytes);
+		const uint32_t record_header[] = {static_cast<uint32_t>(i), 0, packet_bytes, packet_bytes};
+		memcpy(record, record_header, sizeof(record_header));
+		rtp::pack(record + 16 + rtp_offset, 2, false, false, 0, false, 96, static_cast<uint16_t>(i),
+			  static_cast<uint32_t>(i * 3000), static_cast<uint32_t>(i % 16));
+	}
+	const bool written = write(fd, file.data(), file.size()) == static_cast<ssize_t>(file.size());
+	close(fd);
+	if (!written) {
+		cerr << "unable to write a temporary capture file" << endl;
+		remove(path);
+		return;
+	}
+
+	// Warm the page cache so both runs read from memory
+	{
+		capture_reader reader{string(path)};
+		reader.for_each([](capture_record const &) {});
+	}
+
+	stringstream name;
+	name << "capture/rtp_ssrc/" << packet_bytes << "B";
+
+	measure_once(name.str() + "/capture_reader", records, [&path]() {
+			capture_reader reader{string(path)};
+			uint64_t acc = 0;
+			reader.for_each<rtp>(rtp_offset, [&acc](capture_record const &, unsigned char const * const buf) {
+					acc += rtp::field_value<8>(buf);
+				});
+			return acc;
+		});
+
+	// read() of the file into a buffer, touching every cache line,
+	// bounds the throughput of reading the file from the page cache
+	measure_once(name.str() + "/read_baseline", records, [&path]() {
+			const int fd = open(path, O_RDONLY);
+			vector<unsigned char> buf(1 << 20);
+			uint64_t acc = 0;
+			ssize_t bytes;
+			while ((bytes = read(fd, buf.data(), buf.size())) > 0) {
+				for (ssize_t i = 0; i < bytes; i += 64) {
+					acc += buf[i];
+				}
+			}
+			close(fd);
+			return acc;
+		});
+
+	remove(path);
+}
+
+static void bench_parallel()
+{
+	// 64 MiB of 188 byte packets
+	static constexpr size_t packet_bytes = 188;
+	static constexpr size_t packets = (64 << 20) / packet_bytes;
+	vector<unsigned char> stream(packets * packet_bytes);
+	for (size_t i = 0; i < packets; ++i) {
+		ts_proto::pack(stream.data() + i * packet_bytes, 0x47, false, false, false,
+			       static_cast<unsigned short>((i * 7919) % 8192));
+	}
+
+	// Histogram of the packets' PIDs
+	using histogram = vector<uint64_t>;
+	auto visit = [](histogram & counts, unsigned char const * const packet) {
+		if (counts.empty()) {
+			counts.resize(8192);
+		}
+		++counts[ts_proto::field_value<4>(packet)];
+	};
+	auto merge = [](histogram & counts, histogram && next) {
+		if (counts.empty()) {
+			counts.swap(next);
+		}
+		for (size_t i = 0; i < next.size(); ++i) {
+			counts[i] += next[i];
+		}
+	};
+
+	const size_t hardware = thread::hardware_concurrency() == 0 ? 1 : thread::hardware_concurrency();
+	for (size_t threads = 1; ; threads *= 2) {
+		threads = threads < hardware ? threads : hardware;
+		stringstream name;
+		name << "parallel/ts_pid_histogram/threads" << threads;
+		measure_once(name.str(), packets, [&]() {
+				const histogram counts = parallel_decode<histogram>(stream.data(), packet_bytes, packets,
+										    visit, merge, threads);
+				return counts[0];
+			});
+		if (threads == hardware) {
+			break;
+		}
+	}
+}
+
+int main(int argc, char * argv[])
+{
+	const bool json = argc > 1 && string(argv[1]) == "--json";
+	if (argc > 1 && !json && string(argv[1]) != "--csv") {
+		cerr << "usage: " << argv[0] << " [--csv | --json]" << endl;
+		return 1;
+	}
+
+	auto bufs = make_buffers<test_proto::traits::array_type>();
+	bench_test_field<test_proto::traits::fields - 1>::run(bufs);
+	bench_rtp();
+	bench_ts();
+	bench_checksum();
+	bench_bitstream();
+	bench_demux();
+	bench_sequence();
+	bench_stack();
+	bench_flow_key();
+	bench_packed_vector();
+	bench_buffer_pool();
+	bench_segmented_header();
+	bench_udp();
+	bench_capture();
+	bench_parallel();
+
+	if (json) {
+		cout << "[" << endl;
+		for (size_t i = 0; i < results.size(); ++i) {
+			cout << "  {\"name\": \"" << results[i].name << "\", "
+			     << "\"ns_per_op\": " << results[i].ns_per_op << ", "
+			     << "\"ops_per_sec\": " << 1e9 / results[i].ns_per_op << "}"
+			     << (i + 1 < results.size() ? "," : "") << endl;
+		}
+		cout << "]" << endl;
+	} else {
+		cout << "name,ns_per_op,ops_per_sec" << endl;
+		for (auto const & r : results) {
+			cout << r.name << "," << r.ns_per_op << "," << 1e9 / r.ns_per_op << endl;
+		}
+	}
+	return 0;
+}
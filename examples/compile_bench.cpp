@@ -0,0 +1,39 @@
+#include <cstdint>
+#include <tuple>
+#include <utility>
+#include "ptl.hpp"
+
+// Number of fields in the benchmarked protocol
+#ifndef PTL_COMPILE_BENCH_FIELDS
+#define PTL_COMPILE_BENCH_FIELDS 128
+#endif
+
+template <std::size_t I>
+using bench_field = ptl::field<(I % 64) + 1, std::uint64_t>;
+
+template <class Sequence>
+struct bench_tuple;
+
+template <std::size_t... I>
+struct bench_tuple<std::index_sequence<I...>>
+{
+	using type = std::tuple<bench_field<I>...>;
+};
+
+using bench_proto = ptl::protocol<bench_tuple<std::make_index_sequence<PTL_COMPILE_BENCH_FIELDS>>::type>;
+
+// Instantiates the get and set accessors of every field
+template <std::size_t... I>
+std::uint64_t touch_fields(unsigned char * const buf, std::index_sequence<I...>)
+{
+	std::uint64_t sum = 0;
+	const int expand[] = { (bench_proto::field_value<I>(buf, I), sum += bench_proto::field_value<I>(buf), 0)... };
+	(void)expand;
+	return sum;
+}
+
+int main()
+{
+	bench_proto::traits::array_type buf = {};
+	return static_cast<int>(touch_fields(buf.data(), std::make_index_sequence<PTL_COMPILE_BENCH_FIELDS>()) & 1);
+}
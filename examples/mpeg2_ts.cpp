@@ -1,6 +1,10 @@
 #include <tuple>
+#include <cstdint>
 #include <iostream>
 #include "ptl.hpp"
+#include "ptl/match.hpp"
+#include "ptl/ts_demux.hpp"
+#include "ptl/ts_framer.hpp"
 using namespace std;
 using namespace ptl;
 
@@ -46,4 +50,50 @@ int main()
 	cout << std::hex << std::showbase << ts_proto::field_value<mpeg2_ts::pusi>(b) << endl;
 	cout << std::hex << std::showbase << ts_proto::field_value<mpeg2_ts::transport_priority>(b) << endl;
 	cout << std::hex << std::showbase << ts_proto::field_value<mpeg2_ts::pid>(b) << endl;
+
+	// Extract the PID of every packet in a buffer of 188 byte packets
+	static constexpr size_t packet_size = 188;
+	unsigned char packets[4 * packet_size] = {};
+	unsigned short pids[4];
+	for (unsigned short i = 0; i < 4; ++i) {
+		ts_proto::pack(packets + i * packet_size, 0x47, false, i == 0, false, 0x100 + i);
+	}
+	ts_proto::extract<mpeg2_ts::pid>(packets, packet_size, 4, pids);
+	for (auto pid : pids) {
+		cout << std::hex << std::showbase << pid << endl;
+	}
+
+	// Filter the packets that start a payload unit on PID 0x100
+	using ts_match = match<ts_proto>;
+	constexpr auto is_start = ts_match::eq<mpeg2_ts::sync_byte>(0x47) &&
+		ts_match::eq<mpeg2_ts::pid>(0x100) &&
+		ts_match::eq<mpeg2_ts::pusi>(true);
+	uint64_t bitmap;
+	cout << std::dec << is_start(packets, packet_size, 4, &bitmap) << " " << bitmap << endl;
+
+	// Frame a stream that starts in the middle of a packet
+	unsigned char stream[5 * packet_size] = {};
+	for (unsigned short i = 0; i < 5; ++i) {
+		ts_proto::pack(stream + i * packet_size, 0x47, false, false, false, 0x200 + i);
+	}
+	ts_framer<ts_proto> framer;
+	const size_t consumed = framer.frame(stream + 100, sizeof(stream) - 100,
+					     [](ts_framer<ts_proto>::packet_type const & packet) {
+						     cout << std::hex << std::showbase
+							  << packet.field_value<mpeg2_ts::pid>() << endl;
+					     });
+	cout << std::dec << consumed << " " << framer.skipped_bytes() << endl;
+
+	// Demultiplex the framed packets, odd PIDs to one queue and even PIDs to another
+	ts_demux<ts_proto, mpeg2_ts::pid> demux(2, 16);
+	for (unsigned short pid = 0x200; pid < 0x205; ++pid) {
+		demux.route(pid, pid % 2);
+	}
+	framer.reset();
+	framer.frame(stream, sizeof(stream), demux);
+	unsigned char const * packet;
+	while (demux.queue(1).try_pop(packet)) {
+		cout << std::hex << std::showbase << ts_proto::field_value<mpeg2_ts::pid>(packet) << endl;
+	}
+	cout << std::dec << demux.delivered(0) << " " << demux.delivered(1) << endl;
 }
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <cstring>
 #include <cstdint>
 #include <iostream>
@@ -8,139 +9,39 @@
 #include <string>
 #include <array>
 #include <type_traits>
+#include <vector>
+#include <memory>
+#include <cstdio>
+#include <fstream>
+#include <thread>
+#include <atomic>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
 #include "ptl.hpp"
+#include "ptl/bit_reader.hpp"
+#include "ptl/bit_writer.hpp"
+#include "ptl/buffer_pool.hpp"
+#include "ptl/capture_reader.hpp"
+#include "ptl/checksum.hpp"
+#include "ptl/columnar_decoder.hpp"
+#include "ptl/flow_key.hpp"
+#include "ptl/header_template.hpp"
+#include "ptl/match.hpp"
+#include "ptl/packed_vector.hpp"
+#include "ptl/parallel_decode.hpp"
+#include "ptl/segmented_header.hpp"
+#include "ptl/sequence_tracker.hpp"
+#include "ptl/stack.hpp"
+#include "ptl/ts_demux.hpp"
+#include "ptl/ts_framer.hpp"
+#include "ptl/udp_batch_io.hpp"
+#include "test_protocol.hpp"
 
 using namespace std;
 using namespace ptl;
 
-using test = tuple<field<1, bool>,
-		   field<1, uint8_t>,
-		   field<2, uint8_t>,
-		   field<3, uint8_t>,
-		   field<4, uint8_t>,
-		   field<5, uint8_t>,
-		   field<6, uint8_t>,
-		   field<7, uint8_t>,
-		   field<8, uint8_t>,
-
-		   field<1, uint16_t>,
-		   field<2, uint16_t>,
-		   field<3, uint16_t>,
-		   field<4, uint16_t>,
-		   field<5, uint16_t>,
-		   field<6, uint16_t>,
-		   field<7, uint16_t>,
-		   field<8, uint16_t>,
-		   field<9, uint16_t>,
-		   field<10, uint16_t>,
-		   field<11, uint16_t>,
-		   field<12, uint16_t>,
-		   field<13, uint16_t>,
-		   field<14, uint16_t>,
-		   field<15, uint16_t>,
-		   field<16, uint16_t>,
-
-		   field<1, uint32_t>,
-		   field<2, uint32_t>,
-		   field<3, uint32_t>,
-		   field<4, uint32_t>,
-		   field<5, uint32_t>,
-		   field<6, uint32_t>,
-		   field<7, uint32_t>,
-		   field<8, uint32_t>,
-		   field<9, uint32_t>,
-		   field<10, uint32_t>,
-		   field<11, uint32_t>,
-		   field<12, uint32_t>,
-		   field<13, uint32_t>,
-		   field<14, uint32_t>,
-		   field<15, uint32_t>,
-		   field<16, uint32_t>,
-		   field<17, uint32_t>,
-		   field<18, uint32_t>,
-		   field<19, uint32_t>,
-		   field<20, uint32_t>,
-		   field<21, uint32_t>,
-		   field<22, uint32_t>,
-		   field<23, uint32_t>,
-		   field<24, uint32_t>,
-		   field<25, uint32_t>,
-		   field<26, uint32_t>,
-		   field<27, uint32_t>,
-		   field<28, uint32_t>,
-		   field<29, uint32_t>,
-		   field<30, uint32_t>,
-		   field<31, uint32_t>,
-		   field<32, uint32_t>,
-
-		   field<1, uint64_t>,
-		   field<2, uint64_t>,
-		   field<3, uint64_t>,
-		   field<4, uint64_t>,
-		   field<5, uint64_t>,
-		   field<6, uint64_t>,
-		   field<7, uint64_t>,
-		   field<8, uint64_t>,
-		   field<9, uint64_t>,
-		   field<10, uint64_t>,
-		   field<11, uint64_t>,
-		   field<12, uint64_t>,
-		   field<13, uint64_t>,
-		   field<14, uint64_t>,
-		   field<15, uint64_t>,
-		   field<16, uint64_t>,
-		   field<17, uint64_t>,
-		   field<18, uint64_t>,
-		   field<19, uint64_t>,
-		   field<20, uint64_t>,
-		   field<21, uint64_t>,
-		   field<22, uint64_t>,
-		   field<23, uint64_t>,
-		   field<24, uint64_t>,
-		   field<25, uint64_t>,
-		   field<26, uint64_t>,
-		   field<27, uint64_t>,
-		   field<28, uint64_t>,
-		   field<29, uint64_t>,
-		   field<30, uint64_t>,
-		   field<31, uint64_t>,
-		   field<32, uint64_t>,
-		   field<33, uint64_t>,
-		   field<34, uint64_t>,
-		   field<35, uint64_t>,
-		   field<36, uint64_t>,
-		   field<37, uint64_t>,
-		   field<38, uint64_t>,
-		   field<39, uint64_t>,
-		   field<40, uint64_t>,
-		   field<41, uint64_t>,
-		   field<42, uint64_t>,
-		   field<43, uint64_t>,
-		   field<44, uint64_t>,
-		   field<45, uint64_t>,
-		   field<46, uint64_t>,
-		   field<47, uint64_t>,
-		   field<48, uint64_t>,
-		   field<49, uint64_t>,
-		   field<50, uint64_t>,
-		   field<51, uint64_t>,
-		   field<52, uint64_t>,
-		   field<53, uint64_t>,
-		   field<54, uint64_t>,
-		   field<55, uint64_t>,
-		   field<56, uint64_t>,
-		   field<57, uint64_t>,
-		   field<58, uint64_t>,
-		   field<59, uint64_t>,
-		   field<60, uint64_t>,
-		   field<61, uint64_t>,
-		   field<62, uint64_t>,
-		   field<63, uint64_t>,
-		   field<64, uint64_t>
-		   >;
-
-using test_proto = protocol<test>;
-
 template <class Field_Traits>
 static void check_field(typename Field_Traits::type::value_type expected,
 			typename Field_Traits::type::value_type real,
@@ -492,11 +393,1999 @@ void test_types()
 	test_type<tuple_size<Types_Tuple>::value - 1, Types_Tuple>::test();
 }
 
+// Checks the word wide accessors against the byte by byte accessors
+template <size_t I, class Protocol>
+struct test_backend
+{
+	static void test(unsigned char * const buf) {
+		using field_traits = typename Protocol::template field_traits<I>;
+		using field = typename field_traits::type;
+		using value_type = typename field::value_type;
+		using byte_fv = ptl::byte_field_value<field::bits, field_traits::byte_bit_offset, value_type>;
+
+		unsigned char * const field_buf = buf + field_traits::byte_index;
+		check_field<field_traits>(byte_fv::get(field_buf),
+					  Protocol::template field_value<I>(buf),
+					  "word and byte backends disagree on get",
+					  buf);
+
+		typename Protocol::traits::array_type expected;
+		memcpy(expected.data(), buf, expected.size());
+
+		const value_type val = static_cast<value_type>(0xa5a5a5a5a5a5a5a5ull);
+		byte_fv::set(expected.data() + field_traits::byte_index, val);
+		Protocol::template field_value<I>(buf, val);
+		if (memcmp(expected.data(), buf, expected.size()) != 0) {
+			stringstream ss;
+			ss << "field: " << std::dec << I
+			   << ", word and byte backends disagree on set";
+			throw logic_error(ss.str());
+		}
+
+		test_backend<I - 1, Protocol>::test(buf);
+	}
+};
+
+template <class Protocol>
+struct test_backend<0, Protocol>
+{
+	static void test(unsigned char * const buf) {
+		using field_traits = typename Protocol::template field_traits<0>;
+		check_field<field_traits>(ptl::byte_field_value<field_traits::type::bits,
+					  field_traits::byte_bit_offset,
+					  typename field_traits::type::value_type>::get(buf),
+					  Protocol::template field_value<0>(buf),
+					  "word and byte backends disagree on get",
+					  buf);
+	}
+};
+
+// Checks unpacked field values against the field accessors
+template <size_t I, class Protocol>
+struct test_unpack
+{
+	static void test(unsigned char const * const buf,
+			 typename Protocol::value_tuple const & values) {
+		using field_traits = typename Protocol::template field_traits<I>;
+		check_field<field_traits>(Protocol::template field_value<I>(buf),
+					  get<I>(values),
+					  "unpack disagrees with field_value",
+					  buf);
+		check_field<field_traits>(Protocol::template field_value<I>(buf),
+					  get<0>(Protocol::template unpack<I>(buf)),
+					  "unpack of a single field disagrees with field_value",
+					  buf);
+		test_unpack<I - 1, Protocol>::test(buf, values);
+	}
+};
+
+template <class Protocol>
+struct test_unpack<0, Protocol>
+{
+	static void test(unsigned char const * const buf,
+			 typename Protocol::value_tuple const & values) {
+		check_field<typename Protocol::template field_traits<0>>(Protocol::template field_value<0>(buf),
+									 get<0>(values),
+									 "unpack disagrees with field_value",
+									 buf);
+	}
+};
+
+template<class Protocol>
+void test_unpacks(unsigned char * const buf)
+{
+	for (size_t i = 0; i < Protocol::traits::bytes; ++i) {
+		buf[i] = static_cast<unsigned char>(i * 59 + 3);
+	}
+	test_unpack<Protocol::traits::fields - 1, Protocol>::test(buf, Protocol::unpack(buf));
+}
+
+// Checks that packing unpacked values reproduces the buffer
+template<class Protocol>
+void test_pack(unsigned char * const buf)
+{
+	for (size_t i = 0; i < Protocol::traits::bytes; ++i) {
+		buf[i] = static_cast<unsigned char>(i * 101 + 17);
+	}
+
+	typename Protocol::traits::array_type packed;
+	packed.fill(0xff);
+	Protocol::pack(packed.data(), Protocol::unpack(buf));
+	if (memcmp(packed.data(), buf, packed.size()) != 0) {
+		throw logic_error("packing unpacked values did not reproduce the buffer");
+	}
+}
+
+// Checks batch extraction against the field accessors
+template <size_t I, class Protocol>
+void check_extract(vector<unsigned char> const & records, const size_t stride, const size_t count)
+{
+	using field_traits = typename Protocol::template field_traits<I>;
+	using value_type = typename field_traits::type::value_type;
+	unique_ptr<value_type[]> values(new value_type[count]);
+	Protocol::template extract<I>(records.data(), stride, count, values.get());
+	for (size_t i = 0; i < count; ++i) {
+		check_field<field_traits>(Protocol::template field_value<I>(records.data() + i * stride),
+					  values[i],
+					  "extract disagrees with field_value",
+					  records.data() + i * stride);
+	}
+}
+
+template <size_t I, class Protocol>
+struct test_extract
+{
+	static void test(vector<unsigned char> const & records, const size_t stride, const size_t count) {
+		check_extract<I, Protocol>(records, stride, count);
+		test_extract<I - 1, Protocol>::test(records, stride, count);
+	}
+};
+
+template <class Protocol>
+struct test_extract<0, Protocol>
+{
+	static void test(vector<unsigned char> const & records, const size_t stride, const size_t count) {
+		check_extract<0, Protocol>(records, stride, count);
+	}
+};
+
+template<class Protocol>
+void test_extracts()
+{
+	// Strides that aren't multiples of the protocol size, and a
+	// record count that isn't a multiple of the vector width
+	for (size_t pad = 0; pad < 3; ++pad) {
+		const size_t stride = Protocol::traits::bytes + pad;
+		const size_t count = 37;
+		vector<unsigned char> records((count - 1) * stride + Protocol::traits::bytes);
+		for (size_t i = 0; i < records.size(); ++i) {
+			records[i] = static_cast<unsigned char>(i * 13 + pad);
+		}
+		test_extract<Protocol::traits::fields - 1, Protocol>::test(records, stride, count);
+	}
+}
+
+template<class Protocol>
+void test_backends(unsigned char * const buf)
+{
+	for (size_t i = 0; i < Protocol::traits::bytes; ++i) {
+		buf[i] = static_cast<unsigned char>(i * 37 + 11);
+	}
+	test_backend<Protocol::traits::fields - 1, Protocol>::test(buf);
+}
+
+// Returns a value for field I that fits in the field's bits
+template <size_t I, class Protocol>
+constexpr field_type<I, typename Protocol::tuple_type> constexpr_value()
+{
+	return static_cast<field_type<I, typename Protocol::tuple_type>>(
+		(0xa5c3f00f9669e11eull >> (I % 16)) &
+		lsb_mask<word_type>(field_bits<I, typename Protocol::tuple_type>::value, 0));
+}
+
+// Sets and reads back every field in a constant expression
+template <class Protocol, size_t... I>
+constexpr bool constexpr_accessors(index_sequence<I...>)
+{
+	unsigned char buf[Protocol::traits::bytes] = {};
+	const int expand[] = { (Protocol::template field_value<I>(buf, constexpr_value<I, Protocol>()), 0)... };
+	(void)expand;
+
+	bool fields_match = true;
+	const bool matches[] = { (Protocol::template field_value<I>(buf) == constexpr_value<I, Protocol>())... };
+	for (bool matched : matches) {
+		fields_match = fields_match && matched;
+	}
+
+	const auto made = Protocol::make(constexpr_value<I, Protocol>()...);
+	bool bytes_match = true;
+	for (size_t i = 0; i < Protocol::traits::bytes; ++i) {
+		bytes_match = bytes_match && made[i] == buf[i];
+	}
+
+	return fields_match && bytes_match &&
+		Protocol::unpack(made) == make_tuple(constexpr_value<I, Protocol>()...);
+}
+
+static_assert(constexpr_accessors<test_proto>(make_index_sequence<test_proto::traits::fields>()),
+	      "field accessors differ in constant expressions");
+
+// Checks columnar decoding against the field accessors
+template<class Protocol, size_t F0, size_t F1, size_t F2>
+void test_columnar()
+{
+	const size_t stride = Protocol::traits::bytes + 5;
+	const size_t count = 3 * ptl::columnar_decoder<Protocol, F0, F1, F2>::chunk_records + 7;
+	vector<unsigned char> records(count * stride);
+	for (size_t i = 0; i < records.size(); ++i) {
+		records[i] = static_cast<unsigned char>(i * 29 + 1);
+	}
+
+	vector<field_type<F0, typename Protocol::tuple_type>> c0(count);
+	vector<field_type<F1, typename Protocol::tuple_type>> c1(count);
+	vector<field_type<F2, typename Protocol::tuple_type>> c2(count);
+	ptl::columnar_decoder<Protocol, F0, F1, F2> decoder;
+	decoder.decode(records.data(), stride, count, c0.data(), c1.data(), c2.data());
+
+	for (size_t i = 0; i < count; ++i) {
+		unsigned char const * const buf = records.data() + i * stride;
+		check_field<typename Protocol::template field_traits<F0>>(Protocol::template field_value<F0>(buf), c0[i],
+									  "columnar decode disagrees with field_value", buf);
+		check_field<typename Protocol::template field_traits<F1>>(Protocol::template field_value<F1>(buf), c1[i],
+									  "columnar decode disagrees with field_value", buf);
+		check_field<typename Protocol::template field_traits<F2>>(Protocol::template field_value<F2>(buf), c2[i],
+									  "columnar decode disagrees with field_value", buf);
+	}
+}
+
+// Checks fused predicates against direct field comparisons
+template<class Protocol, size_t F0, size_t F1>
+void test_match()
+{
+	using m = ptl::match<Protocol>;
+	const size_t stride = Protocol::traits::bytes;
+	const size_t count = 200;
+	vector<unsigned char> records(count * stride);
+	for (size_t i = 0; i < records.size(); ++i) {
+		records[i] = static_cast<unsigned char>(i * 7 + i / stride);
+	}
+
+	// Make every third record match
+	const auto v0 = Protocol::template field_value<F0>(records.data());
+	const auto v1 = Protocol::template field_value<F1>(records.data());
+	for (size_t i = 0; i < count; i += 3) {
+		Protocol::template field_value<F0>(records.data() + i * stride, v0);
+		Protocol::template field_value<F1>(records.data() + i * stride, v1);
+	}
+
+	const auto pred = m::template eq<F0>(v0) && m::template eq<F1>(v1);
+	vector<uint64_t> bitmap((count + 63) / 64);
+	size_t expected_matches = 0;
+	const size_t matches = pred(records.data(), stride, count, bitmap.data());
+	for (size_t i = 0; i < count; ++i) {
+		unsigned char const * const buf = records.data() + i * stride;
+		const bool expected = Protocol::template field_value<F0>(buf) == v0 &&
+			Protocol::template field_value<F1>(buf) == v1;
+		expected_matches += expected;
+		if (pred(buf) != expected || ((bitmap[i / 64] >> (i % 64)) & 1) != expected) {
+			stringstream ss;
+			ss << "record: " << std::dec << i << ", predicate disagrees with field_value";
+			throw logic_error(ss.str());
+		}
+	}
+	if (matches != expected_matches) {
+		throw logic_error("predicate match count is wrong");
+	}
+
+	// Contradicting predicates never match
+	const auto never = m::template eq<F0>(v0) && m::template eq<F0>(v0 ^ 1);
+	if (never(records.data())) {
+		throw logic_error("contradicting predicates matched");
+	}
+}
+
+using mixed = tuple<field<4, uint8_t>,
+		    field<4, uint8_t>,
+		    field<16, uint16_t, byte_order::little>,
+		    field<3, uint8_t>,
+		    field<5, uint8_t>,
+		    field<32, uint32_t, byte_order::little>,
+		    field<24, uint32_t, byte_order::little>,
+		    field<64, uint64_t, byte_order::little>,
+		    field<16, uint16_t>
+		    >;
+
+using mixed_proto = protocol<mixed>;
+
+// The field offsets are a prefix sum of the fields' bits
+static_assert(field_offsets<mixed>::offset(0) == 0 && field_offsets<mixed>::offset(2) == 8 &&
+	      field_offsets<mixed>::offset(5) == 32 && field_offsets<mixed>::offset(8) == 152 &&
+	      field_offsets<mixed>::offset(9) == 168, "field offsets are not a prefix sum");
+static_assert(field_bit_offset<6, mixed>::value == 64 && field_first_byte<7, mixed>::value == 11 &&
+	      field_last_byte<7, mixed>::value == 18 && !field_spans_bytes<3, mixed>::value &&
+	      mixed_proto::traits::bits == 168, "field traits disagree with the field offsets");
+
+static_assert(constexpr_accessors<mixed_proto>(make_index_sequence<mixed_proto::traits::fields>()),
+	      "mixed byte order accessors differ in constant expressions");
+
+// Checks little endian fields in a mixed byte order protocol
+void test_byte_order()
+{
+	mixed_proto::traits::array_type buf;
+	buf.fill(0);
+
+	mixed_proto::field_value<2>(buf.data(), 0x1234);
+	mixed_proto::field_value<5>(buf.data(), 0x89abcdef);
+	mixed_proto::field_value<6>(buf.data(), 0x563412);
+	mixed_proto::field_value<7>(buf.data(), 0x0807060504030201ull);
+	mixed_proto::field_value<8>(buf.data(), 0x1234);
+
+	const mixed_proto::traits::array_type expected = {{0x00, 0x34, 0x12, 0x00,
+							   0xef, 0xcd, 0xab, 0x89,
+							   0x12, 0x34, 0x56,
+							   0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08,
+							   0x12, 0x34}};
+	if (buf != expected) {
+		throw logic_error("little endian fields were stored in the wrong byte order");
+	}
+
+	const auto values = mixed_proto::unpack(buf.data());
+	if (get<2>(values) != 0x1234 || get<5>(values) != 0x89abcdef ||
+	    get<6>(values) != 0x563412 || get<7>(values) != 0x0807060504030201ull ||
+	    get<8>(values) != 0x1234) {
+		throw logic_error("unpack of little endian fields failed");
+	}
+
+	mixed_proto::traits::array_type packed;
+	mixed_proto::pack(packed.data(), values);
+	if (packed != expected) {
+		throw logic_error("pack of little endian fields failed");
+	}
+
+	uint32_t extracted;
+	mixed_proto::extract<5>(buf.data(), buf.size(), 1, &extracted);
+	if (extracted != 0x89abcdef) {
+		throw logic_error("extract of a little endian field failed");
+	}
+
+	using m = ptl::match<mixed_proto>;
+	if (!(m::eq<2>(0x1234) && m::eq<7>(0x0807060504030201ull))(buf.data()) ||
+	    m::eq<2>(0x3412)(buf.data())) {
+		throw logic_error("match of little endian fields failed");
+	}
+
+	// A value wider than its field never matches, rather than being truncated
+	mixed_proto::field_value<3>(buf.data(), 0);
+	mixed_proto::field_value<4>(buf.data(), 0x1f);
+	if (!m::eq<3>(0)(buf.data()) || m::eq<3>(8)(buf.data()) || m::eq<4>(0x3f)(buf.data()) ||
+	    (m::eq<4>(0x1f) && m::eq<3>(0x10))(buf.data())) {
+		throw logic_error("match of a value wider than its field matched");
+	}
+}
+
+using ts_header = tuple<field<8, uint8_t>,
+			field<1, bool>,
+			field<1, bool>,
+			field<1, bool>,
+			field<13, uint16_t>
+			>;
+
+using ts_header_proto = protocol<ts_header>;
+
+// Returns a stream of count packets of the given spacing with PIDs
+// starting at first_pid, preceded by garbage bytes
+vector<unsigned char> ts_stream(const size_t garbage, const size_t count, const size_t stride,
+				const size_t sync_offset, const uint16_t first_pid)
+{
+	vector<unsigned char> stream(garbage + count * stride, 0xff);
+	for (size_t i = 0; i < garbage; ++i) {
+		// Lone sync bytes that must not be mistaken for a packet
+		stream[i] = i % 3 == 0 ? 0x47 : 0x00;
+	}
+	for (size_t i = 0; i < count; ++i) {
+		ts_header_proto::pack(stream.data() + garbage + i * stride + sync_offset,
+				      0x47, false, false, false, static_cast<uint16_t>(first_pid + i));
+	}
+	return stream;
+}
+
+// Frames stream in chunks of chunk bytes, carrying unconsumed bytes to the next chunk
+vector<uint16_t> frame_stream(ts_framer<ts_header_proto> & framer,
+			      vector<unsigned char> const & stream, const size_t chunk)
+{
+	vector<uint16_t> pids;
+	vector<unsigned char> pending;
+	for (size_t offset = 0; offset < stream.size(); offset += chunk) {
+		const size_t end = offset + chunk < stream.size() ? offset + chunk : stream.size();
+		pending.insert(pending.end(), stream.begin() + offset, stream.begin() + end);
+		const size_t consumed = framer.frame(pending.data(), pending.size(),
+						     [&pids](ts_framer<ts_header_proto>::packet_type const & packet) {
+							     pids.push_back(packet.field_value<4>());
+						     });
+		pending.erase(pending.begin(), pending.begin() + consumed);
+	}
+	return pids;
+}
+
+// Checks framing, resynchronization, and packet size detection
+void test_ts_framer()
+{
+	// Corrupt the sync byte of packet 8 of 20
+	vector<unsigned char> stream = ts_stream(40, 20, 188, 0, 0x100);
+	stream[40 + 8 * 188] = 0x00;
+
+	for (size_t chunk : {stream.size(), size_t(1000), size_t(100)}) {
+		ts_framer<ts_header_proto> framer(ts_packet_size::ts);
+		const vector<uint16_t> pids = frame_stream(framer, stream, chunk);
+		if (pids.size() != 19 || framer.sync_losses() != 1 || framer.skipped_bytes() != 40 + 188) {
+			throw logic_error("ts_framer did not resynchronize after a corrupt packet");
+		}
+		for (size_t i = 0; i < pids.size(); ++i) {
+			if (pids[i] != 0x100 + i + (i >= 8)) {
+				throw logic_error("ts_framer yielded the wrong packet");
+			}
+		}
+	}
+
+	const size_t strides[] = {188, 192, 204};
+	const size_t sync_offsets[] = {0, 4, 0};
+	for (size_t s = 0; s < 3; ++s) {
+		const vector<unsigned char> stream = ts_stream(3 + s, 8, strides[s], sync_offsets[s], 0x20);
+		ts_framer<ts_header_proto> framer;
+		const vector<uint16_t> pids = frame_stream(framer, stream, 190);
+		if (framer.packet_size() != strides[s] || pids.size() != 8 ||
+		    pids[0] != 0x20 || pids.back() != 0x20 + pids.size() - 1) {
+			throw logic_error("ts_framer did not detect the packet size");
+		}
+	}
+}
+
+// Appends value to bytes in the given byte order
+template <class T>
+void append(vector<unsigned char> & bytes, const T value, const byte_order order)
+{
+	for (size_t i = 0; i < sizeof(T); ++i) {
+		const size_t shift = order == byte_order::little ? i * 8 : (sizeof(T) - 1 - i) * 8;
+		bytes.push_back(static_cast<unsigned char>(value >> shift));
+	}
+}
+
+// Returns a ts packet prefixed by a four byte link header
+vector<unsigned char> capture_packet(const uint16_t pid)
+{
+	vector<unsigned char> packet(4 + 188, 0xff);
+	ts_header_proto::pack(packet.data() + 4, 0x47, false, false, false, pid);
+	return packet;
+}
+
+// Returns a pcap file of count packets, the last truncated if truncate is true
+vector<unsigned char> pcap_file(const byte_order order, const size_t count, const bool truncate)
+{
+	vector<unsigned char> file;
+	append<uint32_t>(file, 0xa1b2c3d4, order);
+	append<uint16_t>(file, 2, order);
+	append<uint16_t>(file, 4, order);
+	append<uint32_t>(file, 0, order);
+	append<uint32_t>(file, 0, order);
+	append<uint32_t>(file, 65535, order);
+	append<uint32_t>(file, 147, order);
+	for (size_t i = 0; i < count; ++i) {
+		const vector<unsigned char> packet = capture_packet(static_cast<uint16_t>(0x30 + i));
+		append<uint32_t>(file, static_cast<uint32_t>(1000 + i), order);
+		append<uint32_t>(file, 500, order);
+		append<uint32_t>(file, static_cast<uint32_t>(packet.size()), order);
+		append<uint32_t>(file, static_cast<uint32_t>(packet.size()), order);
+		file.insert(file.end(), packet.begin(), packet.end());
+	}
+	if (truncate) {
+		file.resize(file.size() - 10);
+	}
+	return file;
+}
+
+// Returns a pcapng file with count enhanced packet blocks and one simple packet block
+vector<unsigned char> pcapng_file(const byte_order order, const size_t count)
+{
+	vector<unsigned char> file;
+	append<uint32_t>(file, 0x0a0d0d0a, order);
+	append<uint32_t>(file, 28, order);
+	append<uint32_t>(file, 0x1a2b3c4d, order);
+	append<uint16_t>(file, 1, order);
+	append<uint16_t>(file, 0, order);
+	append<uint64_t>(file, ~uint64_t(0), order);
+	append<uint32_t>(file, 28, order);
+
+	// Interface with nanosecond timestamps
+	append<uint32_t>(file, 1, order);
+	append<uint32_t>(file, 32, order);
+	append<uint16_t>(file, 147, order);
+	append<uint16_t>(file, 0, order);
+	append<uint32_t>(file, 0, order);
+	append<uint16_t>(file, 9, order);
+	append<uint16_t>(file, 1, order);
+	append<uint32_t>(file, 0x09000000, byte_order::big);
+	append<uint32_t>(file, 0, order);
+	append<uint32_t>(file, 32, order);
+
+	for (size_t i = 0; i < count; ++i) {
+		const vector<unsigned char> packet = capture_packet(static_cast<uint16_t>(0x30 + i));
+		const uint64_t ts = 2000000000ull + i;
+		const uint32_t length = static_cast<uint32_t>(32 + packet.size());
+		append<uint32_t>(file, 6, order);
+		append<uint32_t>(file, length, order);
+		append<uint32_t>(file, 0, order);
+		append<uint32_t>(file, static_cast<uint32_t>(ts >> 32), order);
+		append<uint32_t>(file, static_cast<uint32_t>(ts), order);
+		append<uint32_t>(file, static_cast<uint32_t>(packet.size()), order);
+		append<uint32_t>(file, static_cast<uint32_t>(packet.size()), order);
+		file.insert(file.end(), packet.begin(), packet.end());
+		append<uint32_t>(file, length, order);
+	}
+
+	// A record too short for the header protocol
+	append<uint32_t>(file, 3, order);
+	append<uint32_t>(file, 20, order);
+	append<uint32_t>(file, 2, order);
+	append<uint32_t>(file, 0xffffffff, byte_order::big);
+	append<uint32_t>(file, 20, order);
+	return file;
+}
+
+// Returns the PIDs of a capture's records
+vector<uint16_t> capture_pids(capture_reader & reader, size_t & records)
+{
+	vector<uint16_t> pids;
+	records = reader.for_each([](capture_record const &) {});
+	reader.for_each<ts_header_proto>(4, [&pids](capture_record const &, unsigned char const * const header) {
+			pids.push_back(ts_header_proto::field_value<4>(header));
+		});
+	return pids;
+}
+
+// Checks reading pcap and pcapng captures in both byte orders
+void test_capture_reader()
+{
+	for (const byte_order order : {byte_order::little, byte_order::big}) {
+		const vector<unsigned char> pcap = pcap_file(order, 5, true);
+		capture_reader reader(pcap.data(), pcap.size());
+		size_t records;
+		const vector<uint16_t> pids = capture_pids(reader, records);
+		if (reader.file_format() != capture_reader::format::pcap || records != 4 ||
+		    pids != vector<uint16_t>{0x30, 0x31, 0x32, 0x33} || !reader.truncated()) {
+			throw logic_error("pcap records were read incorrectly");
+		}
+
+		const vector<unsigned char> pcapng = pcapng_file(order, 3);
+		capture_reader ng_reader(pcapng.data(), pcapng.size());
+		uint64_t last_timestamp = 0;
+		ng_reader.for_each([&last_timestamp](capture_record const & record) {
+				last_timestamp = record.size > 4 ? record.timestamp : last_timestamp;
+			});
+		if (ng_reader.file_format() != capture_reader::format::pcapng ||
+		    capture_pids(ng_reader, records) != vector<uint16_t>{0x30, 0x31, 0x32} ||
+		    records != 4 || ng_reader.truncated() || last_timestamp != 2000000002ull) {
+			throw logic_error("pcapng records were read incorrectly");
+		}
+	}
+
+	// A section may follow one of the opposite byte order
+	vector<unsigned char> mixed = pcapng_file(byte_order::little, 3);
+	const vector<unsigned char> big_section = pcapng_file(byte_order::big, 2);
+	mixed.insert(mixed.end(), big_section.begin(), big_section.end());
+	{
+		capture_reader reader(mixed.data(), mixed.size());
+		size_t records;
+		if (capture_pids(reader, records) != vector<uint16_t>{0x30, 0x31, 0x32, 0x30, 0x31} ||
+		    records != 7 || reader.truncated()) {
+			throw logic_error("mixed byte order pcapng sections were read incorrectly");
+		}
+	}
+
+	// Read a capture file through a memory mapping
+	const vector<unsigned char> pcap = pcap_file(byte_order::little, 3, false);
+	char path[] = "/tmp/ptl-test-XXXXXX";
+	const int fd = mkstemp(path);
+	if (fd < 0) {
+		throw runtime_error("unable to create a temporary capture file");
+	}
+	close(fd);
+	ofstream(path, ios::binary).write(reinterpret_cast<char const *>(pcap.data()), pcap.size());
+	size_t records;
+	uint64_t first_timestamp = 0;
+	{
+		capture_reader reader{string(path)};
+		reader.for_each([&first_timestamp](capture_record const & record) {
+				first_timestamp = first_timestamp == 0 ? record.timestamp : first_timestamp;
+			});
+		const vector<uint16_t> pids = capture_pids(reader, records);
+		remove(path);
+		if (records != 3 || pids != vector<uint16_t>{0x30, 0x31, 0x32} || reader.truncated() ||
+		    first_timestamp != 1000000500000ull) {
+			throw logic_error("mapped pcap records were read incorrectly");
+		}
+	}
+}
+
+// Checks that parallel decoding matches serial decoding for any thread count
+void test_parallel_decode()
+{
+	static constexpr size_t count = 10007;
+	vector<unsigned char> packets(count * 188);
+	vector<unsigned char const *> framed(count);
+	vector<uint16_t> expected(count);
+	for (size_t i = 0; i < count; ++i) {
+		expected[i] = static_cast<uint16_t>((i * 7919) % 8192);
+		ts_header_proto::pack(packets.data() + i * 188, 0x47, false, false, false, expected[i]);
+		framed[i] = packets.data() + i * 188;
+	}
+
+	// Appending isn't commutative, so the merge order is checked
+	auto visit = [](vector<uint16_t> & pids, unsigned char const * const packet) {
+		pids.push_back(ts_header_proto::field_value<4>(packet));
+	};
+	auto merge = [](vector<uint16_t> & pids, vector<uint16_t> && next) {
+		pids.insert(pids.end(), next.begin(), next.end());
+	};
+
+	for (size_t threads : {1, 2, 3, 8, 64}) {
+		if (parallel_decode<vector<uint16_t>>(packets.data(), 188, count, visit, merge, threads) != expected ||
+		    parallel_decode<vector<uint16_t>>(framed.data(), count, visit, merge, threads) != expected) {
+			throw logic_error("parallel decoding differs from serial decoding");
+		}
+	}
+
+	// Each chunk's bool result is written to its own bytes
+	auto any = [](bool & matched, bool && next) {
+		matched = matched || next;
+	};
+	const bool has_pid = parallel_decode<bool>(packets.data(), 188, count,
+						   [](bool & matched, unsigned char const * const packet) {
+							   matched = matched || ts_header_proto::field_value<4>(packet) == 0x1fff;
+						   },
+						   any, 8);
+	const bool has_pusi = parallel_decode<bool>(packets.data(), 188, count,
+						    [](bool & matched, unsigned char const * const packet) {
+							    matched = matched || ts_header_proto::field_value<2>(packet);
+						    },
+						    any, 8);
+	if (!has_pid || has_pusi) {
+		throw logic_error("parallel decoding of bool results is incorrect");
+	}
+
+	if (!parallel_decode<vector<uint16_t>>(packets.data(), 188, 0, visit, merge, 4).empty()) {
+		throw logic_error("parallel decoding of no records returned values");
+	}
+
+	bool rethrown = false;
+	try {
+		parallel_decode<size_t>(packets.data(), 188, count,
+					[](size_t &, unsigned char const * const packet) {
+						if (ts_header_proto::field_value<4>(packet) == 7919) {
+							throw runtime_error("visit failed");
+						}
+					},
+					[](size_t &, size_t &&) {}, 4);
+	} catch (runtime_error const &) {
+		rethrown = true;
+	}
+	if (!rethrown) {
+		throw logic_error("parallel decoding didn't rethrow a visit exception");
+	}
+}
+
+using rtp_header = tuple<field<2, uint8_t>,
+			 field<1, bool>,
+			 field<1, bool>,
+			 field<4, uint8_t>,
+			 field<1, bool>,
+			 field<7, uint8_t>,
+			 field<16, uint16_t>,
+			 field<32, uint32_t>,
+			 field<32, uint32_t>
+			 >;
+
+using rtp_header_proto = protocol<rtp_header>;
+
+// Marker, sequence number and timestamp are dynamic
+using rtp_template = header_template<rtp_header_proto, 4, 6, 7>;
+
+// The template is built at compile time with the dynamic fields cleared
+constexpr rtp_template compiled_rtp_template(2, false, false, 0, true, 96, 0xffff, 0xffffffff, 0x12345678);
+static_assert(compiled_rtp_template.word(0) == 0x8060000000000000ull &&
+	      compiled_rtp_template.word(1) == 0x1234567800000000ull,
+	      "header template words are incorrect");
+
+// A golden RTP header built by the compiler
+constexpr auto rtp_golden = rtp_header_proto::make(2, false, false, 0, true, 96, 0x1234, 0x89abcdef, 0x12345678);
+static_assert(rtp_golden[0] == 0x80 && rtp_golden[1] == 0xe0 && rtp_golden[2] == 0x12 && rtp_golden[3] == 0x34 &&
+	      rtp_header_proto::field_value<7>(rtp_golden) == 0x89abcdef &&
+	      rtp_header_proto::field_value<8>(rtp_golden) == 0x12345678,
+	      "constant RTP header is incorrect");
+
+// Checks that emitted headers match packed headers
+void test_header_template()
+{
+	rtp_template tmpl = compiled_rtp_template;
+	rtp_header_proto::traits::array_type emitted;
+	rtp_header_proto::traits::array_type packed;
+
+	emitted.fill(0xaa);
+	tmpl.emit(emitted.data(), false, 0x1234, 0x89abcdef);
+	rtp_header_proto::pack(packed.data(), 2, false, false, 0, false, 96, 0x1234, 0x89abcdef, 0x12345678);
+	if (emitted != packed) {
+		throw logic_error("header template emitted the wrong header");
+	}
+
+	// The sequence number and timestamp wrap around
+	for (uint32_t i = 0; i < 3; ++i) {
+		emitted.fill(0xaa);
+		tmpl.emit(emitted.data());
+		rtp_header_proto::pack(packed.data(), 2, false, false, 0, true, 96,
+				       static_cast<uint16_t>(0xffff + i), 0xffffffff + i * 3000, 0x12345678);
+		if (emitted != packed) {
+			throw logic_error("header template emitted the wrong current header");
+		}
+		tmpl.advance<6>();
+		tmpl.advance<7>(3000);
+	}
+
+	tmpl.set<4>(false);
+	if (tmpl.get<4>() || tmpl.get<6>() != 2 || tmpl.get<7>() != 8999) {
+		throw logic_error("header template dynamic values are incorrect");
+	}
+}
+
+using ipv4_header = tuple<field<4, uint8_t>,
+			  field<4, uint8_t>,
+			  field<6, uint8_t>,
+			  field<2, uint8_t>,
+			  field<16, uint16_t>,
+			  field<16, uint16_t>,
+			  field<3, uint8_t>,
+			  field<13, uint16_t>,
+			  field<8, uint8_t>,
+			  field<8, uint8_t>,
+			  field<16, uint16_t>,
+			  field<32, uint32_t>,
+			  field<32, uint32_t>
+			  >;
+
+using ipv4_header_proto = protocol<ipv4_header>;
+using ipv4_checksum = internet_checksum_field<ipv4_header_proto, 10>;
+using udp_style_checksum = internet_checksum_field<ipv4_header_proto, 10, true>;
+
+// A 5 byte header whose last field ends in its odd last byte
+using odd_header = tuple<field<16, uint16_t>,
+			 field<16, uint16_t>,
+			 field<8, uint8_t>
+			 >;
+
+using odd_header_proto = protocol<odd_header>;
+using odd_checksum = internet_checksum_field<odd_header_proto, 0>;
+
+using pat_section = tuple<field<8, uint8_t>,
+			  field<1, bool>,
+			  field<1, bool>,
+			  field<2, uint8_t>,
+			  field<12, uint16_t>,
+			  field<16, uint16_t>,
+			  field<2, uint8_t>,
+			  field<5, uint8_t>,
+			  field<1, bool>,
+			  field<8, uint8_t>,
+			  field<8, uint8_t>,
+			  field<16, uint16_t>,
+			  field<3, uint8_t>,
+			  field<13, uint16_t>,
+			  field<32, uint32_t>
+			  >;
+
+using pat_section_proto = protocol<pat_section>;
+using pat_crc = crc32_mpeg2_field<pat_section_proto, 14>;
+
+// Sums bytes one 16 bit word at a time as RFC 1071 describes
+uint16_t naive_ones_complement_sum(unsigned char const * const data, const size_t bytes)
+{
+	uint32_t sum = 0;
+	for (size_t i = 0; i < bytes; i += 2) {
+		sum += static_cast<uint32_t>(data[i]) << 8;
+		sum += i + 1 < bytes ? data[i + 1] : 0;
+	}
+	while (sum >> 16) {
+		sum = (sum >> 16) + (sum & 0xffff);
+	}
+	return static_cast<uint16_t>(sum);
+}
+
+// Computes the MPEG-2 CRC_32 one bit at a time
+uint32_t naive_crc32_mpeg2(unsigned char const * const data, const size_t bytes)
+{
+	uint32_t crc = 0xffffffff;
+	for (size_t i = 0; i < bytes; ++i) {
+		crc ^= static_cast<uint32_t>(data[i]) << 24;
+		for (int bit = 0; bit < 8; ++bit) {
+			crc = (crc & 0x80000000) ? (crc << 1) ^ 0x04c11db7 : crc << 1;
+		}
+	}
+	return crc;
+}
+
+// Checks the checksum kernels and their protocol bindings
+void test_checksum()
+{
+	vector<unsigned char> data(300);
+	for (size_t i = 0; i < data.size(); ++i) {
+		data[i] = static_cast<unsigned char>(i * 37 + 11);
+	}
+	for (size_t offset = 0; offset < 4; ++offset) {
+		for (size_t bytes = 0; bytes + offset <= data.size(); bytes += 7) {
+			if (ones_complement_sum(data.data() + offset, bytes) !=
+			    naive_ones_complement_sum(data.data() + offset, bytes)) {
+				throw logic_error("one's complement sum is incorrect");
+			}
+			if (crc32_mpeg2(data.data() + offset, bytes) != naive_crc32_mpeg2(data.data() + offset, bytes)) {
+				throw logic_error("CRC32 is incorrect");
+			}
+		}
+	}
+
+	// The check value of the CRC-32/MPEG-2 catalogue entry
+	unsigned char const check[] = {'1', '2', '3', '4', '5', '6', '7', '8', '9'};
+	if (crc32_mpeg2(check, sizeof(check)) != 0x0376e6e7) {
+		throw logic_error("CRC32 check value is incorrect");
+	}
+
+	// A single program PAT section
+	pat_section_proto::traits::array_type pat = {{0x00, 0xb0, 0x0d, 0x00, 0x01, 0xc1, 0x00, 0x00,
+						      0x00, 0x01, 0xf0, 0x00, 0x2a, 0xb1, 0x04, 0xb2}};
+	if (!pat_crc::verify(pat.data()) || pat_crc::compute(pat.data()) != 0x2ab104b2 ||
+	    crc32_mpeg2(pat.data(), pat.size()) != 0) {
+		throw logic_error("PAT section CRC is incorrect");
+	}
+	pat_section_proto::field_value<13>(pat.data(), 0x100);
+	pat_crc::update(pat.data());
+	if (!pat_crc::verify(pat.data()) || crc32_mpeg2(pat.data(), pat.size()) != 0) {
+		throw logic_error("updated PAT section CRC is incorrect");
+	}
+
+	// An IPv4 header with a checksum of 0xb861
+	ipv4_header_proto::traits::array_type ip = {{0x45, 0x00, 0x00, 0x73, 0x00, 0x00, 0x40, 0x00, 0x40, 0x11,
+						     0xb8, 0x61, 0xc0, 0xa8, 0x00, 0x01, 0xc0, 0xa8, 0x00, 0xc7}};
+	if (!ipv4_checksum::verify(ip.data()) || ipv4_checksum::compute(ip.data()) != 0xb861 ||
+	    internet_checksum(ip.data(), ip.size()) != 0) {
+		throw logic_error("IPv4 header checksum is incorrect");
+	}
+	ipv4_header_proto::field_value<10>(ip.data(), 0);
+	ipv4_checksum::update(ip.data());
+	if (ipv4_header_proto::field_value<10>(ip.data()) != 0xb861) {
+		throw logic_error("updated IPv4 header checksum is incorrect");
+	}
+
+	// A zero sum's checksum is 0xffff, and a sum of 0xffff's checksum
+	// is zero, as RFC 1071 computes them
+	ipv4_header_proto::traits::array_type zeros{};
+	if (ipv4_checksum::compute(zeros.data()) != 0xffff) {
+		throw logic_error("all zero IPv4 header checksum is incorrect");
+	}
+	ipv4_checksum::update(zeros.data());
+	if (!ipv4_checksum::verify(zeros.data())) {
+		throw logic_error("all zero IPv4 header checksum doesn't verify");
+	}
+	ipv4_header_proto::traits::array_type ones = ip;
+	ipv4_header_proto::field_value<4>(ones.data(), 0);
+	ipv4_header_proto::field_value<4>(ones.data(), ipv4_checksum::compute(ones.data()));
+	if (ipv4_checksum::compute(ones.data()) != 0) {
+		throw logic_error("IPv4 header checksum of a 0xffff sum is incorrect");
+	}
+	ipv4_checksum::update(ones.data());
+	if (!ipv4_checksum::verify(ones.data())) {
+		throw logic_error("zero IPv4 header checksum doesn't verify");
+	}
+
+	// UDP sends a zero checksum as 0xffff, also when it's updated
+	if (udp_style_checksum::compute(ones.data()) != 0xffff) {
+		throw logic_error("zero UDP style checksum isn't sent as 0xffff");
+	}
+	udp_style_checksum::update(ones.data());
+	if (!udp_style_checksum::verify(ones.data())) {
+		throw logic_error("UDP style checksum of 0xffff doesn't verify");
+	}
+	udp_style_checksum::field_value<8>(zeros.data(), 1);
+	udp_style_checksum::field_value<8>(zeros.data(), 0);
+	if (ipv4_header_proto::field_value<10>(zeros.data()) != 0xffff || !udp_style_checksum::verify(zeros.data())) {
+		throw logic_error("incrementally updated all zero UDP style checksum is incorrect");
+	}
+
+	// The last field of an odd length header is updated without
+	// reading past the header
+	unique_ptr<unsigned char[]> odd(new unsigned char[odd_header_proto::traits::bytes]);
+	odd_header_proto::pack(odd.get(), 0, 0x1234, 0x56);
+	odd_checksum::update(odd.get());
+	for (unsigned value = 0; value < 256; value += 15) {
+		odd_checksum::field_value<2>(odd.get(), static_cast<uint8_t>(value));
+		if (!odd_checksum::verify(odd.get()) ||
+		    odd_header_proto::field_value<0>(odd.get()) != odd_checksum::compute(odd.get())) {
+			throw logic_error("incrementally updated odd length header checksum is incorrect");
+		}
+	}
+
+	// Incremental updates match recomputing the checksum
+	for (uint8_t ttl = 0x40; ttl > 0; --ttl) {
+		ipv4_checksum::field_value<8>(ip.data(), ttl);
+		ipv4_checksum::field_value<7>(ip.data(), static_cast<uint16_t>(ttl * 97));
+		ipv4_checksum::field_value<3>(ip.data(), static_cast<uint8_t>(ttl & 3));
+		ipv4_checksum::field_value<11>(ip.data(), 0x0a000000u + ttl);
+		if (!ipv4_checksum::verify(ip.data()) ||
+		    ipv4_header_proto::field_value<10>(ip.data()) != ipv4_checksum::compute(ip.data())) {
+			throw logic_error("incrementally updated IPv4 header checksum is incorrect");
+		}
+	}
+}
+
+// Appends bits to a bit stream, most significant bit first
+struct bit_stream
+{
+	vector<unsigned char> bytes;
+	size_t bits = 0;
+
+	void append(const uint64_t value, const size_t n)
+	{
+		for (size_t i = n; i-- > 0; ++bits) {
+			if (bits % 8 == 0) {
+				bytes.push_back(0);
+			}
+			bytes.back() |= static_cast<unsigned char>(((value >> i) & 1) << (7 - bits % 8));
+		}
+	}
+
+	void append_ue(const uint32_t value)
+	{
+		const uint64_t code = static_cast<uint64_t>(value) + 1;
+		size_t n = 0;
+		while ((code >> n) > 1) {
+			++n;
+		}
+		append(0, n);
+		append(code, n + 1);
+	}
+
+	void append_se(const int32_t value)
+	{
+		append_ue(value > 0 ? static_cast<uint32_t>(value) * 2 - 1 : static_cast<uint32_t>(-static_cast<int64_t>(value)) * 2);
+	}
+};
+
+// Checks sequential reads of fixed, variable and Exp-Golomb coded fields
+void test_bit_reader()
+{
+	bit_stream stream;
+	vector<uint64_t> values;
+	for (size_t n = 1; n <= 64; ++n) {
+		values.push_back(0x9e3779b97f4a7c15ull * n >> (64 - n));
+		stream.append(values.back(), n);
+		stream.append_ue(static_cast<uint32_t>(n * n * 1000));
+		stream.append_se(n % 2 ? -static_cast<int32_t>(n) : static_cast<int32_t>(n * 3));
+	}
+	stream.append_ue(0);
+	stream.append_ue(0xfffffffe);
+	stream.append_se(-0x7fffffff);
+
+	bit_reader reader(stream.bytes.data(), stream.bytes.size());
+	for (size_t n = 1; n <= 64; ++n) {
+		if (reader.read(n) != values[n - 1] ||
+		    reader.read_ue() != n * n * 1000 ||
+		    reader.read_se() != (n % 2 ? -static_cast<int32_t>(n) : static_cast<int32_t>(n * 3))) {
+			throw logic_error("bit reader read the wrong value");
+		}
+	}
+	if (reader.read_ue() != 0 || reader.read_ue() != 0xfffffffe || reader.read_se() != -0x7fffffff ||
+	    reader.overrun() || reader.position() != stream.bits) {
+		throw logic_error("bit reader read the wrong Exp-Golomb codes");
+	}
+
+	// Compile time widths and skipping
+	bit_reader fixed(stream.bytes.data(), stream.bytes.size());
+	if (fixed.read<1>() != values[0]) {
+		throw logic_error("bit reader read the wrong fixed width value");
+	}
+	fixed.skip(stream.bits - 1 - 3 * 8);
+	fixed.align();
+	if (!fixed.byte_aligned() || fixed.remaining() != 3 * 8 ||
+	    fixed.read<24>() != (static_cast<uint64_t>(stream.bytes[stream.bytes.size() - 3]) << 16 |
+				 static_cast<uint64_t>(stream.bytes[stream.bytes.size() - 2]) << 8 |
+				 stream.bytes.back())) {
+		throw logic_error("bit reader skipped to the wrong position");
+	}
+
+	// Reading past the end yields zeros
+	if (fixed.overrun() || fixed.read<8>() != 0 || !fixed.overrun() || fixed.remaining() != 0) {
+		throw logic_error("bit reader didn't overrun the stream");
+	}
+	unsigned char const zero_bytes[3] = {};
+	bit_reader zeros(zero_bytes, sizeof(zero_bytes));
+	if (zeros.read_ue() != 0 || !zeros.overrun()) {
+		throw logic_error("bit reader read an Exp-Golomb code past the stream");
+	}
+
+	// Protocols are read at byte aligned and unaligned positions
+	mixed_proto::traits::array_type packed;
+	mixed_proto::pack(packed.data(), 5, 0xa, 0x0102, 0x3, 0x1e, 0x0a0b0c0d, 0x0c0d0e, 0x0102030405060708ull, 0xbeef);
+	for (size_t shift : {0, 3, 8}) {
+		bit_stream proto_stream;
+		proto_stream.append(0x5, shift);
+		for (unsigned char byte : packed) {
+			proto_stream.append(byte, 8);
+		}
+		proto_stream.append_ue(7);
+		bit_reader proto_reader(proto_stream.bytes.data(), proto_stream.bytes.size());
+		proto_reader.skip(shift);
+		if (proto_reader.read_protocol<mixed_proto>() != mixed_proto::unpack(packed.data()) ||
+		    proto_reader.read_ue() != 7) {
+			throw logic_error("bit reader read the wrong protocol values");
+		}
+	}
+}
+
+// Checks that written bit streams match streams built bit by bit
+void test_bit_writer()
+{
+	bit_stream expected;
+	vector<unsigned char> written(1024, 0xaa);
+	bit_writer writer(written.data(), written.size());
+
+	mixed_proto::traits::array_type packed;
+	mixed_proto::pack(packed.data(), 5, 0xa, 0x0102, 0x3, 0x1e, 0x0a0b0c0d, 0x0c0d0e, 0x0102030405060708ull, 0xbeef);
+	ts_header_proto::traits::array_type ts;
+	ts_header_proto::pack(ts.data(), 0x47, true, false, true, 0x1abc);
+
+	for (size_t n = 1; n <= 64; ++n) {
+		const uint64_t value = 0x9e3779b97f4a7c15ull * n;
+		writer.write(value, n);
+		expected.append(value, n);
+		writer.write_ue(static_cast<uint32_t>(n * n * 1000));
+		expected.append_ue(static_cast<uint32_t>(n * n * 1000));
+		writer.write_se(n % 2 ? -static_cast<int32_t>(n) : static_cast<int32_t>(n * 3));
+		expected.append_se(n % 2 ? -static_cast<int32_t>(n) : static_cast<int32_t>(n * 3));
+		if (n % 16 == 0) {
+			writer.write_protocol<mixed_proto>(mixed_proto::unpack(packed.data()));
+			for (unsigned char byte : packed) {
+				expected.append(byte, 8);
+			}
+			writer.write_protocol<ts_header_proto>(0x47, true, false, true, 0x1abc);
+			for (unsigned char byte : ts) {
+				expected.append(byte, 8);
+			}
+		}
+	}
+	writer.write<3>(0xff);
+	expected.append(0x7, 3);
+	writer.write_ue(0xfffffffe);
+	expected.append_ue(0xfffffffe);
+	writer.write_se(-0x7fffffff);
+	expected.append_se(-0x7fffffff);
+	writer.write_flag(true);
+	expected.append(1, 1);
+	writer.align();
+	while (expected.bits % 8 != 0) {
+		expected.append(0, 1);
+	}
+
+	if (writer.position() != expected.bits || writer.flush() != expected.bytes.size() || writer.overrun() ||
+	    !equal(expected.bytes.begin(), expected.bytes.end(), written.begin()) ||
+	    written[expected.bytes.size()] != 0xaa) {
+		throw logic_error("bit writer wrote the wrong bits");
+	}
+
+	// Writing continues after a flush
+	writer.write<4>(0x5);
+	writer.flush();
+	writer.write<12>(0xabc);
+	if (writer.flush() != expected.bytes.size() + 2 ||
+	    written[expected.bytes.size()] != 0x5a || written[expected.bytes.size() + 1] != 0xbc) {
+		throw logic_error("bit writer didn't continue after a flush");
+	}
+
+	// Bits past the end of the stream aren't written
+	unsigned char small[5] = {0, 0, 0, 0, 0xaa};
+	bit_writer overrun(small, 4);
+	overrun.write<32>(0x01020304);
+	overrun.write<32>(0x05060708);
+	if (!overrun.overrun() || overrun.flush() != 4 || small[3] != 0x04 || small[4] != 0xaa) {
+		throw logic_error("bit writer wrote past the stream");
+	}
+
+	// Signed codes of the extremes are read back, INT32_MIN's code
+	// number is 2^32
+	const int32_t extremes[] = {numeric_limits<int32_t>::min(), numeric_limits<int32_t>::max(), -1, 0,
+				    numeric_limits<int32_t>::min() + 1};
+	unsigned char coded[64] = {};
+	bit_writer se_writer(coded, sizeof(coded));
+	for (const int32_t value : extremes) {
+		se_writer.write_se(value);
+	}
+	se_writer.write_ue(numeric_limits<uint32_t>::max() - 1);
+	se_writer.flush();
+	bit_reader se_reader(coded, sizeof(coded));
+	for (const int32_t value : extremes) {
+		if (se_reader.read_se() != value) {
+			throw logic_error("signed Exp-Golomb extreme didn't round trip");
+		}
+	}
+	if (se_reader.read_ue() != numeric_limits<uint32_t>::max() - 1 || se_writer.overrun() || se_reader.overrun()) {
+		throw logic_error("Exp-Golomb codes after the extremes are incorrect");
+	}
+}
+
+// Checks that packets are queued for their PID's consumer in order
+void test_ts_demux()
+{
+	static constexpr size_t count = 4096;
+	const vector<unsigned char> packets = ts_stream(0, count, 188, 0, 0);
+
+	// ts_stream's PIDs count up from 0, every PID but 0x1fff is routed
+	ts_demux<ts_header_proto, 4> demux(3, 2048);
+	for (uint16_t pid = 0; pid < 0x1fff; ++pid) {
+		demux.route(pid, pid % 3);
+	}
+	if (demux.demux(packets.data(), 188, count) != count) {
+		throw logic_error("demultiplexer dropped packets");
+	}
+	for (size_t c = 0; c < 3; ++c) {
+		unsigned char const * packet;
+		uint16_t pid = static_cast<uint16_t>(c);
+		while (demux.queue(c).try_pop(packet)) {
+			if (ts_header_proto::field_value<4>(packet) != pid || packet != packets.data() + pid * 188) {
+				throw logic_error("demultiplexer queued the wrong packet");
+			}
+			pid = static_cast<uint16_t>(pid + 3);
+		}
+		if (demux.delivered(c) != (count + 2 - c) / 3 || pid / 3 != demux.delivered(c) ||
+		    demux.high_water(c) != demux.delivered(c) || demux.dropped(c) != 0) {
+			throw logic_error("demultiplexer counters are incorrect");
+		}
+	}
+
+	// Full queues and unrouted PIDs drop packets
+	demux.unroute(1);
+	demux.demux(packets.data(), 188, count);
+	demux.demux(packets.data(), 188, count);
+	if (demux.dropped(0) != (count + 2) / 3 * 2 - 2048 ||
+	    demux.high_water(0) != 2048 || demux.unrouted_packets() != 2) {
+		throw logic_error("demultiplexer drop counters are incorrect");
+	}
+
+	bool thrown = false;
+	try {
+		demux.route(0x2000, 0);
+	} catch (out_of_range const &) {
+		thrown = true;
+	}
+	if (!thrown) {
+		throw logic_error("demultiplexer routed an out of range PID");
+	}
+
+	// Consumer threads see every packet the producer queued, in order
+	ts_demux<ts_header_proto, 4> threaded(2, 64);
+	for (uint16_t pid = 0; pid < 0x2000; ++pid) {
+		threaded.route(pid, pid % 2);
+	}
+	vector<vector<uint16_t>> consumed(2);
+	vector<thread> consumers;
+	for (size_t c = 0; c < 2; ++c) {
+		consumers.emplace_back([&threaded, &consumed, c]() {
+				auto visit = [&consumed, c](unsigned char const * const packet) {
+					consumed[c].push_back(ts_header_proto::field_value<4>(packet));
+				};
+				while (consumed[c].size() < count / 2) {
+					if (threaded.queue(c).consume(visit) == 0) {
+						this_thread::yield();
+					}
+				}
+			});
+	}
+	ts_framer<ts_header_proto> framer(ts_packet_size::ts);
+	framer.frame(packets.data(), packets.size(), [&threaded](ts_packet<ts_header_proto> const & packet) {
+			// Waits for room rather than dropping
+			while (!threaded(packet)) {
+				this_thread::yield();
+			}
+		});
+	for (auto & consumer : consumers) {
+		consumer.join();
+	}
+	for (size_t c = 0; c < 2; ++c) {
+		for (size_t i = 0; i < consumed[c].size(); ++i) {
+			if (consumed[c][i] != i * 2 + c) {
+				throw logic_error("consumer thread saw the wrong packet");
+			}
+		}
+	}
+
+	// 0xffff marks an unrouted PID, so it can't be a consumer
+	bool rejected = false;
+	try {
+		ts_demux<ts_header_proto, 4> too_many(65535, 2);
+	} catch (invalid_argument const &) {
+		rejected = true;
+	}
+	if (!rejected) {
+		throw logic_error("demultiplexer accepted 65535 consumers");
+	}
+}
+
+using continuity_header = tuple<field<8, uint8_t>,
+				field<1, bool>,
+				field<1, bool>,
+				field<1, bool>,
+				field<13, uint16_t>,
+				field<2, uint8_t>,
+				field<2, uint8_t>,
+				field<4, uint8_t>
+				>;
+
+using continuity_header_proto = protocol<continuity_header>;
+
+// Checks loss, duplicate, reorder and wraparound tracking of RTP and TS streams
+void test_sequence_tracker()
+{
+	using rtp_tracker = sequence_tracker<rtp_header_proto, 8, 6>;
+	rtp_tracker rtp(2, 100);
+
+	// Wraps around, loses 2, duplicates 1 and reorders 2 by up to 5
+	const uint16_t sequences[] = {65530, 65531, 65533, 65534, 65535, 0, 1, 65532, 1, 5, 6, 3, 7};
+	for (uint16_t sequence : sequences) {
+		rtp.update(0, 0x1234, sequence);
+	}
+	sequence_stats stats = rtp.stats(0x1234);
+	if (stats.received != 13 || stats.lost != 2 || stats.duplicates != 1 || stats.reordered != 2 ||
+	    stats.max_reorder_depth != 5 || stats.wraps != 1) {
+		throw logic_error("RTP sequence statistics are incorrect");
+	}
+
+	// Packets earlier than the first received count as reordered
+	rtp.update(0, 0x5678, 100);
+	rtp.update(0, 0x5678, 98);
+	rtp.update(0, 0x5678, 99);
+	stats = rtp.stats(0x5678);
+	if (stats.lost != 0 || stats.reordered != 2 || stats.max_reorder_depth != 2 || stats.wraps != 0) {
+		throw logic_error("RTP sequence statistics of an early packet are incorrect");
+	}
+
+	// Packets behind the window are late, whether or not they were
+	// received before, and don't change the loss
+	for (uint16_t sequence = 0; sequence < 100; ++sequence) {
+		if (sequence != 5) {
+			rtp.update(0, 0x4321, sequence);
+		}
+	}
+	rtp.update(0, 0x4321, 10);
+	rtp.update(0, 0x4321, 5);
+	stats = rtp.stats(0x4321);
+	if (stats.received != 101 || stats.late != 2 || stats.lost != 1 || stats.duplicates != 0 ||
+	    stats.reordered != 0 || stats.max_reorder_depth != 0) {
+		throw logic_error("RTP sequence statistics of late packets are incorrect");
+	}
+
+	// A stream is tracked by the first shard that updates it, and
+	// other shards count its packets as untracked
+	rtp.update(1, 0x1234, 10);
+	rtp.update(1, 0x1234, 12);
+	rtp.update(1, 0x2222, 1);
+	stats = rtp.stats(0x1234);
+	if (stats.received != 13 || stats.lost != 2 || rtp.streams(0) != 3 || rtp.streams(1) != 1 ||
+	    rtp.untracked() != 2 || rtp.stats(0x2222).received != 1 || rtp.stats(0x9999).received != 0) {
+		throw logic_error("sharded RTP sequence statistics are incorrect");
+	}
+
+	// Batched updates from packed headers match single updates
+	static constexpr size_t streams = 500;
+	static constexpr size_t packets = 20 * streams;
+	vector<unsigned char> headers(packets * rtp_header_proto::traits::bytes);
+	rtp_tracker single(1, streams);
+	for (size_t i = 0; i < packets; ++i) {
+		const uint32_t ssrc = static_cast<uint32_t>((i * 7) % streams);
+		// Every 13th packet is lost
+		const uint16_t sequence = static_cast<uint16_t>(i / streams * 3 + (i % 13 == 0));
+		rtp_header_proto::pack(headers.data() + i * rtp_header_proto::traits::bytes,
+				       2, false, false, 0, false, 96, sequence, 0, ssrc);
+		single.update(0, headers.data() + i * rtp_header_proto::traits::bytes);
+	}
+	rtp_tracker batched(1, streams);
+	batched.update(0, headers.data(), rtp_header_proto::traits::bytes, packets);
+	size_t visited = 0;
+	batched.for_each(0, [&](const uint32_t ssrc, sequence_stats const & batch_stats) {
+			const sequence_stats single_stats = single.stats(ssrc);
+			if (batch_stats.received != 20 || batch_stats.received != single_stats.received ||
+			    batch_stats.lost != single_stats.lost || batch_stats.reordered != single_stats.reordered) {
+				throw logic_error("batched sequence statistics are incorrect");
+			}
+			++visited;
+		});
+	if (visited != streams || batched.untracked() != 0) {
+		throw logic_error("batched sequence tracker visited the wrong streams");
+	}
+
+	// Streams beyond the capacity aren't tracked
+	rtp_tracker small(1, 3);
+	for (uint32_t ssrc = 0; ssrc < small.capacity() + 2; ++ssrc) {
+		small.update(0, ssrc, 1);
+	}
+	if (small.streams(0) != small.capacity() || small.untracked() != 2) {
+		throw logic_error("full sequence tracker tracked too many streams");
+	}
+
+	// The 4 bit continuity counter wraps every 16 packets
+	sequence_tracker<continuity_header_proto, 4, 7> ts(1, 8192);
+	continuity_header_proto::traits::array_type ts_buf;
+	for (uint32_t i = 0; i < 100; ++i) {
+		if (i == 50) {
+			continue;
+		}
+		continuity_header_proto::pack(ts_buf.data(), 0x47, false, false, false, 0x100, 0, 1, static_cast<uint8_t>(i));
+		ts.update(0, continuity_header_proto::unpack(ts_buf.data()));
+	}
+	stats = ts.stats(0x100);
+	if (stats.received != 99 || stats.lost != 1 || stats.wraps != 6 || stats.duplicates != 0) {
+		throw logic_error("continuity counter statistics are incorrect");
+	}
+
+	// Statistics can be read while a shard is updated
+	rtp_tracker concurrent(1, 16);
+	thread reader([&concurrent]() {
+			uint64_t received = 0;
+			while (received < 100000) {
+				const uint64_t now = concurrent.stats(7).received;
+				if (now < received) {
+					throw logic_error("concurrently read statistics went backwards");
+				}
+				received = now;
+				this_thread::yield();
+			}
+		});
+	for (uint32_t i = 0; i < 100000; ++i) {
+		concurrent.update(0, 7, static_cast<uint16_t>(i));
+	}
+	reader.join();
+	if (concurrent.stats(7).lost != 0 || concurrent.stats(7).wraps != 1) {
+		throw logic_error("concurrently updated statistics are incorrect");
+	}
+}
+
+using ethernet_header = tuple<field<48, uint64_t>,
+			      field<48, uint64_t>,
+			      field<16, uint16_t>
+			      >;
+
+using udp_header = tuple<field<16, uint16_t>,
+			 field<16, uint16_t>,
+			 field<16, uint16_t>,
+			 field<16, uint16_t>
+			 >;
+
+using ethernet_header_proto = protocol<ethernet_header>;
+using udp_header_proto = protocol<udp_header>;
+
+// Extra bytes of an IPv4 header's options
+struct ipv4_options
+{
+	static size_t extra_bytes(unsigned char const * const header) noexcept {
+		return ipv4_header_proto::field_value<1>(header) * 4 - ipv4_header_proto::traits::bytes;
+	}
+};
+
+using rtp_stack = ptl::stack<ethernet_header_proto, ipv4_header_proto, udp_header_proto, rtp_header_proto>;
+using rtp_options_stack = ptl::stack<ethernet_header_proto,
+				     variable_layer<ipv4_header_proto, ipv4_options>,
+				     udp_header_proto,
+				     rtp_header_proto>;
+
+static_assert(rtp_stack::layers == 4 && rtp_stack::traits::fields == 29 && rtp_stack::traits::bytes == 54 &&
+	      !rtp_stack::variable && rtp_options_stack::variable,
+	      "stack traits are incorrect");
+
+static_assert(rtp_stack::layer<1>::byte_offset == 14 && rtp_stack::layer<2>::byte_offset == 34 &&
+	      rtp_stack::layer<3>::bit_offset == 336 && rtp_stack::layer<3>::field<8> == 28 &&
+	      field_bit_offset<rtp_stack::layer<3>::field<6>, rtp_stack::tuple_type>::value == 336 + 16,
+	      "stack layer offsets are incorrect");
+
+static_assert(is_same<rtp_stack::layer<2>::protocol_type, udp_header_proto>::value &&
+	      is_same<rtp_options_stack::layer<1>::protocol_type, ipv4_header_proto>::value,
+	      "stack layer protocols are incorrect");
+
+// Packs a stack's layers at offsets, after ipv4_options bytes of IPv4 options
+void pack_rtp_layers(unsigned char * const buf, const size_t ipv4_options)
+{
+	const size_t udp = 34 + ipv4_options;
+	ethernet_header_proto::pack(buf, 0x0a0b0c0d0e0full, 0x010203040506ull, 0x0800);
+	ipv4_header_proto::pack(buf + 14, 4, static_cast<uint8_t>(5 + ipv4_options / 4), 0, 0,
+				static_cast<uint16_t>(48 + ipv4_options), 0x1c46, 2, 0, 64, 17, 0, 0xc0a80001, 0xc0a800c7);
+	fill(buf + 34, buf + udp, 0x01);
+	udp_header_proto::pack(buf + udp, 5004, 5006, 28, 0);
+	rtp_header_proto::pack(buf + udp + 8, 2, false, false, 0, true, 96, 0x1234, 0x89abcdef, 0x12345678);
+}
+
+// Checks stacked field access against each layer's protocol
+void test_stack()
+{
+	array<unsigned char, 80> buf{};
+	pack_rtp_layers(buf.data(), 0);
+
+	if (rtp_stack::field_value<rtp_stack::layer<0>::field<0>>(buf.data()) != 0x0a0b0c0d0e0full ||
+	    rtp_stack::layer<1>::field_value<9>(buf.data()) != 17 ||
+	    rtp_stack::field_value<rtp_stack::layer<2>::field<1>>(buf.data()) != 5006 ||
+	    rtp_stack::field_value<rtp_stack::layer<3>::field<8>>(buf.data()) != 0x12345678) {
+		throw logic_error("stacked field values are incorrect");
+	}
+
+	const auto layered = tuple_cat(ethernet_header_proto::unpack(buf.data()),
+				       ipv4_header_proto::unpack(buf.data() + 14),
+				       udp_header_proto::unpack(buf.data() + 34),
+				       rtp_header_proto::unpack(buf.data() + 42));
+	if (rtp_stack::unpack(buf.data()) != layered ||
+	    rtp_options_stack::unpack(buf.data(), rtp_options_stack::shifts(buf.data())) != layered) {
+		throw logic_error("stack unpack is incorrect");
+	}
+
+	// A stack packs the same bytes as its layers
+	array<unsigned char, 80> packed{};
+	rtp_stack::pack(packed.data(), layered);
+	if (!equal(packed.begin(), packed.begin() + rtp_stack::traits::bytes, buf.begin())) {
+		throw logic_error("stack pack is incorrect");
+	}
+
+	// 8 bytes of IPv4 options shift the UDP and RTP layers
+	pack_rtp_layers(buf.data(), 8);
+	const rtp_options_stack::shift_type shifts = rtp_options_stack::shifts(buf.data());
+	if (shifts[0] != 0 || shifts[1] != 0 || shifts[2] != 8 || shifts[3] != 8 ||
+	    rtp_options_stack::bytes(shifts) != 62) {
+		throw logic_error("stack shifts are incorrect");
+	}
+	if (rtp_options_stack::field_value<rtp_options_stack::layer<1>::field<1>>(buf.data(), shifts) != 7 ||
+	    rtp_options_stack::field_value<rtp_options_stack::layer<2>::field<0>>(buf.data(), shifts) != 5004 ||
+	    rtp_options_stack::layer<3>::field_value<8>(buf.data(), shifts) != 0x12345678 ||
+	    rtp_options_stack::layer<3>::data(buf.data(), shifts) != buf.data() + 50) {
+		throw logic_error("shifted stack field values are incorrect");
+	}
+	const auto shifted = tuple_cat(ethernet_header_proto::unpack(buf.data()),
+				       ipv4_header_proto::unpack(buf.data() + 14),
+				       udp_header_proto::unpack(buf.data() + 42),
+				       rtp_header_proto::unpack(buf.data() + 50));
+	if (rtp_options_stack::unpack(buf.data(), shifts) != shifted) {
+		throw logic_error("shifted stack unpack is incorrect");
+	}
+}
+
+// Protocol, source and destination addresses and ports
+using five_tuple = flow_key<rtp_stack, 12, 14, 15, 16, 17>;
+using ssrc_key = flow_key<rtp_stack, rtp_stack::layer<3>::field<8>>;
+
+static_assert(five_tuple::words == 3 && five_tuple::offset(0) == 16 && five_tuple::offset(2) == 32 &&
+	      five_tuple::mask(0) == 0xff && five_tuple::mask(1) == 0x0000ffffffffffffull && five_tuple::mask(2) == 0xffffffffffff0000ull &&
+	      ssrc_key::words == 1 && ssrc_key::offset(0) == 48 && ssrc_key::mask(0) == 0x0000ffffffff0000ull,
+	      "flow key masks are incorrect");
+
+// Computes the CRC32C of words' little endian bytes one bit at a time
+uint32_t naive_crc32c(vector<uint64_t> const & words)
+{
+	uint32_t crc = 0xffffffff;
+	for (uint64_t word : words) {
+		for (size_t byte = 0; byte < 8; ++byte) {
+			crc ^= static_cast<uint8_t>(word >> (byte * 8));
+			for (int bit = 0; bit < 8; ++bit) {
+				crc = (crc & 1) ? (crc >> 1) ^ 0x82f63b78u : crc >> 1;
+			}
+		}
+	}
+	return ~crc;
+}
+
+// Checks flow keys' extraction, hashing and comparison
+void test_flow_key()
+{
+	// The CRC32C check value
+	const unsigned char check[] = {'1', '2', '3', '4', '5', '6', '7', '8'};
+	uint64_t check_word;
+	memcpy(&check_word, check, sizeof(check_word));
+	if (~crc32c_word(0xffffffff, check_word) != naive_crc32c({check_word})) {
+		throw logic_error("CRC32C of a word is incorrect");
+	}
+
+	array<unsigned char, 80> buf{};
+	pack_rtp_layers(buf.data(), 0);
+	const five_tuple::key_type key = five_tuple::key(buf.data());
+	const uint64_t protocol = rtp_stack::field_value<12>(buf.data());
+	const uint64_t source = rtp_stack::field_value<14>(buf.data());
+	const uint64_t destination = rtp_stack::field_value<15>(buf.data());
+	const uint64_t ports = (uint64_t(rtp_stack::field_value<16>(buf.data())) << 16) | rtp_stack::field_value<17>(buf.data());
+	if (key[0] != protocol || key[1] != ((source << 16) | (destination >> 16)) ||
+	    key[2] != ((destination << 48) | (ports << 16))) {
+		throw logic_error("flow key is incorrect");
+	}
+	if (five_tuple::hash(buf.data()) != naive_crc32c({key[0], key[1], key[2]}) ||
+	    five_tuple::hash(key, 1) == five_tuple::hash(key) ||
+	    ssrc_key::hash(buf.data()) != naive_crc32c({uint64_t(0x12345678) << 16})) {
+		throw logic_error("flow key hash is incorrect");
+	}
+
+	// Only the key's fields are compared
+	array<unsigned char, 80> other = buf;
+	rtp_stack::field_value<11>(other.data(), 1);
+	rtp_stack::field_value<rtp_stack::layer<3>::field<6>>(other.data(), 1);
+	if (!five_tuple::equal(other.data(), key) || five_tuple::hash(other.data()) != five_tuple::hash(key)) {
+		throw logic_error("flow key compared fields outside the key");
+	}
+	rtp_stack::field_value<16>(other.data(), 1);
+	if (five_tuple::equal(other.data(), buf.data()) || ssrc_key::equal(buf.data(), other.data()) == false) {
+		throw logic_error("flow key comparison is incorrect");
+	}
+
+	// Batched hashes match single hashes
+	static constexpr size_t count = 7;
+	vector<unsigned char> headers(count * rtp_stack::traits::bytes);
+	for (size_t i = 0; i < count; ++i) {
+		copy(buf.begin(), buf.begin() + rtp_stack::traits::bytes, headers.begin() + i * rtp_stack::traits::bytes);
+		rtp_stack::field_value<16>(headers.data() + i * rtp_stack::traits::bytes, static_cast<uint16_t>(i));
+	}
+	uint32_t hashes[count];
+	five_tuple::hash(headers.data(), rtp_stack::traits::bytes, count, hashes, 5);
+	for (size_t i = 0; i < count; ++i) {
+		const uint32_t hash = five_tuple::hash(headers.data() + i * rtp_stack::traits::bytes, 5);
+		if (hashes[i] != hash || five_tuple::steer(hash, 3) >= 3) {
+			throw logic_error("batched flow key hashes are incorrect");
+		}
+	}
+	if (five_tuple::steer(0xffffffff, 4) != 3 || five_tuple::steer(0, 4) != 0) {
+		throw logic_error("flow key steering is incorrect");
+	}
+}
+
+// Checks a packed vector of Bits bit elements against a vector of values
+template <size_t Bits, class T>
+void test_packed_vector()
+{
+	using vector_type = packed_vector<field<Bits, T>>;
+	const uint64_t mask = Bits == 64 ? ~0ull : (1ull << Bits) - 1;
+
+	vector<T> values(1000);
+	vector_type packed;
+	for (size_t i = 0; i < values.size(); ++i) {
+		values[i] = static_cast<T>((i * 0x9e3779b97f4a7c15ull >> 7) & mask);
+		packed.push_back(values[i]);
+	}
+	if (packed.size() != values.size() || !equal(packed.begin(), packed.end(), values.begin()) ||
+	    packed.bytes() != ((values.size() * Bits + 63) / 64 + 1) * 8) {
+		throw logic_error("packed vector elements are incorrect");
+	}
+
+	// Setting an element doesn't change its neighbours
+	packed.set(501, static_cast<T>(mask));
+	packed.set(502, 0);
+	values[501] = static_cast<T>(mask);
+	values[502] = 0;
+	if (packed[500] != values[500] || packed[501] != values[501] || packed[502] != values[502] ||
+	    packed[503] != values[503]) {
+		throw logic_error("packed vector set is incorrect");
+	}
+
+	// Unaligned bulk unpacks have a head, whole blocks and a tail
+	unique_ptr<T[]> unpacked(new T[values.size()]);
+	for (size_t first : {0, 5, 64, 100}) {
+		const size_t count = values.size() - first - 3;
+		packed.unpack(first, count, unpacked.get());
+		if (!equal(unpacked.get(), unpacked.get() + count, values.begin() + first)) {
+			throw logic_error("packed vector unpack is incorrect");
+		}
+	}
+
+	// Bulk packs only change the packed elements
+	static constexpr size_t replaced = 700;
+	unique_ptr<T[]> replacement(new T[replaced]);
+	for (size_t i = 0; i < replaced; ++i) {
+		replacement[i] = static_cast<T>((i * 2654435761u + 11) & mask);
+	}
+	packed.pack(37, replaced, replacement.get());
+	copy(replacement.get(), replacement.get() + replaced, values.begin() + 37);
+	if (!equal(packed.begin(), packed.end(), values.begin())) {
+		throw logic_error("packed vector pack is incorrect");
+	}
+
+	// Iterators are random access
+	auto it = packed.begin() + 10;
+	if (it[5] != values[15] || *(it - 3) != values[7] || packed.end() - it != 990 ||
+	    !(it < packed.end()) || *--it != values[9]) {
+		throw logic_error("packed vector iterators are incorrect");
+	}
+
+	// Shrinking clears the removed elements
+	packed.resize(3);
+	packed.resize(6, static_cast<T>(1));
+	if (packed.size() != 6 || packed[2] != values[2] || packed[3] != 1 || packed[5] != 1 ||
+	    vector_type(4, static_cast<T>(1))[3] != 1) {
+		throw logic_error("packed vector resize is incorrect");
+	}
+}
+
+void test_packed_vectors()
+{
+	test_packed_vector<1, bool>();
+	test_packed_vector<4, uint8_t>();
+	test_packed_vector<7, uint8_t>();
+	test_packed_vector<13, uint16_t>();
+	test_packed_vector<33, uint64_t>();
+	test_packed_vector<64, uint64_t>();
+}
+
+// Checks buffer allocation, alignment and release across threads
+void test_buffer_pool()
+{
+	using pool_type = buffer_pool<rtp_header_proto, 1388>;
+	static_assert(pool_type::buffer_bytes == 1400 && pool_type::slot_bytes == 1408,
+		      "buffer pool slot size is incorrect");
+
+	// Every buffer is allocated once and is cache line aligned
+	static constexpr size_t slots = 200;
+	pool_type pool(slots, true);
+	auto allocate_all = [&pool]() {
+		vector<pool_type::buffer> buffers;
+		for (pool_type::buffer buffer = pool.allocate(); buffer; buffer = pool.allocate()) {
+			if (reinterpret_cast<uintptr_t>(buffer.data()) % cache_line_bytes != 0 ||
+			    buffer.payload() != buffer.header() + rtp_header_proto::traits::bytes) {
+				throw logic_error("buffer is not cache line aligned");
+			}
+			rtp_header_proto::field_value<8>(buffer.header(), buffer.index());
+			buffers.push_back(move(buffer));
+		}
+		for (pool_type::buffer const & buffer : buffers) {
+			if (rtp_header_proto::field_value<8>(buffer.header()) != buffer.index()) {
+				throw logic_error("buffer was allocated twice");
+			}
+		}
+		return buffers.size();
+	};
+	if (allocate_all() != slots || allocate_all() != slots) {
+		throw logic_error("buffer pool allocated the wrong number of buffers");
+	}
+
+	// Buffers released by a consumer thread go back to the free list
+	spsc_ring<uint32_t> queue(64);
+	static constexpr size_t packets = 10000;
+	thread consumer([&queue, &pool]() {
+			size_t released = 0;
+			while (released < packets) {
+				released += queue.consume([&pool](const uint32_t index) {
+						pool_type::buffer buffer = pool.adopt(index);
+						if (rtp_header_proto::field_value<6>(buffer.header()) != 0x1234) {
+							throw logic_error("queued buffer was overwritten");
+						}
+					});
+			}
+		});
+	for (size_t i = 0; i < packets; ++i) {
+		pool_type::buffer buffer;
+		while (!(buffer = pool.allocate())) {
+			this_thread::yield();
+		}
+		rtp_header_proto::pack(buffer.header(), 2, false, false, 0, false, 96, 0x1234, 0, 0);
+		const uint32_t index = buffer.release();
+		while (!queue.try_push(index)) {
+			this_thread::yield();
+		}
+	}
+	consumer.join();
+	if (allocate_all() != slots) {
+		throw logic_error("consumer thread's buffers weren't released");
+	}
+
+	// Threads allocating and releasing at once never share a buffer
+	vector<thread> threads;
+	for (uint32_t id = 1; id <= 3; ++id) {
+		threads.emplace_back([&pool, id]() {
+				vector<pool_type::buffer> held;
+				for (size_t i = 0; i < 20000; ++i) {
+					if (pool_type::buffer buffer = pool.allocate()) {
+						rtp_header_proto::field_value<8>(buffer.header(), id);
+						held.push_back(move(buffer));
+					}
+					if (held.size() > 40 || (i % 7 == 0 && !held.empty())) {
+						if (rtp_header_proto::field_value<8>(held.back().header()) != id) {
+							throw logic_error("buffer was shared between threads");
+						}
+						held.pop_back();
+					}
+				}
+			});
+	}
+	for (thread & t : threads) {
+		t.join();
+	}
+	if (allocate_all() != slots) {
+		throw logic_error("buffers were lost by concurrent threads");
+	}
+
+	// Many threads' caches hold at most a quarter of the buffers
+	pool_type shared_pool(64);
+	atomic<size_t> cached(0);
+	atomic<bool> counted(false);
+	vector<thread> cachers;
+	for (size_t t = 0; t < 12; ++t) {
+		cachers.emplace_back([&shared_pool, &cached, &counted]() {
+				{
+					vector<pool_type::buffer> held;
+					for (size_t i = 0; i < 8; ++i) {
+						held.push_back(shared_pool.allocate());
+					}
+				}
+				++cached;
+				while (!counted.load()) {
+					this_thread::yield();
+				}
+			});
+	}
+	while (cached.load() < cachers.size()) {
+		this_thread::yield();
+	}
+	size_t available = 0;
+	{
+		vector<pool_type::buffer> taken;
+		for (pool_type::buffer buffer = shared_pool.allocate(); buffer; buffer = shared_pool.allocate()) {
+			taken.push_back(move(buffer));
+		}
+		available = taken.size();
+	}
+	counted = true;
+	for (thread & t : cachers) {
+		t.join();
+	}
+	if (available < shared_pool.slots() / 4 * 3) {
+		throw logic_error("idle threads' caches stranded a pool's buffers");
+	}
+
+	// A producer of a pool smaller than a cache isn't starved by a
+	// consumer thread that is still running
+	pool_type small_pool(16);
+	spsc_ring<uint32_t> small_queue(16);
+	atomic<bool> done(false);
+	thread small_consumer([&small_queue, &small_pool, &done]() {
+			while (!done.load()) {
+				small_queue.consume([&small_pool](const uint32_t index) {
+						small_pool.adopt(index);
+					});
+				this_thread::yield();
+			}
+		});
+	bool starved = false;
+	for (size_t i = 0; i < 1000 && !starved; ++i) {
+		pool_type::buffer buffer;
+		for (size_t tries = 0; !(buffer = small_pool.allocate()); ++tries) {
+			if (tries == 1000000) {
+				starved = true;
+				break;
+			}
+			this_thread::yield();
+		}
+		if (buffer) {
+			const uint32_t index = buffer.release();
+			while (!small_queue.try_push(index)) {
+				this_thread::yield();
+			}
+		}
+	}
+	done = true;
+	small_consumer.join();
+	if (starved) {
+		throw logic_error("consumer thread stranded a small pool's buffers");
+	}
+}
+
+// Checks field access to headers split across segments at every byte
+void test_segmented_header()
+{
+	array<unsigned char, 80> buf{};
+	pack_rtp_layers(buf.data(), 0);
+	const rtp_stack::value_tuple expected = rtp_stack::unpack(buf.data());
+	static constexpr size_t bytes = rtp_stack::traits::bytes;
+
+	// The header starts 3 bytes into the first segment, and the second
+	// split leaves a one byte segment between the others
+	for (size_t split = 0; split <= bytes; ++split) {
+		for (size_t middle = 0; middle <= 1; ++middle) {
+			vector<unsigned char> first(3 + split), second(middle), third(bytes - min(bytes, split + middle) + 5);
+			copy(buf.begin(), buf.begin() + split, first.begin() + 3);
+			copy(buf.begin() + split, buf.begin() + min(bytes, split + middle), second.begin());
+			copy(buf.begin() + min(bytes, split + middle), buf.begin() + bytes, third.begin());
+			struct iovec segments[] = {{first.data(), first.size()},
+						   {second.data(), second.size()},
+						   {third.data(), third.size()}};
+
+			segmented_header<rtp_stack> header(segments, 3, 3);
+			if (!header.complete() || header.contiguous() != (split == bytes || (split == 0 && middle == 0)) ||
+			    header.unpack() != expected ||
+			    header.field_value<rtp_stack::layer<3>::field<8>>() != 0x12345678 ||
+			    header.field_value<rtp_stack::layer<1>::field<1>>() != 5) {
+				throw logic_error("segmented header fields are incorrect");
+			}
+
+			array<unsigned char, bytes> gathered;
+			header.gather(gathered.data());
+			if (!equal(gathered.begin(), gathered.end(), buf.begin())) {
+				throw logic_error("gathered segmented header is incorrect");
+			}
+
+			// Setting a field keeps its neighbours' bits in shared bytes
+			header.field_value<rtp_stack::layer<1>::field<7>>(0x1abc);
+			header.field_value<rtp_stack::layer<3>::field<7>>(0x01020304);
+			rtp_stack::value_tuple set = expected;
+			get<rtp_stack::layer<1>::field<7>>(set) = 0x1abc;
+			get<rtp_stack::layer<3>::field<7>>(set) = 0x01020304;
+			if (segmented_header<rtp_stack>(segments, 3, 3).unpack() != set) {
+				throw logic_error("segmented header set is incorrect");
+			}
+		}
+	}
+
+	// Bytes past the segments read as zero
+	struct iovec truncated = {buf.data(), 40};
+	segmented_header<rtp_stack> header(&truncated, 1);
+	if (header.complete() || header.field_value<rtp_stack::layer<2>::field<0>>() != 5004 ||
+	    header.field_value<rtp_stack::layer<3>::field<8>>() != 0) {
+		throw logic_error("truncated segmented header is incorrect");
+	}
+}
+
+// Returns a non blocking UDP socket bound to a loopback port
+int loopback_socket(struct sockaddr_in & address)
+{
+	const int fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+	address = {};
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	socklen_t length = sizeof(address);
+	if (fd < 0 || bind(fd, reinterpret_cast<struct sockaddr *>(&address), sizeof(address)) != 0 ||
+	    getsockname(fd, reinterpret_cast<struct sockaddr *>(&address), &length) != 0) {
+		throw runtime_error("unable to create a loopback socket");
+	}
+	return fd;
+}
+
+void test_udp_batch_io()
+{
+	using io_type = udp_batch_io<rtp_header_proto, 1388>;
+	io_type::pool_type pool(256);
+	struct sockaddr_in receiver_address, sender_address;
+	const int receiver = loopback_socket(receiver_address);
+	const int sender = loopback_socket(sender_address);
+	if (connect(sender, reinterpret_cast<struct sockaddr *>(&receiver_address), sizeof(receiver_address)) != 0) {
+		throw runtime_error("unable to connect a loopback socket");
+	}
+	io_type in(receiver, pool), out(sender, pool);
+
+	// Nothing is received from an empty socket
+	if (in.receive([](io_type::batch &) { throw logic_error("empty socket was visited"); }) != 0) {
+		throw logic_error("empty socket received datagrams");
+	}
+
+	// 40 datagrams arrive in a full burst and a partial one, the
+	// last is shorter than a header and one is truncated
+	static constexpr size_t count = 40;
+	vector<vector<unsigned char>> datagrams(count);
+	vector<unsigned char const *> data(count);
+	vector<size_t> bytes(count);
+	for (size_t i = 0; i < count; ++i) {
+		datagrams[i].resize(i == count - 1 ? 4 : i == 5 ? 1500 : rtp_header_proto::traits::bytes + i);
+		if (i != count - 1) {
+			rtp_header_proto::pack(datagrams[i].data(), 2, false, false, 0, false, 96,
+					       static_cast<uint16_t>(i), 0, 0x12345678);
+		}
+		data[i] = datagrams[i].data();
+		bytes[i] = datagrams[i].size();
+	}
+	if (out.send(data.data(), bytes.data(), count) != count) {
+		throw logic_error("udp batch io didn't send every datagram");
+	}
+
+	io_type::buffer taken;
+	size_t received = 0, visited = 0;
+	for (size_t burst = 0; burst < 2; ++burst) {
+		const size_t n = in.receive([&](io_type::batch & batch) {
+				for (size_t i = 0; i < batch.size(); ++i, ++received) {
+					const bool truncated = received == 5;
+					if (batch.truncated(i) != truncated ||
+					    batch.bytes(i) != (truncated ? io_type::buffer_bytes : bytes[received]) ||
+					    batch.complete(i) != (received != count - 1 && !truncated) ||
+					    reinterpret_cast<struct sockaddr_in const &>(batch.source(i)).sin_port !=
+					    sender_address.sin_port) {
+						throw logic_error("udp batch io datagram is incorrect");
+					}
+					if (batch.complete(i) && batch.field_value<6>(i) != received) {
+						throw logic_error("udp batch io datagram fields are incorrect");
+					}
+				}
+				visited += batch.for_each([](unsigned char const * const header, const size_t) {
+						if (rtp_header_proto::field_value<8>(header) != 0x12345678) {
+							throw logic_error("udp batch io visited an incomplete datagram");
+						}
+					});
+				if (!taken) {
+					taken = batch.take(1);
+				}
+			});
+		if (n != (burst == 0 ? io_type::burst : count - io_type::burst)) {
+			throw logic_error("udp batch io burst is the wrong size");
+		}
+	}
+	if (received != count || visited != count - 2) {
+		throw logic_error("udp batch io received the wrong datagrams");
+	}
+	// A taken buffer isn't received into again
+	if (rtp_header_proto::field_value<6>(taken.header()) != 1) {
+		throw logic_error("udp batch io reused a taken buffer");
+	}
+
+	// Equal size datagrams sent from one buffer are received as
+	// separate datagrams, even if they're coalesced
+	using gro_type = udp_batch_io<rtp_header_proto, io_type::gro_bytes>;
+	gro_type::pool_type gro_pool(4);
+	gro_type gro_in(receiver, gro_pool);
+	gro_in.enable_gro();
+	static constexpr size_t segment = 100, segments = 6;
+	vector<unsigned char> segmented(segment * (segments - 1) + 50);
+	for (size_t i = 0; i < segments; ++i) {
+		rtp_header_proto::pack(segmented.data() + i * segment, 2, false, false, 0, false, 96,
+				       static_cast<uint16_t>(i), 0, 0);
+	}
+	if (out.send_segments(segmented.data(), segmented.size(), segment) != segments) {
+		throw logic_error("udp batch io didn't send every segment");
+	}
+	received = 0;
+	for (size_t attempt = 0; attempt < 1000 && received < segments; ++attempt) {
+		gro_in.receive([&](gro_type::batch & batch) {
+				for (size_t i = 0; i < batch.size(); ++i, ++received) {
+					if (batch.field_value<6>(i) != received ||
+					    batch.bytes(i) != (received == segments - 1 ? 50 : segment)) {
+						throw logic_error("udp batch io segment is incorrect");
+					}
+				}
+			});
+	}
+	if (received != segments) {
+		throw logic_error("udp batch io received the wrong segments");
+	}
+
+	// More than a UDP datagram's bytes are sent as several messages
+	static constexpr size_t large_segment = 1400, large_segments = 64;
+	vector<unsigned char> large(large_segment * large_segments);
+	for (size_t i = 0; i < large_segments; ++i) {
+		rtp_header_proto::pack(large.data() + i * large_segment, 2, false, false, 0, false, 96,
+				       static_cast<uint16_t>(i), 0, 0);
+	}
+	if (out.send_segments(large.data(), large.size(), large_segment) != large_segments) {
+		throw logic_error("udp batch io didn't send every large segment");
+	}
+	received = 0;
+	for (size_t attempt = 0; attempt < 1000 && received < large_segments; ++attempt) {
+		gro_in.receive([&](gro_type::batch & batch) {
+				for (size_t i = 0; i < batch.size(); ++i, ++received) {
+					if (batch.field_value<6>(i) != received || batch.bytes(i) != large_segment) {
+						throw logic_error("udp batch io large segment is incorrect");
+					}
+				}
+			});
+	}
+	if (received != large_segments) {
+		throw logic_error("udp batch io received the wrong large segments");
+	}
+
+	close(sender);
+	close(receiver);
+}
+
 int main()
 try {
 	test_proto::traits::array_type proto_buf;
 	proto_buf.fill(0);
 	test_protocol<test_proto>(proto_buf.data());
+	test_backends<test_proto>(proto_buf.data());
+	test_unpacks<test_proto>(proto_buf.data());
+	test_pack<test_proto>(proto_buf.data());
+	test_extracts<test_proto>();
+	test_columnar<test_proto, 3, 21, 100>();
+	test_match<test_proto, 20, 120>();
+	test_byte_order();
+	test_ts_framer();
+	test_capture_reader();
+	test_parallel_decode();
+	test_header_template();
+	test_checksum();
+	test_bit_reader();
+	test_bit_writer();
+	test_ts_demux();
+	test_sequence_tracker();
+	test_stack();
+	test_flow_key();
+	test_packed_vectors();
+	test_buffer_pool();
+	test_segmented_header();
+	test_udp_batch_io();
 	return 0;
 
 } catch(exception& ex) {
@@ -0,0 +1,137 @@
+#ifndef PTL_EXAMPLES_TEST_PROTOCOL_HPP
+#define PTL_EXAMPLES_TEST_PROTOCOL_HPP
+
+#include <cstdint>
+#include <tuple>
+#include "ptl.hpp"
+
+// Fields of every size for each unsigned field type
+using test = std::tuple<ptl::field<1, bool>,
+		   ptl::field<1, std::uint8_t>,
+		   ptl::field<2, std::uint8_t>,
+		   ptl::field<3, std::uint8_t>,
+		   ptl::field<4, std::uint8_t>,
+		   ptl::field<5, std::uint8_t>,
+		   ptl::field<6, std::uint8_t>,
+		   ptl::field<7, std::uint8_t>,
+		   ptl::field<8, std::uint8_t>,
+
+		   ptl::field<1, std::uint16_t>,
+		   ptl::field<2, std::uint16_t>,
+		   ptl::field<3, std::uint16_t>,
+		   ptl::field<4, std::uint16_t>,
+		   ptl::field<5, std::uint16_t>,
+		   ptl::field<6, std::uint16_t>,
+		   ptl::field<7, std::uint16_t>,
+		   ptl::field<8, std::uint16_t>,
+		   ptl::field<9, std::uint16_t>,
+		   ptl::field<10, std::uint16_t>,
+		   ptl::field<11, std::uint16_t>,
+		   ptl::field<12, std::uint16_t>,
+		   ptl::field<13, std::uint16_t>,
+		   ptl::field<14, std::uint16_t>,
+		   ptl::field<15, std::uint16_t>,
+		   ptl::field<16, std::uint16_t>,
+
+		   ptl::field<1, std::uint32_t>,
+		   ptl::field<2, std::uint32_t>,
+		   ptl::field<3, std::uint32_t>,
+		   ptl::field<4, std::uint32_t>,
+		   ptl::field<5, std::uint32_t>,
+		   ptl::field<6, std::uint32_t>,
+		   ptl::field<7, std::uint32_t>,
+		   ptl::field<8, std::uint32_t>,
+		   ptl::field<9, std::uint32_t>,
+		   ptl::field<10, std::uint32_t>,
+		   ptl::field<11, std::uint32_t>,
+		   ptl::field<12, std::uint32_t>,
+		   ptl::field<13, std::uint32_t>,
+		   ptl::field<14, std::uint32_t>,
+		   ptl::field<15, std::uint32_t>,
+		   ptl::field<16, std::uint32_t>,
+		   ptl::field<17, std::uint32_t>,
+		   ptl::field<18, std::uint32_t>,
+		   ptl::field<19, std::uint32_t>,
+		   ptl::field<20, std::uint32_t>,
+		   ptl::field<21, std::uint32_t>,
+		   ptl::field<22, std::uint32_t>,
+		   ptl::field<23, std::uint32_t>,
+		   ptl::field<24, std::uint32_t>,
+		   ptl::field<25, std::uint32_t>,
+		   ptl::field<26, std::uint32_t>,
+		   ptl::field<27, std::uint32_t>,
+		   ptl::field<28, std::uint32_t>,
+		   ptl::field<29, std::uint32_t>,
+		   ptl::field<30, std::uint32_t>,
+		   ptl::field<31, std::uint32_t>,
+		   ptl::field<32, std::uint32_t>,
+
+		   ptl::field<1, std::uint64_t>,
+		   ptl::field<2, std::uint64_t>,
+		   ptl::field<3, std::uint64_t>,
+		   ptl::field<4, std::uint64_t>,
+		   ptl::field<5, std::uint64_t>,
+		   ptl::field<6, std::uint64_t>,
+		   ptl::field<7, std::uint64_t>,
+		   ptl::field<8, std::uint64_t>,
+		   ptl::field<9, std::uint64_t>,
+		   ptl::field<10, std::uint64_t>,
+		   ptl::field<11, std::uint64_t>,
+		   ptl::field<12, std::uint64_t>,
+		   ptl::field<13, std::uint64_t>,
+		   ptl::field<14, std::uint64_t>,
+		   ptl::field<15, std::uint64_t>,
+		   ptl::field<16, std::uint64_t>,
+		   ptl::field<17, std::uint64_t>,
+		   ptl::field<18, std::uint64_t>,
+		   ptl::field<19, std::uint64_t>,
+		   ptl::field<20, std::uint64_t>,
+		   ptl::field<21, std::uint64_t>,
+		   ptl::field<22, std::uint64_t>,
+		   ptl::field<23, std::uint64_t>,
+		   ptl::field<24, std::uint64_t>,
+		   ptl::field<25, std::uint64_t>,
+		   ptl::field<26, std::uint64_t>,
+		   ptl::field<27, std::uint64_t>,
+		   ptl::field<28, std::uint64_t>,
+		   ptl::field<29, std::uint64_t>,
+		   ptl::field<30, std::uint64_t>,
+		   ptl::field<31, std::uint64_t>,
+		   ptl::field<32, std::uint64_t>,
+		   ptl::field<33, std::uint64_t>,
+		   ptl::field<34, std::uint64_t>,
+		   ptl::field<35, std::uint64_t>,
+		   ptl::field<36, std::uint64_t>,
+		   ptl::field<37, std::uint64_t>,
+		   ptl::field<38, std::uint64_t>,
+		   ptl::field<39, std::uint64_t>,
+		   ptl::field<40, std::uint64_t>,
+		   ptl::field<41, std::uint64_t>,
+		   ptl::field<42, std::uint64_t>,
+		   ptl::field<43, std::uint64_t>,
+		   ptl::field<44, std::uint64_t>,
+		   ptl::field<45, std::uint64_t>,
+		   ptl::field<46, std::uint64_t>,
+		   ptl::field<47, std::uint64_t>,
+		   ptl::field<48, std::uint64_t>,
+		   ptl::field<49, std::uint64_t>,
+		   ptl::field<50, std::uint64_t>,
+		   ptl::field<51, std::uint64_t>,
+		   ptl::field<52, std::uint64_t>,
+		   ptl::field<53, std::uint64_t>,
+		   ptl::field<54, std::uint64_t>,
+		   ptl::field<55, std::uint64_t>,
+		   ptl::field<56, std::uint64_t>,
+		   ptl::field<57, std::uint64_t>,
+		   ptl::field<58, std::uint64_t>,
+		   ptl::field<59, std::uint64_t>,
+		   ptl::field<60, std::uint64_t>,
+		   ptl::field<61, std::uint64_t>,
+		   ptl::field<62, std::uint64_t>,
+		   ptl::field<63, std::uint64_t>,
+		   ptl::field<64, std::uint64_t>
+		   >;
+
+using test_proto = ptl::protocol<test>;
+
+#endif
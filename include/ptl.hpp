@@ -1,11 +1,42 @@
+#ifndef PTL_HPP
+#define PTL_HPP
+
 #include <cstring>
+#include <cstdint>
 #include <tuple>
 #include <limits>
 #include <array>
 #include <type_traits>
+#include <utility>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define PTL_X86_DISPATCH 1
+#include <immintrin.h>
+#endif
+
+#if defined(__has_builtin)
+#if __has_builtin(__builtin_is_constant_evaluated)
+#define PTL_HAS_CONSTANT_EVALUATED 1
+#endif
+#endif
 
 namespace ptl
 {
+    /** Returns true when called during constant evaluation
+     *
+     *  Lets the accessors use memcpy loads and stores at run time and
+     *  byte loops in constant expressions.  Compilers without
+     *  __builtin_is_constant_evaluated always use the memcpy loads
+     *  and stores, so their accessors can't be constant evaluated.
+     */
+    constexpr bool constant_evaluated() noexcept {
+#if defined(PTL_HAS_CONSTANT_EVALUATED)
+        return __builtin_is_constant_evaluated();
+#else
+        return false;
+#endif
+    }
+
     static constexpr std::size_t bits_per_byte = static_cast<std::size_t>(std::numeric_limits<unsigned char>::digits);
 
     // Returns the number of bytes required to store the provided bits
@@ -63,11 +94,19 @@ namespace ptl
     }
 
 
+    /// Byte order of a field's bytes in a protocol buffer
+    enum class byte_order
+    {
+        big,
+        little
+    };
+
     /** Represents a field in a binary protocol
 	 *  @tparam Bits Number of bits that make up the field
 	 *  @tparam T Type used to represent the field
+	 *  @tparam Order Byte order of the field's bytes
 	 */
-    template<int Bits, typename T>
+    template<int Bits, typename T, ptl::byte_order Order = ptl::byte_order::big>
     struct field
     {
             static_assert(Bits > 0,
@@ -79,11 +118,57 @@ namespace ptl
 
             using value_type = T;
             static constexpr std::size_t bits = Bits;
+            static constexpr ptl::byte_order order = Order;
 
             /// Number of bytes required to store the field's value
             static constexpr std::size_t bytes = ptl::required_bytes(bits);
     };
 
+    namespace detail
+    {
+        /// Associates a field with its index in a tuple
+        template <std::size_t I, class Field>
+        struct indexed_field
+        {
+                using type = Field;
+        };
+
+        /// Derives from an indexed_field for each of a tuple's fields
+        template <class Sequence, class... Fields>
+        struct indexed_fields;
+
+        template <std::size_t... I, class... Fields>
+        struct indexed_fields<std::index_sequence<I...>, Fields...> : ptl::detail::indexed_field<I, Fields>...
+        {
+        };
+
+        /// Selects field I's base of an indexed_fields by overload resolution
+        template <std::size_t I, class Field>
+        ptl::detail::indexed_field<I, Field> select_field(ptl::detail::indexed_field<I, Field> const &) noexcept;
+    }
+
+    /** Provides a type alias for a tuple's field
+	 *
+	 *  Unlike std::tuple_element, the field is found without
+	 *  instantiating a template per preceding field, which keeps
+	 *  accessing every field of a protocol linear in the number of
+	 *  fields.
+	 *
+	 *  @tparam I Order number of the element within the tuple
+	 *  @tparam Tuple Tuple that contains the field
+	 */
+    template <std::size_t I, class Tuple>
+    struct field_element;
+
+    template <std::size_t I, class... Fields>
+    struct field_element<I, std::tuple<Fields...>>
+    {
+            static_assert(I < sizeof...(Fields),
+                          "Protocol tuple index is greater than tuple size");
+            using type = typename decltype(ptl::detail::select_field<I>(
+                std::declval<ptl::detail::indexed_fields<std::index_sequence_for<Fields...>, Fields...>>()))::type;
+    };
+
     /** Returns the number of bits in a field
 	 *  @tparam I Order number of the element within the tuple
 	 *  @tparam Tuple Tuple that contains the field
@@ -91,39 +176,88 @@ namespace ptl
     template<std::size_t I, class Tuple>
     struct field_bits
     {
-            static constexpr auto value = std::tuple_element<I, Tuple>::type::bits;
+            static constexpr auto value = ptl::field_element<I, Tuple>::type::bits;
     };
 
 
+    /** Returns the byte order of a field
+	 *  @tparam I Order number of the element within the tuple
+	 *  @tparam Tuple Tuple that contains the field
+	 */
+    template<std::size_t I, class Tuple>
+    struct field_order
+    {
+            static constexpr ptl::byte_order value = ptl::field_element<I, Tuple>::type::order;
+    };
+
     /** Provides a type alias for a field's type
 	 *  @tparam I Order number of the element within the tuple
 	 *  @tparam Tuple Tuplethat contains the field
 	 */
     template <std::size_t I, class Tuple>
-    using field_type = typename std::tuple_element<I, Tuple>::type::value_type;
+    using field_type = typename ptl::field_element<I, Tuple>::type::value_type;
 
-    /** Returns the bit offset of a field element within a tuple
-	 *  @tparam I Order number of the element within the tuple
+    /** Provides the bit offsets of a tuple's fields
+	 *
+	 *  The offsets are computed once per tuple as a prefix sum of the
+	 *  fields' bits, so looking up a field's offset does not
+	 *  instantiate a template per preceding field.  offset(I) is the
+	 *  bit offset of field I, and offset(fields) is the protocol's
+	 *  length in bits.
 	 *
 	 *  @tparam Tuple The tuple which contains the fields that represent
 	 *  the protocol
 	 */
-    template<std::size_t I, class Tuple>
-    struct field_bit_offset;
+    template <class Tuple>
+    struct field_offsets;
 
-    /// Recursive implementation of bit_offset
-    template<std::size_t I, class Tuple>
-    struct field_bit_offset
+    template <class... Fields>
+    struct field_offsets<std::tuple<Fields...>>
     {
-            static constexpr std::size_t value = ptl::field_bits<I - 1, Tuple>::value +
-                ptl::field_bit_offset<I - 1, Tuple>::value;
+            /// Number of fields in the tuple
+            static constexpr std::size_t fields = sizeof...(Fields);
+
+            /// Prefix sum of the fields' bits
+            struct table_type
+            {
+                    std::size_t offsets[fields + 1];
+            };
+
+        private:
+            static constexpr table_type make_table() noexcept {
+                const std::size_t bits[fields + 1] = { Fields::bits..., 0 };
+                table_type table = {};
+                for (std::size_t i = 0; i < fields; ++i) {
+                    table.offsets[i + 1] = table.offsets[i] + bits[i];
+                }
+                return table;
+            }
+
+        public:
+            static constexpr table_type table = make_table();
+
+            /// Returns the bit offset of field I
+            static constexpr std::size_t offset(const std::size_t i) noexcept {
+                return table.offsets[i];
+            }
     };
 
-    /// Base implementation of bit_offset for the zero element
-    template <class Tuple>
-    struct field_bit_offset<0, Tuple>
+    template <class... Fields>
+    constexpr typename field_offsets<std::tuple<Fields...>>::table_type
+    field_offsets<std::tuple<Fields...>>::table;
+
+    /** Returns the bit offset of a field element within a tuple
+	 *  @tparam I Order number of the element within the tuple
+	 *
+	 *  @tparam Tuple The tuple which contains the fields that represent
+	 *  the protocol
+	 */
+    template<std::size_t I, class Tuple>
+    struct field_bit_offset
     {
-            static constexpr std::size_t value = 0;
+            static_assert(I < std::tuple_size<Tuple>::value,
+                          "Protocol tuple index is greater than tuple size");
+            static constexpr std::size_t value = ptl::field_offsets<Tuple>::offset(I);
     };
 
     /** Returns the byte index of a field element in a tuple
@@ -135,7 +269,7 @@ namespace ptl
     template<std::size_t I, class Tuple>
     struct field_first_byte
     {
-            static constexpr std::size_t value = ptl::field_bit_offset<I, Tuple>::value / ptl::bits_per_byte;
+            static constexpr std::size_t value = ptl::field_offsets<Tuple>::offset(I) / ptl::bits_per_byte;
     };
 
     /** Returns the last byte index of a field
@@ -145,7 +279,7 @@ namespace ptl
     template <std::size_t I, class Tuple>
     struct field_last_byte
     {
-            static constexpr std::size_t value = (ptl::field_bit_offset<I, Tuple>::value +
+            static constexpr std::size_t value = (ptl::field_offsets<Tuple>::offset(I) +
                                                   ptl::field_bits<I, Tuple>::value - 1) / ptl::bits_per_byte;
     };
 
@@ -156,7 +290,7 @@ namespace ptl
     template <std::size_t I, class Tuple>
     struct field_spans_bytes
     {
-            static constexpr bool value = ((ptl::field_bit_offset<I, Tuple>::value % ptl::bits_per_byte) +
+            static constexpr bool value = ((ptl::field_offsets<Tuple>::offset(I) % ptl::bits_per_byte) +
                                            ptl::field_bits<I, Tuple>::value) > ptl::bits_per_byte;
     };
 
@@ -169,8 +303,7 @@ namespace ptl
     template<class Tuple>
     struct protocol_length
     {
-            static constexpr std::size_t value = ptl::field_bit_offset<std::tuple_size<Tuple>::value - 1, Tuple>::value +
-                ptl::field_bits<std::tuple_size<Tuple>::value - 1, Tuple>::value;
+            static constexpr std::size_t value = ptl::field_offsets<Tuple>::offset(std::tuple_size<Tuple>::value);
     };
 
     /// Specialization for when the field does not span multiple bytes
@@ -180,25 +313,24 @@ namespace ptl
         private:
             static constexpr auto byte_mask = ptl::msb_mask<unsigned char>(Field_Bits, Byte_Offset);
             static constexpr auto value_shift = ptl::bits_per_byte - Field_Bits - Byte_Offset;
+            static constexpr auto value_mask = ptl::msb_mask<T>(Field_Bits,
+                                                                std::numeric_limits<T>::digits - Field_Bits);
 
         public:
-            static const T get(unsigned char const * const buf) noexcept {
+            static constexpr T get(unsigned char const * const buf) noexcept {
                 // Select the bits from buf with the byte order's byte
                 // mask and right shift the resulting value the
                 // appropriate bits to fit in the value in the remaining
                 // bits of the field
-                return (buf[0] & byte_mask) >> value_shift;
+                return static_cast<T>((buf[0] & byte_mask) >> value_shift);
             }
 
-            static const void set(unsigned char * const buf, const T value) noexcept {
-
-                static constexpr auto value_mask = ptl::msb_mask<T>(Field_Bits,
-                                                                    std::numeric_limits<T>::digits - Field_Bits);
+            static constexpr void set(unsigned char * const buf, const T value) noexcept {
                 // Clear the current value
                 buf[0] &= static_cast<unsigned char>(~byte_mask);
 
                 // Set the new value
-                buf[0] |= ((value & value_mask) << value_shift);
+                buf[0] |= static_cast<unsigned char>((value & value_mask) << value_shift);
             }
     };
 
@@ -216,32 +348,30 @@ namespace ptl
             static constexpr auto value_shift = Field_Bits - (ptl::bits_per_byte - Byte_Offset);
             static constexpr auto next_bit_count = Field_Bits - ptl::byte_mask_len(Byte_Offset);
             static constexpr auto next_spans_bytes = ptl::spans_bytes(next_bit_count, 0);
+            static constexpr auto value_mask = ptl::msb_mask<T>(ptl::byte_mask_len(Byte_Offset),
+                                                                (std::numeric_limits<T>::digits - Field_Bits));
 
         public:
-            static const T get(unsigned char const * const buf) noexcept {
+            static constexpr T get(unsigned char const * const buf) noexcept {
 
                 // Selects the bits from buf with the mask, and left
                 // shifts the resulting value the appropriate bits to fit
                 // the next byte's value.  The formula below is:
 
                 // buf[0] & (mask to select field value in this byte) << (number of remaining field bits)
-                return (static_cast<T>((buf[0] & byte_mask)) << value_shift) +
+                return static_cast<T>((static_cast<T>((buf[0] & byte_mask)) << value_shift) +
                     std::conditional<next_spans_bytes,
                                      ptl::recursive_field_value<next_bit_count, 0, T>,
                                      ptl::terminal_field_value<next_bit_count, 0, T>
-                                     >::type::get(buf + 1);
+                                     >::type::get(buf + 1));
             }
 
-            static void set(unsigned char * const buf, const T val) noexcept {
-
-                static constexpr auto value_mask = ptl::msb_mask<T>(ptl::byte_mask_len(Byte_Offset),
-                                                                    (std::numeric_limits<T>::digits - Field_Bits));
-
+            static constexpr void set(unsigned char * const buf, const T val) noexcept {
                 // Clear the current value
                 buf[0] &= static_cast<unsigned char>(~byte_mask);
 
                 // Set current byte
-                buf[0] |= ((val & value_mask) >> value_shift);
+                buf[0] |= static_cast<unsigned char>((val & value_mask) >> value_shift);
 
                 std::conditional<next_spans_bytes,
                                  ptl::recursive_field_value<next_bit_count, 0, T>,
@@ -250,12 +380,316 @@ namespace ptl
             }
     };
 
+    /// Byte by byte implementation of a field's accessors
+    template <std::size_t Bits, std::size_t Offset, class T>
+    using byte_field_value = typename std::conditional<ptl::spans_bytes(Bits, Offset),
+                                                       ptl::recursive_field_value<Bits, Offset, T>,
+                                                       ptl::terminal_field_value<Bits, Offset, T>
+                                                       >::type;
+
+    /// The word type used by the word wide field accessors
+    using word_type = std::uint64_t;
+
+    /// Number of bits in a word_type
+    static constexpr std::size_t word_bits = static_cast<std::size_t>(std::numeric_limits<ptl::word_type>::digits);
+
+    /** Returns whether Bits + Offset can be read with a single word load
+	 *  @param bits The number of bits
+	 *  @param offset The offset into the first byte
+	 */
+    constexpr bool fits_word(std::size_t bits, std::size_t offset) noexcept {
+        return ptl::bits_per_byte == 8 && (offset % ptl::bits_per_byte) + bits <= ptl::word_bits;
+    }
+
+    /// Reverses the bytes of a word
+    constexpr ptl::word_type byte_swap(const ptl::word_type word) noexcept {
+#if defined(__GNUC__)
+        return __builtin_bswap64(word);
+#else
+        ptl::word_type swapped = 0;
+        for (std::size_t i = 0; i < sizeof(word); ++i) {
+            swapped |= ((word >> (i * 8)) & 0xff) << ((sizeof(word) - 1 - i) * 8);
+        }
+        return swapped;
+#endif
+    }
+
+    namespace detail
+    {
+        /** Loads and stores Bytes bytes as a big endian integer
+	 *
+	 *  Byte counts that aren't a power of two are split into power
+	 *  of two loads and stores which are combined in registers.
+	 *  Copying them through a word in memory instead would stall on
+	 *  store forwarding.
+	 *
+	 *  @tparam Bytes The number of bytes, must be <= sizeof(word_type)
+	 */
+        template <std::size_t Bytes>
+        struct big_endian_bytes
+        {
+            private:
+                static constexpr std::size_t head = Bytes > 4 ? 4 : Bytes > 2 ? 2 : 1;
+                static constexpr std::size_t tail_bits = 8 * (Bytes - head);
+
+            public:
+                static constexpr ptl::word_type load(unsigned char const * const buf) noexcept {
+                    return (big_endian_bytes<head>::load(buf) << tail_bits) |
+                        big_endian_bytes<Bytes - head>::load(buf + head);
+                }
+
+                static constexpr void store(unsigned char * const buf, const ptl::word_type value) noexcept {
+                    big_endian_bytes<head>::store(buf, value >> tail_bits);
+                    big_endian_bytes<Bytes - head>::store(buf + head, value);
+                }
+        };
+
+        /// Loads and stores power of two byte counts with a single access
+        template <class U>
+        struct big_endian_native
+        {
+            private:
+                static constexpr std::size_t bits = 8 * sizeof(U);
+
+                // Byte by byte load, used in constant expressions
+                static constexpr ptl::word_type load_bytes(unsigned char const * const buf) noexcept {
+                    ptl::word_type value = 0;
+                    for (std::size_t i = 0; i < sizeof(U); ++i) {
+                        value = (value << 8) | buf[i];
+                    }
+                    return value;
+                }
+
+                // Byte by byte store, used in constant expressions
+                static constexpr void store_bytes(unsigned char * const buf, const ptl::word_type value) noexcept {
+                    for (std::size_t i = 0; i < sizeof(U); ++i) {
+                        buf[i] = static_cast<unsigned char>(value >> (8 * (sizeof(U) - 1 - i)));
+                    }
+                }
+
+            public:
+                static constexpr ptl::word_type load(unsigned char const * const buf) noexcept {
+                    if (ptl::constant_evaluated()) {
+                        return load_bytes(buf);
+                    }
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+                    U value = 0;
+                    std::memcpy(&value, buf, sizeof(value));
+                    return ptl::byte_swap(value) >> (ptl::word_bits - bits);
+#elif defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+                    U value = 0;
+                    std::memcpy(&value, buf, sizeof(value));
+                    return value;
+#else
+                    return load_bytes(buf);
+#endif
+                }
+
+                static constexpr void store(unsigned char * const buf, const ptl::word_type value) noexcept {
+                    if (ptl::constant_evaluated()) {
+                        store_bytes(buf, value);
+                        return;
+                    }
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+                    const U swapped = static_cast<U>(ptl::byte_swap(value) >> (ptl::word_bits - bits));
+                    std::memcpy(buf, &swapped, sizeof(swapped));
+#elif defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+                    const U native = static_cast<U>(value);
+                    std::memcpy(buf, &native, sizeof(native));
+#else
+                    store_bytes(buf, value);
+#endif
+                }
+        };
+
+        template <>
+        struct big_endian_bytes<8> : ptl::detail::big_endian_native<std::uint64_t> {};
+
+        template <>
+        struct big_endian_bytes<4> : ptl::detail::big_endian_native<std::uint32_t> {};
+
+        template <>
+        struct big_endian_bytes<2> : ptl::detail::big_endian_native<std::uint16_t> {};
+
+        template <>
+        struct big_endian_bytes<1>
+        {
+                static constexpr ptl::word_type load(unsigned char const * const buf) noexcept {
+                    return buf[0];
+                }
+
+                static constexpr void store(unsigned char * const buf, const ptl::word_type value) noexcept {
+                    buf[0] = static_cast<unsigned char>(value);
+                }
+        };
+    }
+
+    /** Loads Bytes bytes from buf into the most significant bytes of a word
+	 *
+	 *  The bytes are interpreted in big endian byte order, so buf[0]
+	 *  ends up in the most significant byte of the returned word.
+	 *
+	 *  @tparam Bytes The number of bytes to load, must be <= sizeof(word_type)
+	 */
+    template <std::size_t Bytes>
+    constexpr ptl::word_type load_word(unsigned char const * const buf) noexcept {
+        static_assert(Bytes > 0 && Bytes <= sizeof(ptl::word_type),
+                      "The number of bytes loaded must fit in a word");
+        return ptl::detail::big_endian_bytes<Bytes>::load(buf) << (ptl::word_bits - 8 * Bytes);
+    }
+
+    /** Stores the Bytes most significant bytes of word into buf
+	 *
+	 *  The inverse of load_word.
+	 *
+	 *  @tparam Bytes The number of bytes to store, must be <= sizeof(word_type)
+	 */
+    template <std::size_t Bytes>
+    constexpr void store_word(unsigned char * const buf, const ptl::word_type word) noexcept {
+        static_assert(Bytes > 0 && Bytes <= sizeof(ptl::word_type),
+                      "The number of bytes stored must fit in a word");
+        ptl::detail::big_endian_bytes<Bytes>::store(buf, word >> (ptl::word_bits - 8 * Bytes));
+    }
+
+    /** Sets and returns the value of a field with a single word load
+	 *
+	 *  The bytes the field spans are loaded into a word with one
+	 *  load, and the field's value is selected with one shift and
+	 *  one mask.  Only usable when ptl::fits_word(Bits, Offset).
+	 *
+	 *  @tparam Bits The number of bits in the field
+	 *  @tparam Offset The field's offset into its first byte
+	 *  @tparam T The type used to represent the field
+	 */
+    template <std::size_t Bits, std::size_t Offset, class T>
+    struct word_field_value
+    {
+            static_assert(ptl::fits_word(Bits, Offset),
+                          "The field must fit within a word");
+
+            /// Number of bytes spanned by the field
+            static constexpr std::size_t bytes = ptl::required_bytes(Bits + Offset);
+
+        private:
+            static constexpr auto value_shift = ptl::word_bits - Bits - Offset;
+            static constexpr auto word_mask = ptl::msb_mask<ptl::word_type>(Bits, Offset);
+
+        public:
+            static constexpr T get(unsigned char const * const buf) noexcept {
+                return static_cast<T>((ptl::load_word<bytes>(buf) & word_mask) >> value_shift);
+            }
+
+            static constexpr void set(unsigned char * const buf, const T value) noexcept {
+                const ptl::word_type word = ptl::load_word<bytes>(buf);
+                ptl::store_word<bytes>(buf, (word & ~word_mask) |
+                                       ((static_cast<ptl::word_type>(value) << value_shift) & word_mask));
+            }
+    };
+
+    /** Sets and returns the value of a field
+	 *
+	 *  Uses word_field_value when the field fits in a word, and
+	 *  falls back to the byte by byte implementation otherwise.
+	 *
+	 *  @tparam Bits The number of bits in the field
+	 *  @tparam Offset The field's offset into its first byte
+	 *  @tparam T The type used to represent the field
+	 */
     template <std::size_t Bits, std::size_t Offset, class T>
-    using field_value = typename std::conditional<ptl::spans_bytes(Bits, Offset),
-                                                  ptl::recursive_field_value<Bits, Offset, T>,
-                                                  ptl::terminal_field_value<Bits, Offset, T>
+    using field_value = typename std::conditional<ptl::fits_word(Bits, Offset),
+                                                  ptl::word_field_value<Bits, Offset, T>,
+                                                  ptl::byte_field_value<Bits, Offset, T>
                                                   >::type;
 
+    /** Reverses the order of the bytes in the Bits least significant bits of value
+	 *  @tparam Bits The number of bits to reverse, a multiple of 8
+	 */
+    template <std::size_t Bits>
+    constexpr ptl::word_type reverse_bytes(const ptl::word_type value) noexcept {
+        static_assert(Bits % 8 == 0 && Bits > 0 && Bits <= ptl::word_bits,
+                      "Only whole bytes can be reversed");
+        return ptl::byte_swap(value) >> (ptl::word_bits - Bits);
+    }
+
+    /** Converts a field's value between big endian and the field's byte order
+	 *  @tparam Order The field's byte order
+	 *  @tparam Bits The number of bits in the field
+	 */
+    template <ptl::byte_order Order, std::size_t Bits>
+    constexpr ptl::word_type order_bytes(const ptl::word_type value, std::false_type) noexcept {
+        return value;
+    }
+
+    template <ptl::byte_order Order, std::size_t Bits>
+    constexpr ptl::word_type order_bytes(const ptl::word_type value, std::true_type) noexcept {
+        return ptl::reverse_bytes<Bits>(value);
+    }
+
+    template <ptl::byte_order Order, std::size_t Bits>
+    constexpr ptl::word_type order_bytes(const ptl::word_type value) noexcept {
+        return ptl::order_bytes<Order, Bits>(value,
+                                             std::integral_constant<bool, Order == ptl::byte_order::little>());
+    }
+
+    /** Sets and returns the value of a little endian field
+	 *
+	 *  Little endian fields must start on a byte boundary and be a
+	 *  whole number of bytes.  On little endian hosts the field is
+	 *  read and written with a plain unaligned load and store.
+	 *
+	 *  @tparam Bits The number of bits in the field
+	 *  @tparam Offset The field's offset into its first byte
+	 *  @tparam T The type used to represent the field
+	 */
+    template <std::size_t Bits, std::size_t Offset, class T>
+    struct little_field_value
+    {
+            static_assert(Offset == 0,
+                          "Little endian fields must start on a byte boundary");
+            static_assert(Bits % 8 == 0 && Bits <= ptl::word_bits,
+                          "Little endian fields must be a whole number of bytes");
+            static_assert(ptl::bits_per_byte == 8,
+                          "Little endian fields require 8 bit bytes");
+
+            /// Number of bytes in the field
+            static constexpr std::size_t bytes = Bits / 8;
+
+            static constexpr T get(unsigned char const * const buf) noexcept {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+                if (!ptl::constant_evaluated()) {
+                    T value = 0;
+                    std::memcpy(&value, buf, bytes);
+                    return value;
+                }
+#endif
+                return static_cast<T>(ptl::reverse_bytes<Bits>(ptl::load_word<bytes>(buf) >>
+                                                               (ptl::word_bits - Bits)));
+            }
+
+            static constexpr void set(unsigned char * const buf, const T value) noexcept {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+                if (!ptl::constant_evaluated()) {
+                    std::memcpy(buf, &value, bytes);
+                    return;
+                }
+#endif
+                ptl::store_word<bytes>(buf, ptl::reverse_bytes<Bits>(static_cast<ptl::word_type>(value)) <<
+                                       (ptl::word_bits - Bits));
+            }
+    };
+
+    /** Sets and returns the value of a field in the field's byte order
+	 *  @tparam Field The ptl::field
+	 *  @tparam Offset The field's offset into its first byte
+	 */
+    template <class Field, std::size_t Offset>
+    using field_accessor = typename std::conditional<Field::order == ptl::byte_order::little,
+                                                     ptl::little_field_value<Field::bits, Offset,
+                                                                             typename Field::value_type>,
+                                                     ptl::field_value<Field::bits, Offset,
+                                                                      typename Field::value_type>
+                                                     >::type;
+
     /// Defines the field traits which are dependent on the protocol
     template <std::size_t Field, class Tuple>
     struct field_protocol_traits
@@ -263,7 +697,7 @@ namespace ptl
             static_assert(Field < std::tuple_size<Tuple>::value,
                           "Protocol tuple index is greater than tuple size");
             /// The type of the field
-            using type = typename std::tuple_element<Field, Tuple>::type;
+            using type = typename ptl::field_element<Field, Tuple>::type;
             /// The field index in the protocol
             static constexpr auto index = Field;
             /// The number of bits before the field's bits in a buffer
@@ -274,6 +708,8 @@ namespace ptl
             static constexpr auto byte_index = ptl::field_first_byte<Field, Tuple>::value;
             /// True if the field spans multiple bytes in a buffer
             static constexpr auto spans_bytes = ptl::spans_bytes(type::bits, bit_offset);
+            /// Byte order of the field's bytes in a buffer
+            static constexpr auto order = type::order;
     };
 
     template <class Tuple>
@@ -292,6 +728,143 @@ namespace ptl
             using array_type = std::array<unsigned char, bytes>;
     };
 
+    /** Provides a std::tuple of a field tuple's value types
+	 *  @tparam Tuple The tuple which contains the fields
+	 */
+    template <class Tuple>
+    struct value_tuple;
+
+    template <class... Fields>
+    struct value_tuple<std::tuple<Fields...>>
+    {
+            using type = std::tuple<typename Fields::value_type...>;
+    };
+
+    /** A fixed size array of words
+	 *
+	 *  Unlike std::array before C++17, its elements can be modified
+	 *  in constant expressions.
+	 *
+	 *  @tparam N The number of words
+	 */
+    template <std::size_t N>
+    struct word_array
+    {
+            ptl::word_type words[N];
+
+            constexpr ptl::word_type & operator[](const std::size_t i) noexcept {
+                return words[i];
+            }
+
+            constexpr ptl::word_type const & operator[](const std::size_t i) const noexcept {
+                return words[i];
+            }
+
+            static constexpr std::size_t size() noexcept {
+                return N;
+            }
+    };
+
+    /** A protocol buffer held as big endian words
+	 *
+	 *  Word i holds the protocol buffer's bytes [i * 8, i * 8 + 8),
+	 *  with the first byte in the most significant byte.  Bytes past
+	 *  the end of the protocol buffer are zero.
+	 *
+	 *  @tparam Tuple The tuple that represents the protocol
+	 */
+    template <class Tuple>
+    struct protocol_words
+    {
+            static_assert(ptl::bits_per_byte == 8,
+                          "Protocol words require 8 bit bytes");
+
+            /// Number of words required to store the protocol's buffer
+            static constexpr std::size_t count = (ptl::protocol_traits<Tuple>::bytes + sizeof(ptl::word_type) - 1) /
+                sizeof(ptl::word_type);
+
+            /// Number of bytes in the last word
+            static constexpr std::size_t last_bytes = ptl::protocol_traits<Tuple>::bytes -
+                (count - 1) * sizeof(ptl::word_type);
+
+            using array_type = ptl::word_array<count>;
+
+            /// Loads a protocol buffer into words
+            static constexpr array_type load(unsigned char const * const buf) noexcept {
+                array_type words{};
+                for (std::size_t i = 0; i < count - 1; ++i) {
+                    words[i] = ptl::load_word<sizeof(ptl::word_type)>(buf + i * sizeof(ptl::word_type));
+                }
+                words[count - 1] = ptl::load_word<last_bytes>(buf + (count - 1) * sizeof(ptl::word_type));
+                return words;
+            }
+
+            /// Stores words into a protocol buffer
+            static constexpr void store(unsigned char * const buf, array_type const & words) noexcept {
+                for (std::size_t i = 0; i < count - 1; ++i) {
+                    ptl::store_word<sizeof(ptl::word_type)>(buf + i * sizeof(ptl::word_type), words[i]);
+                }
+                ptl::store_word<last_bytes>(buf + (count - 1) * sizeof(ptl::word_type), words[count - 1]);
+            }
+    };
+
+    /** Returns the value of a field from a protocol buffer held as words
+	 *  @tparam Bit_Offset The field's bit offset in the protocol buffer
+	 *  @tparam Bits The number of bits in the field
+	 *  @tparam T The type used to represent the field
+	 *  @tparam Order Byte order of the field's bytes
+	 */
+    template <std::size_t Bit_Offset, std::size_t Bits, class T, ptl::byte_order Order = ptl::byte_order::big>
+    struct words_field_value
+    {
+        private:
+            static constexpr std::size_t index = Bit_Offset / ptl::word_bits;
+            static constexpr std::size_t shift = Bit_Offset % ptl::word_bits;
+            static constexpr bool straddles = shift + Bits > ptl::word_bits;
+
+            // The field is within a single word
+            template <std::size_t N>
+            static constexpr ptl::word_type get(ptl::word_array<N> const & words, std::false_type) noexcept {
+                return (words[index] << shift) >> (ptl::word_bits - Bits);
+            }
+
+            // The field's last bits are in the next word
+            template <std::size_t N>
+            static constexpr ptl::word_type get(ptl::word_array<N> const & words, std::true_type) noexcept {
+                return ((words[index] << shift) >> (ptl::word_bits - Bits)) |
+                    (words[index + 1] >> (2 * ptl::word_bits - shift - Bits));
+            }
+
+            static constexpr auto value_mask = ptl::lsb_mask<ptl::word_type>(Bits, 0);
+
+            // The field is within a single word
+            template <std::size_t N>
+            static constexpr void set(ptl::word_array<N> & words, const ptl::word_type value, std::false_type) noexcept {
+                words[index] |= value << (ptl::word_bits - shift - Bits);
+            }
+
+            // The field's last bits are in the next word
+            template <std::size_t N>
+            static constexpr void set(ptl::word_array<N> & words, const ptl::word_type value, std::true_type) noexcept {
+                words[index] |= value >> (shift + Bits - ptl::word_bits);
+                words[index + 1] |= value << (2 * ptl::word_bits - shift - Bits);
+            }
+
+        public:
+            template <std::size_t N>
+            static constexpr T get(ptl::word_array<N> const & words) noexcept {
+                return static_cast<T>(ptl::order_bytes<Order, Bits>(get(words,
+                                                                        std::integral_constant<bool, straddles>())));
+            }
+
+            /// Sets the field's bits in words, which must be zero
+            template <std::size_t N>
+            static constexpr void set(ptl::word_array<N> & words, const T value) noexcept {
+                set(words, ptl::order_bytes<Order, Bits>(static_cast<ptl::word_type>(value) & value_mask),
+                    std::integral_constant<bool, straddles>());
+            }
+    };
+
     /** Class that represents a protocol defined by a field tuple
 	 *  @tparam Tuple The tuple that represents the protocol
 	 */
@@ -309,7 +882,18 @@ namespace ptl
              *  @param buf Protocol buffer.
              */
             template<std::size_t I>
-            static ptl::field_type<I, Tuple> field_value(unsigned char const * const buf) noexcept;
+            static constexpr ptl::field_type<I, Tuple> field_value(unsigned char const * const buf) noexcept;
+
+            /// Accessor for a protocol field given a protocol buffer array
+            /**
+             *  Usable in constant expressions in C++14, where
+             *  std::array::data() isn't constexpr.
+             *
+             *  @tparam I Order number of the field in the protocol tuple.
+             *  @param buf Protocol buffer.
+             */
+            template<std::size_t I>
+            static constexpr ptl::field_type<I, Tuple> field_value(typename traits::array_type const & buf) noexcept;
 
             /// Sets a protocol field's value
             /**
@@ -318,7 +902,89 @@ namespace ptl
              *  @param val Value to set the field to
              */
             template<std::size_t I>
-            static void field_value(unsigned char * const buf, const ptl::field_type<I, Tuple> value) noexcept;
+            static constexpr void field_value(unsigned char * const buf, const ptl::field_type<I, Tuple> value) noexcept;
+
+            /// std::tuple of the protocol's field value types
+            using value_tuple = typename ptl::value_tuple<Tuple>::type;
+
+            /// Returns the values of all of the protocol's fields
+            /**
+             *  The protocol buffer is loaded once, and every field is
+             *  extracted from the loaded words.
+             *
+             *  @param buf Protocol buffer.
+             */
+            static constexpr value_tuple unpack(unsigned char const * const buf) noexcept;
+
+            /// Returns the values of all of the protocol's fields
+            /**
+             *  @param buf Protocol buffer.
+             */
+            static constexpr value_tuple unpack(typename traits::array_type const & buf) noexcept;
+
+            /// Returns the values of the selected protocol fields
+            /**
+             *  @tparam I Order numbers of the fields in the protocol tuple.
+             *  @param buf Protocol buffer.
+             */
+            template<std::size_t... I>
+            static constexpr std::tuple<ptl::field_type<I, Tuple>...> unpack(unsigned char const * const buf) noexcept;
+
+            /// Sets the values of all of the protocol's fields
+            /**
+             *  The protocol buffer's words are assembled from the
+             *  values and written with one store per word.  The
+             *  previous contents of the buffer are not read.
+             *
+             *  @param buf Protocol buffer.
+             *  @param values Values of the protocol's fields.
+             */
+            static constexpr void pack(unsigned char * const buf, value_tuple const & values) noexcept;
+
+            /// Sets the values of all of the protocol's fields
+            /**
+             *  @param buf Protocol buffer.
+             *  @param values Values of the protocol's fields in field order.
+             */
+            template<class... Values>
+            static constexpr void pack(unsigned char * const buf, Values const &... values) noexcept;
+
+            /// Returns a protocol buffer array with the fields set to values
+            /**
+             *  Usable in constant expressions in C++14, where a
+             *  std::array's elements can't be modified, so constant
+             *  packets can be built by the compiler:
+             *
+             *      constexpr auto packet = rtp::make(2, false, false, 0, false, 96, 1, 0, ssrc);
+             *
+             *  @param values Values of the protocol's fields.
+             */
+            static constexpr typename traits::array_type make(value_tuple const & values) noexcept;
+
+            /// Returns a protocol buffer array with the fields set to values
+            /**
+             *  @param values Values of the protocol's fields in field order.
+             */
+            template<class... Values>
+            static constexpr typename traits::array_type make(Values const &... values) noexcept;
+
+            /// Extracts a field from an array of fixed stride records
+            /**
+             *  Uses a vectorized kernel when the CPU supports one, and
+             *  field_value otherwise.  The record buffer must be at
+             *  least (count - 1) * stride + traits::bytes bytes.
+             *
+             *  @tparam I Order number of the field in the protocol tuple.
+             *  @param base First record's protocol buffer.
+             *  @param stride Number of bytes between records.
+             *  @param count Number of records.
+             *  @param out Array of count field values.
+             */
+            template<std::size_t I>
+            static void extract(unsigned char const * const base,
+                                const std::size_t stride,
+                                const std::size_t count,
+                                ptl::field_type<I, Tuple> * const out) noexcept;
 
             /// Defines the field_protocol_traits for the field
             /**
@@ -333,30 +999,241 @@ namespace ptl
              */
             template <std::size_t I>
             using field = ptl::field<ptl::field_bits<I, Tuple>::value,
-                                     ptl::field_type<I, Tuple>>;
+                                     ptl::field_type<I, Tuple>,
+                                     ptl::field_order<I, Tuple>::value>;
     };
 
     template<class Tuple>
     template<std::size_t I>
-    ptl::field_type<I, Tuple> protocol<Tuple>::field_value(unsigned char const * const buf) noexcept
+    constexpr ptl::field_type<I, Tuple> protocol<Tuple>::field_value(unsigned char const * const buf) noexcept
     {
         static_assert(I < std::tuple_size<Tuple>::value,
                       "Protocol tuple index is greater than tuple size");
-        return ptl::field_value<ptl::field_bits<I, Tuple>::value,
-                                ptl::field_byte_offset(ptl::field_bit_offset<I, Tuple>::value),
-                                ptl::field_type<I, Tuple>
-                                >::get(buf + ptl::field_first_byte<I, Tuple>::value);
+        return ptl::field_accessor<typename ptl::field_element<I, Tuple>::type,
+                                   ptl::field_byte_offset(ptl::field_bit_offset<I, Tuple>::value)
+                                   >::get(buf + ptl::field_first_byte<I, Tuple>::value);
     }
 
     template<class Tuple>
     template<std::size_t I>
-    void protocol<Tuple>::field_value(unsigned char * const buf, const ptl::field_type<I, Tuple> val) noexcept
+    constexpr ptl::field_type<I, Tuple> protocol<Tuple>::field_value(typename traits::array_type const & buf) noexcept
+    {
+        return field_value<I>(&buf[0]);
+    }
+
+    template<class Tuple>
+    template<std::size_t I>
+    constexpr void protocol<Tuple>::field_value(unsigned char * const buf, const ptl::field_type<I, Tuple> val) noexcept
     {
         static_assert(I < std::tuple_size<Tuple>::value,
                       "Protocol tuple index is greater than tuple size");
-        ptl::field_value<ptl::field_bits<I, Tuple>::value,
-                         ptl::field_byte_offset(ptl::field_bit_offset<I, Tuple>::value),
-                         ptl::field_type<I, Tuple>
-                         >::set(buf + ptl::field_first_byte<I, Tuple>::value, val);
+        ptl::field_accessor<typename ptl::field_element<I, Tuple>::type,
+                            ptl::field_byte_offset(ptl::field_bit_offset<I, Tuple>::value)
+                            >::set(buf + ptl::field_first_byte<I, Tuple>::value, val);
+    }
+
+    template<class Tuple>
+    template<std::size_t... I>
+    constexpr std::tuple<ptl::field_type<I, Tuple>...> protocol<Tuple>::unpack(unsigned char const * const buf) noexcept
+    {
+        static_assert(sizeof...(I) > 0,
+                      "At least one field must be unpacked");
+        const auto words = ptl::protocol_words<Tuple>::load(buf);
+        return std::tuple<ptl::field_type<I, Tuple>...>(
+            ptl::words_field_value<ptl::field_bit_offset<I, Tuple>::value,
+                                   ptl::field_bits<I, Tuple>::value,
+                                   ptl::field_type<I, Tuple>,
+                                   ptl::field_order<I, Tuple>::value
+                                   >::get(words)...);
+    }
+
+    namespace detail
+    {
+        template <class Protocol, std::size_t... I>
+        constexpr typename Protocol::value_tuple unpack_all(unsigned char const * const buf,
+                                                  std::index_sequence<I...>) noexcept
+        {
+            return Protocol::template unpack<I...>(buf);
+        }
+    }
+
+    template<class Tuple>
+    constexpr typename protocol<Tuple>::value_tuple protocol<Tuple>::unpack(unsigned char const * const buf) noexcept
+    {
+        return ptl::detail::unpack_all<protocol<Tuple>>(buf,
+                                                        std::make_index_sequence<std::tuple_size<Tuple>::value>());
+    }
+
+    template<class Tuple>
+    constexpr typename protocol<Tuple>::value_tuple protocol<Tuple>::unpack(typename traits::array_type const & buf) noexcept
+    {
+        return unpack(&buf[0]);
+    }
+
+    namespace detail
+    {
+        template <class Tuple, std::size_t... I>
+        constexpr void pack_all(unsigned char * const buf,
+                      typename ptl::value_tuple<Tuple>::type const & values,
+                      std::index_sequence<I...>) noexcept
+        {
+            typename ptl::protocol_words<Tuple>::array_type words{};
+            // Expands to one words_field_value::set call per field
+            const int expand[] = {
+                (ptl::words_field_value<ptl::field_bit_offset<I, Tuple>::value,
+                                        ptl::field_bits<I, Tuple>::value,
+                                        ptl::field_type<I, Tuple>,
+                                        ptl::field_order<I, Tuple>::value
+                                        >::set(words, std::get<I>(values)), 0)...
+            };
+            (void)expand;
+            ptl::protocol_words<Tuple>::store(buf, words);
+        }
+    }
+
+    template<class Tuple>
+    constexpr void protocol<Tuple>::pack(unsigned char * const buf, value_tuple const & values) noexcept
+    {
+        ptl::detail::pack_all<Tuple>(buf, values, std::make_index_sequence<std::tuple_size<Tuple>::value>());
+    }
+
+    template<class Tuple>
+    template<class... Values>
+    constexpr void protocol<Tuple>::pack(unsigned char * const buf, Values const &... values) noexcept
+    {
+        static_assert(sizeof...(Values) == std::tuple_size<Tuple>::value,
+                      "A value must be provided for every protocol field");
+        pack(buf, value_tuple(values...));
+    }
+
+    namespace detail
+    {
+        template <class Protocol, std::size_t... B>
+        constexpr typename Protocol::traits::array_type make(typename Protocol::value_tuple const & values,
+                                                             std::index_sequence<B...>) noexcept
+        {
+            // Packed into a plain array, whose elements can be
+            // modified in constant expressions
+            unsigned char buf[Protocol::traits::bytes] = {};
+            Protocol::pack(buf, values);
+            return typename Protocol::traits::array_type{{buf[B]...}};
+        }
+    }
+
+    template<class Tuple>
+    constexpr typename protocol<Tuple>::traits::array_type protocol<Tuple>::make(value_tuple const & values) noexcept
+    {
+        return ptl::detail::make<protocol<Tuple>>(values, std::make_index_sequence<traits::bytes>());
+    }
+
+    template<class Tuple>
+    template<class... Values>
+    constexpr typename protocol<Tuple>::traits::array_type protocol<Tuple>::make(Values const &... values) noexcept
+    {
+        static_assert(sizeof...(Values) == std::tuple_size<Tuple>::value,
+                      "A value must be provided for every protocol field");
+        return make(value_tuple(values...));
+    }
+
+    namespace detail
+    {
+#if defined(PTL_X86_DISPATCH)
+        /// Returns true if the CPU supports AVX2
+        inline bool has_avx2() noexcept
+        {
+            static const bool avx2 = (__builtin_cpu_init(), __builtin_cpu_supports("avx2") != 0);
+            return avx2;
+        }
+
+        /** Extracts a field that fits in 32 bits from blocks of 8 records
+	 *
+	 *  Each block's field words are gathered, byte swapped, shifted
+	 *  and masked in one AVX2 register.
+	 *
+	 *  @return The number of records extracted
+	 */
+        template <std::size_t Bits, std::size_t Offset, class T>
+        __attribute__((target("avx2")))
+        std::size_t extract_avx2(unsigned char const * base,
+                                 const std::size_t stride,
+                                 const std::size_t count,
+                                 T * out) noexcept
+        {
+            static constexpr int lanes = 8;
+            const int s = static_cast<int>(stride);
+            const __m256i index = _mm256_setr_epi32(0, s, 2 * s, 3 * s, 4 * s, 5 * s, 6 * s, 7 * s);
+            const __m256i swap = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+                                                  3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+            std::size_t i = 0;
+            for (; i + lanes <= count; i += lanes, base += lanes * stride, out += lanes) {
+                __m256i v = _mm256_i32gather_epi32(reinterpret_cast<int const *>(base), index, 1);
+                v = _mm256_shuffle_epi8(v, swap);
+                v = _mm256_slli_epi32(v, Offset);
+                v = _mm256_srli_epi32(v, 32 - Bits);
+                if (sizeof(T) == sizeof(std::uint32_t)) {
+                    _mm256_storeu_si256(reinterpret_cast<__m256i *>(out), v);
+                } else {
+                    alignas(32) std::uint32_t values[lanes];
+                    _mm256_store_si256(reinterpret_cast<__m256i *>(values), v);
+                    for (int j = 0; j < lanes; ++j) {
+                        out[j] = static_cast<T>(values[j]);
+                    }
+                }
+            }
+            return i;
+        }
+#endif
+
+        /** Returns the number of records whose field can be read with
+	 *  a Load_Bytes load without reading past the record buffer
+	 */
+        template <std::size_t Load_Bytes>
+        inline std::size_t loadable_records(const std::size_t byte_index,
+                                            const std::size_t protocol_bytes,
+                                            const std::size_t stride,
+                                            const std::size_t count) noexcept
+        {
+            if (count == 0 || stride == 0) {
+                return 0;
+            }
+            const std::size_t size = (count - 1) * stride + protocol_bytes;
+            if (size < byte_index + Load_Bytes) {
+                return 0;
+            }
+            const std::size_t records = (size - byte_index - Load_Bytes) / stride + 1;
+            return records < count ? records : count;
+        }
+    }
+
+    template<class Tuple>
+    template<std::size_t I>
+    void protocol<Tuple>::extract(unsigned char const * const base,
+                                  const std::size_t stride,
+                                  const std::size_t count,
+                                  ptl::field_type<I, Tuple> * const out) noexcept
+    {
+        static_assert(I < std::tuple_size<Tuple>::value,
+                      "Protocol tuple index is greater than tuple size");
+        std::size_t i = 0;
+#if defined(PTL_X86_DISPATCH)
+        using traits = ptl::field_protocol_traits<I, Tuple>;
+        static constexpr bool fits = traits::order == ptl::byte_order::big &&
+            ptl::required_bytes(traits::type::bits + traits::byte_bit_offset) <= sizeof(std::uint32_t);
+        if (fits && stride <= static_cast<std::size_t>(std::numeric_limits<int>::max() / 8) &&
+            ptl::detail::has_avx2()) {
+            const std::size_t records = ptl::detail::loadable_records<sizeof(std::uint32_t)>(
+                traits::byte_index, ptl::protocol_traits<Tuple>::bytes, stride, count);
+            i = ptl::detail::extract_avx2<(fits ? traits::type::bits : 1),
+                                          (fits ? traits::byte_bit_offset : 0)>(base + traits::byte_index,
+                                                                                stride,
+                                                                                records,
+                                                                                out);
+        }
+#endif
+        for (; i < count; ++i) {
+            out[i] = field_value<I>(base + i * stride);
+        }
     }
 }
+
+#endif
@@ -0,0 +1,289 @@
+#ifndef PTL_BIT_READER_HPP
+#define PTL_BIT_READER_HPP
+
+#include <cstdint>
+#include <tuple>
+#include <utility>
+#include "ptl.hpp"
+
+namespace ptl
+{
+    /// Returns the number of leading zero bits of a non-zero word
+    inline unsigned int leading_zeros(const ptl::word_type word) noexcept
+    {
+#if defined(__GNUC__)
+        return static_cast<unsigned int>(__builtin_clzll(word));
+#else
+        unsigned int zeros = 0;
+        for (ptl::word_type bit = ptl::msb_mask<ptl::word_type>(1, 0); (word & bit) == 0; bit >>= 1) {
+            ++zeros;
+        }
+        return zeros;
+#endif
+    }
+
+    /** Reads a bit stream's fields in sequence
+	 *
+	 *  Variable width fields, such as those of H.264 and HEVC
+	 *  parameter sets and slice headers, are read from the stream's
+	 *  next bits.  The next bits are cached in a word that's refilled
+	 *  with a single load of eight bytes, so reads of up to 56 bits
+	 *  take no more than one refill.
+	 *
+	 *  Reading past the end of the stream yields zero bits and sets
+	 *  overrun(), so a header can be parsed without checking each read
+	 *  and checked once at the end.
+	 */
+    class bit_reader
+    {
+        public:
+
+            /// Number of bits a single refill makes available
+            static constexpr std::size_t cache_bits = ptl::word_bits - ptl::bits_per_byte;
+
+            /// Creates a reader of size bytes of data
+            bit_reader(unsigned char const * const data, const std::size_t size) noexcept;
+
+            /// Returns the next N bits, N <= 64
+            template <std::size_t N>
+            ptl::word_type read() noexcept;
+
+            /// Returns the next bits bits, bits <= 64
+            ptl::word_type read(const std::size_t bits) noexcept;
+
+            /// Returns the next bit
+            bool read_flag() noexcept {
+                return read<1>() != 0;
+            }
+
+            /// Returns the next unsigned Exp-Golomb code, ue(v)
+            /**
+             *  Codes with more than 31 leading zero bits don't fit in
+             *  32 bits, so they're read as 0 and set overrun().
+             */
+            std::uint32_t read_ue() noexcept;
+
+            /// Returns the next signed Exp-Golomb code, se(v)
+            std::int32_t read_se() noexcept;
+
+            /// Reads a protocol's fields from the next bits
+            /**
+             *  A protocol at a byte aligned position is unpacked from
+             *  the stream's bytes, otherwise each field is read in
+             *  turn.  Fields' byte orders are applied as unpack
+             *  applies them.
+             *
+             *  @tparam Protocol The ptl::protocol to read
+             */
+            template <class Protocol>
+            typename Protocol::value_tuple read_protocol() noexcept;
+
+            /// Skips the next bits bits
+            void skip(std::size_t bits) noexcept;
+
+            /// Skips to the next byte boundary
+            void align() noexcept {
+                skip((ptl::bits_per_byte - position() % ptl::bits_per_byte) % ptl::bits_per_byte);
+            }
+
+            /// Returns the number of bits read or skipped
+            std::size_t position() const noexcept {
+                return pos_ * ptl::bits_per_byte - cached_;
+            }
+
+            /// Returns the number of bits left in the stream
+            std::size_t remaining() const noexcept {
+                return overrun_ ? 0 : (size_ - pos_) * ptl::bits_per_byte + cached_;
+            }
+
+            /// Returns true if the next bit is on a byte boundary
+            bool byte_aligned() const noexcept {
+                return cached_ % ptl::bits_per_byte == 0;
+            }
+
+            /// Returns true if a read went past the end of the stream
+            bool overrun() const noexcept {
+                return overrun_;
+            }
+
+        private:
+
+            // Adds the stream's next bytes to the cache, leaving at
+            // least cache_bits bits cached unless the stream ends
+            void refill() noexcept;
+
+            // Returns the next bits bits, 0 < bits <= cache_bits
+            ptl::word_type take(const std::size_t bits) noexcept;
+
+            // Returns the next Exp-Golomb code number, or 0 and sets
+            // overrun_ if it has more than max_zeros leading zero bits
+            std::uint64_t read_code(const std::size_t max_zeros) noexcept;
+
+            template <class Protocol, std::size_t... I>
+            typename Protocol::value_tuple read_fields(std::index_sequence<I...>) noexcept;
+
+            unsigned char const * data_;
+            std::size_t size_;
+            // Offset of the first byte that isn't cached
+            std::size_t pos_;
+            // The next bits, starting from the most significant bit.
+            // The bits after the cached bits are the stream's or zero
+            ptl::word_type cache_;
+            std::size_t cached_;
+            bool overrun_;
+    };
+
+    inline bit_reader::bit_reader(unsigned char const * const data, const std::size_t size) noexcept :
+        data_(data),
+        size_(size),
+        pos_(0),
+        cache_(0),
+        cached_(0),
+        overrun_(false)
+    {}
+
+    inline void bit_reader::refill() noexcept
+    {
+        if (pos_ + sizeof(ptl::word_type) <= size_) {
+            // Whole bytes of the load are kept, the rest of its bits
+            // are the same bits the next refill loads
+            cache_ |= ptl::load_word<sizeof(ptl::word_type)>(data_ + pos_) >> cached_;
+            const std::size_t bytes = (ptl::word_bits - 1 - cached_) / ptl::bits_per_byte;
+            pos_ += bytes;
+            cached_ += bytes * ptl::bits_per_byte;
+        } else {
+            for (; cached_ <= cache_bits && pos_ < size_; ++pos_, cached_ += ptl::bits_per_byte) {
+                cache_ |= static_cast<ptl::word_type>(data_[pos_]) << (cache_bits - cached_);
+            }
+        }
+    }
+
+    inline ptl::word_type bit_reader::take(const std::size_t bits) noexcept
+    {
+        if (cached_ < bits) {
+            refill();
+            if (cached_ < bits) {
+                // The cache's bits after the stream's end are zero
+                overrun_ = true;
+                cached_ = bits;
+            }
+        }
+        const ptl::word_type value = cache_ >> (ptl::word_bits - bits);
+        cache_ <<= bits;
+        cached_ -= bits;
+        return value;
+    }
+
+    template <std::size_t N>
+    ptl::word_type bit_reader::read() noexcept
+    {
+        static_assert(N > 0 && N <= ptl::word_bits,
+                      "The number of bits read must be between 1 and 64");
+        if (N > cache_bits) {
+            const ptl::word_type high = take(N - 32);
+            return (high << 32) | take(32);
+        }
+        return take(N);
+    }
+
+    inline ptl::word_type bit_reader::read(const std::size_t bits) noexcept
+    {
+        if (bits == 0) {
+            return 0;
+        }
+        if (bits > cache_bits) {
+            const ptl::word_type high = take(bits - 32);
+            return (high << 32) | take(32);
+        }
+        return take(bits);
+    }
+
+    inline std::uint32_t bit_reader::read_ue() noexcept
+    {
+        return static_cast<std::uint32_t>(read_code(31));
+    }
+
+    inline std::uint64_t bit_reader::read_code(const std::size_t max_zeros) noexcept
+    {
+        if (cached_ <= max_zeros) {
+            refill();
+        }
+        // Only the stream's bits or zeros follow the cached bits, so
+        // leading zeros past them are past the stream's end
+        const std::size_t zeros = cache_ == 0 ? ptl::word_bits : ptl::leading_zeros(cache_);
+        if (zeros > max_zeros) {
+            overrun_ = true;
+            skip(max_zeros + 1);
+            return 0;
+        }
+
+        const std::size_t bits = 2 * zeros + 1;
+        if (bits <= cached_) {
+            return take(bits) - 1;
+        }
+        take(zeros);
+        return take(zeros + 1) - 1;
+    }
+
+    inline std::int32_t bit_reader::read_se() noexcept
+    {
+        // INT32_MIN's code number is 2^32, which has 32 leading zero bits
+        const std::uint64_t code = read_code(32);
+        // 1, 2, 3, 4 ... map to 1, -1, 2, -2 ...
+        return (code & 1) ? static_cast<std::int32_t>(code / 2 + 1) :
+            static_cast<std::int32_t>(-static_cast<std::int64_t>(code / 2));
+    }
+
+    inline void bit_reader::skip(std::size_t bits) noexcept
+    {
+        if (bits <= cached_) {
+            cache_ <<= bits;
+            cached_ -= bits;
+            return;
+        }
+
+        // Whole bytes past the cache aren't loaded
+        bits -= cached_;
+        cache_ = 0;
+        cached_ = 0;
+        const std::size_t bytes = bits / ptl::bits_per_byte;
+        if (bytes > size_ - pos_) {
+            overrun_ = true;
+            pos_ = size_;
+            return;
+        }
+        pos_ += bytes;
+        if (bits % ptl::bits_per_byte != 0) {
+            take(bits % ptl::bits_per_byte);
+        }
+    }
+
+    template <class Protocol>
+    typename Protocol::value_tuple bit_reader::read_protocol() noexcept
+    {
+        static constexpr std::size_t bytes = Protocol::traits::bytes;
+
+        if (byte_aligned()) {
+            const std::size_t offset = position() / ptl::bits_per_byte;
+            if (offset + bytes <= size_) {
+                skip(Protocol::traits::bits);
+                return Protocol::unpack(data_ + offset);
+            }
+        }
+        return read_fields<Protocol>(std::make_index_sequence<Protocol::traits::fields>());
+    }
+
+    template <class Protocol, std::size_t... I>
+    typename Protocol::value_tuple bit_reader::read_fields(std::index_sequence<I...>) noexcept
+    {
+        using tuple_type = typename Protocol::tuple_type;
+        // Braced initialization reads the fields in order
+        return typename Protocol::value_tuple{
+            static_cast<ptl::field_type<I, tuple_type>>(
+                ptl::order_bytes<ptl::field_order<I, tuple_type>::value, ptl::field_bits<I, tuple_type>::value>(
+                    read<ptl::field_bits<I, tuple_type>::value>()))...
+        };
+    }
+}
+
+#endif
@@ -0,0 +1,229 @@
+#ifndef PTL_BIT_WRITER_HPP
+#define PTL_BIT_WRITER_HPP
+
+#include <cstdint>
+#include <type_traits>
+#include "ptl.hpp"
+#include "ptl/bit_reader.hpp"
+
+namespace ptl
+{
+    /** Writes a bit stream's fields in sequence
+	 *
+	 *  The inverse of ptl::bit_reader, for streams whose layout is
+	 *  decided at run time, such as PES headers with optional fields
+	 *  and Exp-Golomb coded parameter sets.  Bits are accumulated in a
+	 *  word that's stored to the stream once it's full, so writing a
+	 *  field takes at most one store.
+	 *
+	 *  The accumulated bits of a partial word are only stored by
+	 *  flush().  Writing past the end of the stream writes the bits
+	 *  that fit and sets overrun().
+	 */
+    class bit_writer
+    {
+        public:
+
+            /// Creates a writer of at most size bytes to data
+            bit_writer(unsigned char * const data, const std::size_t size) noexcept;
+
+            /// Writes the N least significant bits of value, N <= 64
+            template <std::size_t N>
+            void write(const ptl::word_type value) noexcept;
+
+            /// Writes the bits least significant bits of value, bits <= 64
+            void write(const ptl::word_type value, const std::size_t bits) noexcept;
+
+            /// Writes a single bit
+            void write_flag(const bool value) noexcept {
+                write<1>(value);
+            }
+
+            /// Writes an unsigned Exp-Golomb code, ue(v)
+            void write_ue(const std::uint32_t value) noexcept;
+
+            /// Writes a signed Exp-Golomb code, se(v)
+            void write_se(const std::int32_t value) noexcept;
+
+            /// Writes a protocol's fields at the current position
+            /**
+             *  The fields are packed as Protocol::pack packs them, and
+             *  the packed bits are written a word at a time.
+             *
+             *  @tparam Protocol The ptl::protocol to write
+             */
+            template <class Protocol>
+            void write_protocol(typename Protocol::value_tuple const & values) noexcept;
+
+            /// Writes a protocol's fields from values in field order
+            template <class Protocol, class... Values,
+                      class = typename std::enable_if<(sizeof...(Values) > 1)>::type>
+            void write_protocol(Values const &... values) noexcept {
+                write_protocol<Protocol>(typename Protocol::value_tuple(values...));
+            }
+
+            /// Writes zero bits up to the next byte boundary
+            void align() noexcept {
+                write(0, (ptl::bits_per_byte - position() % ptl::bits_per_byte) % ptl::bits_per_byte);
+            }
+
+            /// Stores the accumulated bits, zero padded to a whole byte
+            /**
+             *  Writing can continue after a flush.
+             *
+             *  @return The number of bytes written to the stream.
+             */
+            std::size_t flush() noexcept;
+
+            /// Returns the number of bits written
+            std::size_t position() const noexcept {
+                return pos_ * ptl::bits_per_byte + accumulated_;
+            }
+
+            /// Returns true if a write went past the end of the stream
+            bool overrun() const noexcept {
+                return overrun_;
+            }
+
+        private:
+
+            // Stores the full accumulator
+            void store() noexcept;
+
+            // Writes value's bits least significant bits, the rest of
+            // value's bits are zero
+            void put(const ptl::word_type value, const std::size_t bits) noexcept;
+
+            // Writes the Exp-Golomb code of a code number below 2^63
+            void write_code(const std::uint64_t number) noexcept;
+
+            unsigned char * data_;
+            std::size_t size_;
+            // Offset of the accumulator's first byte
+            std::size_t pos_;
+            // The written bits that haven't been stored, starting from
+            // the most significant bit.  The bits after them are zero
+            ptl::word_type accumulator_;
+            std::size_t accumulated_;
+            bool overrun_;
+    };
+
+    inline bit_writer::bit_writer(unsigned char * const data, const std::size_t size) noexcept :
+        data_(data),
+        size_(size),
+        pos_(0),
+        accumulator_(0),
+        accumulated_(0),
+        overrun_(false)
+    {}
+
+    inline void bit_writer::store() noexcept
+    {
+        if (pos_ + sizeof(ptl::word_type) <= size_) {
+            ptl::store_word<sizeof(ptl::word_type)>(data_ + pos_, accumulator_);
+        } else {
+            overrun_ = true;
+            for (std::size_t i = pos_; i < size_; ++i) {
+                data_[i] = static_cast<unsigned char>(accumulator_ >> (ptl::word_bits - ptl::bits_per_byte * (i - pos_ + 1)));
+            }
+        }
+        pos_ += sizeof(ptl::word_type);
+    }
+
+    inline void bit_writer::put(const ptl::word_type value, const std::size_t bits) noexcept
+    {
+        const std::size_t free = ptl::word_bits - accumulated_;
+        if (bits < free) {
+            accumulator_ |= value << (free - bits);
+            accumulated_ += bits;
+            return;
+        }
+
+        // The accumulator is filled with value's first bits and
+        // starts over with its remaining bits
+        const std::size_t rest = bits - free;
+        accumulator_ |= value >> rest;
+        store();
+        accumulator_ = rest == 0 ? 0 : value << (ptl::word_bits - rest);
+        accumulated_ = rest;
+    }
+
+    template <std::size_t N>
+    void bit_writer::write(const ptl::word_type value) noexcept
+    {
+        static_assert(N > 0 && N <= ptl::word_bits,
+                      "The number of bits written must be between 1 and 64");
+        put(value & ptl::lsb_mask<ptl::word_type>(N, 0), N);
+    }
+
+    inline void bit_writer::write(const ptl::word_type value, const std::size_t bits) noexcept
+    {
+        if (bits == 0) {
+            return;
+        }
+        put(bits == ptl::word_bits ? value : value & ((static_cast<ptl::word_type>(1) << bits) - 1), bits);
+    }
+
+    inline void bit_writer::write_ue(const std::uint32_t value) noexcept
+    {
+        write_code(value);
+    }
+
+    inline void bit_writer::write_code(const std::uint64_t number) noexcept
+    {
+        // The code is number + 1 preceded by one less zero bit than
+        // the bits it takes
+        const ptl::word_type code = number + 1;
+        const std::size_t bits = 2 * (ptl::word_bits - ptl::leading_zeros(code)) - 1;
+        if (bits <= ptl::word_bits) {
+            put(code, bits);
+        } else {
+            put(0, bits / 2);
+            put(code, bits / 2 + 1);
+        }
+    }
+
+    inline void bit_writer::write_se(const std::int32_t value) noexcept
+    {
+        // 1, -1, 2, -2 ... map to 1, 2, 3, 4 ..., and INT32_MIN to 2^32
+        const std::uint64_t magnitude = value < 0 ?
+            static_cast<std::uint64_t>(-static_cast<std::int64_t>(value)) : static_cast<std::uint64_t>(value);
+        write_code(value > 0 ? 2 * magnitude - 1 : 2 * magnitude);
+    }
+
+    template <class Protocol>
+    void bit_writer::write_protocol(typename Protocol::value_tuple const & values) noexcept
+    {
+        static constexpr std::size_t bits = Protocol::traits::bits;
+        static constexpr std::size_t words = bits / ptl::word_bits;
+        static constexpr std::size_t last_bits = bits % ptl::word_bits;
+        // Keeps the last load's size valid when there are no last bits
+        static constexpr std::size_t load_bits = last_bits == 0 ? 1 : last_bits;
+
+        typename Protocol::traits::array_type buf{};
+        Protocol::pack(buf.data(), values);
+        for (std::size_t i = 0; i < words; ++i) {
+            put(ptl::load_word<sizeof(ptl::word_type)>(buf.data() + i * sizeof(ptl::word_type)), ptl::word_bits);
+        }
+        if (last_bits != 0) {
+            const ptl::word_type last = ptl::load_word<ptl::required_bytes(load_bits)>(
+                buf.data() + words * sizeof(ptl::word_type));
+            put(last >> (ptl::word_bits - load_bits), last_bits);
+        }
+    }
+
+    inline std::size_t bit_writer::flush() noexcept
+    {
+        const std::size_t bytes = ptl::required_bytes(accumulated_);
+        for (std::size_t i = 0; i < bytes; ++i) {
+            if (pos_ + i >= size_) {
+                overrun_ = true;
+                break;
+            }
+            data_[pos_ + i] = static_cast<unsigned char>(accumulator_ >> (ptl::word_bits - ptl::bits_per_byte * (i + 1)));
+        }
+        return pos_ + bytes < size_ ? pos_ + bytes : size_;
+    }
+}
+
+#endif
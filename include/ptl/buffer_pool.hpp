@@ -0,0 +1,530 @@
+#ifndef PTL_BUFFER_POOL_HPP
+#define PTL_BUFFER_POOL_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <system_error>
+#include <vector>
+#include <sys/mman.h>
+#include "ptl.hpp"
+
+namespace ptl
+{
+    /// Number of bytes in a cache line
+    static constexpr std::size_t cache_line_bytes = 64;
+
+    namespace detail
+    {
+        /** The slots and lock free free list of a ptl::buffer_pool
+	 *
+	 *  The free list is a stack of slot indices linked through next_,
+	 *  whose head holds the top slot's index plus one and a tag that
+	 *  changes on every push and pop, so a head compared after a slot
+	 *  was popped and pushed again doesn't match.
+	 */
+        class buffer_pool_core : public std::enable_shared_from_this<buffer_pool_core>
+        {
+            public:
+
+                buffer_pool_core(const std::size_t slots, const std::size_t slot_bytes, const bool hugepages);
+
+                buffer_pool_core(buffer_pool_core const &) = delete;
+                buffer_pool_core & operator=(buffer_pool_core const &) = delete;
+
+                ~buffer_pool_core();
+
+                unsigned char * slot(const std::uint32_t index) const noexcept {
+                    return slots_ + index * slot_bytes_;
+                }
+
+                std::size_t slots() const noexcept {
+                    return slot_count_;
+                }
+
+                bool hugepages() const noexcept {
+                    return hugepages_;
+                }
+
+                // True until the pool is destroyed
+                bool open() const noexcept {
+                    return open_.load(std::memory_order_acquire);
+                }
+
+                void close() noexcept {
+                    open_.store(false, std::memory_order_release);
+                }
+
+                // Pops up to count free slots into out with one exchange,
+                // returns the number popped
+                std::size_t pop(std::uint32_t * const out, const std::size_t count) noexcept;
+
+                // Pushes count free slots with one exchange
+                void push(std::uint32_t const * const in, const std::size_t count) noexcept;
+
+                // Reserves room for up to count slots in the threads'
+                // caches, returns the room reserved
+                std::size_t reserve_cached(const std::size_t count) noexcept {
+                    std::size_t cached = cached_.load(std::memory_order_relaxed);
+                    for (;;) {
+                        const std::size_t room = cached < cache_budget_ ? cache_budget_ - cached : 0;
+                        const std::size_t reserved = count < room ? count : room;
+                        if (reserved == 0 ||
+                            cached_.compare_exchange_weak(cached, cached + reserved, std::memory_order_relaxed)) {
+                            return reserved;
+                        }
+                    }
+                }
+
+                // Gives back room reserved by reserve_cached
+                void unreserve_cached(const std::size_t count) noexcept {
+                    cached_.fetch_sub(count, std::memory_order_relaxed);
+                }
+
+            private:
+
+                static constexpr std::uint64_t index_mask = 0xffffffff;
+                static constexpr std::uint64_t tag_increment = index_mask + 1;
+
+                void * map_;
+                std::size_t map_bytes_;
+                unsigned char * slots_;
+                const std::size_t slot_bytes_;
+                const std::size_t slot_count_;
+                bool hugepages_;
+                std::atomic<bool> open_;
+                // Each slot's next free slot's index plus one, or zero
+                std::unique_ptr<std::atomic<std::uint32_t>[]> next_;
+
+                char padding_[ptl::cache_line_bytes];
+                std::atomic<std::uint64_t> head_;
+                char end_padding_[ptl::cache_line_bytes];
+                // Most slots the threads' caches hold between them
+                const std::size_t cache_budget_;
+                std::atomic<std::size_t> cached_;
+                char budget_padding_[ptl::cache_line_bytes];
+        };
+
+        inline buffer_pool_core::buffer_pool_core(const std::size_t slots,
+                                                  const std::size_t slot_bytes,
+                                                  const bool hugepages) :
+            map_(nullptr),
+            map_bytes_(slots * slot_bytes),
+            slots_(nullptr),
+            slot_bytes_(slot_bytes),
+            slot_count_(slots),
+            hugepages_(false),
+            open_(true),
+            next_(new std::atomic<std::uint32_t>[slots]),
+            head_(slots == 0 ? 0 : 1),
+            cache_budget_(slots / 4),
+            cached_(0)
+        {
+#if defined(MAP_HUGETLB)
+            if (hugepages) {
+                // Huge pages are 2MB on most systems, and the mapping's
+                // size must be a multiple of them
+                static constexpr std::size_t huge_page_bytes = 2 * 1024 * 1024;
+                const std::size_t bytes = (map_bytes_ + huge_page_bytes - 1) / huge_page_bytes * huge_page_bytes;
+                void * const map = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                                          MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+                if (map != MAP_FAILED) {
+                    map_ = map;
+                    map_bytes_ = bytes;
+                    hugepages_ = true;
+                }
+            }
+#endif
+            if (map_ == nullptr) {
+                void * const map = ::mmap(nullptr, map_bytes_, PROT_READ | PROT_WRITE,
+                                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+                if (map == MAP_FAILED) {
+                    throw std::system_error(errno, std::generic_category(), "unable to map buffer pool");
+                }
+                map_ = map;
+#if defined(MADV_HUGEPAGE)
+                // Advice is a hint, so failures are ignored
+                if (hugepages) {
+                    ::madvise(map_, map_bytes_, MADV_HUGEPAGE);
+                }
+#endif
+            }
+            slots_ = static_cast<unsigned char *>(map_);
+
+            for (std::size_t i = 0; i < slots; ++i) {
+                next_[i].store(i + 1 < slots ? static_cast<std::uint32_t>(i + 2) : 0, std::memory_order_relaxed);
+            }
+        }
+
+        inline buffer_pool_core::~buffer_pool_core()
+        {
+            ::munmap(map_, map_bytes_);
+        }
+
+        inline std::size_t buffer_pool_core::pop(std::uint32_t * const out, const std::size_t count) noexcept
+        {
+            std::uint64_t head = head_.load(std::memory_order_acquire);
+            for (;;) {
+                // The slots below the head can't change without changing
+                // the head's tag, so the exchange validates the walk
+                std::size_t popped = 0;
+                std::uint32_t top = static_cast<std::uint32_t>(head & index_mask);
+                while (top != 0 && popped < count) {
+                    out[popped++] = top - 1;
+                    top = next_[top - 1].load(std::memory_order_relaxed);
+                }
+                if (popped == 0) {
+                    return 0;
+                }
+                const std::uint64_t next = ((head & ~index_mask) + tag_increment) | top;
+                if (head_.compare_exchange_weak(head, next, std::memory_order_acquire, std::memory_order_acquire)) {
+                    return popped;
+                }
+            }
+        }
+
+        inline void buffer_pool_core::push(std::uint32_t const * const in, const std::size_t count) noexcept
+        {
+            if (count == 0) {
+                return;
+            }
+            for (std::size_t i = 0; i + 1 < count; ++i) {
+                next_[in[i]].store(in[i + 1] + 1, std::memory_order_relaxed);
+            }
+            std::uint64_t head = head_.load(std::memory_order_relaxed);
+            std::uint64_t next;
+            do {
+                next_[in[count - 1]].store(static_cast<std::uint32_t>(head & index_mask), std::memory_order_relaxed);
+                next = ((head & ~index_mask) + tag_increment) | (in[0] + 1);
+            } while (!head_.compare_exchange_weak(head, next, std::memory_order_release, std::memory_order_relaxed));
+        }
+
+        /// A thread's cache of a pool's free slots
+        struct buffer_cache
+        {
+                /// Most slots any cache holds
+                static constexpr std::size_t capacity = 64;
+
+                // A cache holds at most an eighth of a pool's slots, in
+                // room reserved a batch at a time from the pool's budget
+                explicit buffer_cache(std::shared_ptr<ptl::detail::buffer_pool_core> pool) noexcept :
+                    core(std::move(pool)),
+                    limit(core->slots() / 8 < capacity ? std::max<std::size_t>(core->slots() / 8, 1) : capacity),
+                    batch(std::max<std::size_t>(limit / 2, 1)),
+                    count(0),
+                    reserved(0),
+                    allocates(false)
+                {}
+
+                buffer_cache(buffer_cache const &) = delete;
+                buffer_cache & operator=(buffer_cache const &) = delete;
+
+                ~buffer_cache() {
+                    core->push(slots, count);
+                    core->unreserve_cached(reserved);
+                }
+
+                std::shared_ptr<ptl::detail::buffer_pool_core> core;
+                /// Most slots the cache holds
+                const std::size_t limit;
+                /// Slots moved between the cache and the free list at once
+                const std::size_t batch;
+                std::size_t count;
+                /// Room reserved from the pool's budget, at least count
+                std::size_t reserved;
+                /// True once the thread has allocated from the pool
+                bool allocates;
+                std::uint32_t slots[capacity];
+        };
+
+        /// A thread's caches of every pool it has used
+        class buffer_caches
+        {
+            public:
+
+                // Returns the cache of core's slots, creating it if needed
+                buffer_cache & get(ptl::detail::buffer_pool_core & core) {
+                    if (last_ != nullptr && last_->core.get() == &core) {
+                        return *last_;
+                    }
+                    for (auto & cache : caches_) {
+                        if (cache->core.get() == &core) {
+                            last_ = cache.get();
+                            return *last_;
+                        }
+                    }
+
+                    // Caches of destroyed pools are released, so their
+                    // slots can be unmapped
+                    std::vector<std::unique_ptr<buffer_cache>> open;
+                    for (auto & cache : caches_) {
+                        if (cache->core->open()) {
+                            open.push_back(std::move(cache));
+                        }
+                    }
+                    open.emplace_back(new buffer_cache(core.shared_from_this()));
+                    caches_.swap(open);
+                    last_ = caches_.back().get();
+                    return *last_;
+                }
+
+            private:
+
+                std::vector<std::unique_ptr<buffer_cache>> caches_;
+                buffer_cache * last_ = nullptr;
+        };
+
+        // Returns the calling thread's cache of core's slots
+        inline buffer_cache & thread_buffer_cache(ptl::detail::buffer_pool_core & core)
+        {
+            static thread_local buffer_caches caches;
+            return caches.get(core);
+        }
+
+        // Returns a slot to the calling thread's cache
+        inline void release_slot(ptl::detail::buffer_pool_core & core, const std::uint32_t index) noexcept
+        {
+            buffer_cache * cache;
+            try {
+                cache = &ptl::detail::thread_buffer_cache(core);
+            } catch (...) {
+                core.push(&index, 1);
+                return;
+            }
+            // A thread that only releases, such as the consumer of a
+            // queue of buffers, would never reuse its cached slots
+            if (!cache->allocates) {
+                core.push(&index, 1);
+                return;
+            }
+            if (cache->count == cache->reserved) {
+                if (cache->reserved < cache->limit) {
+                    const std::size_t room = cache->limit - cache->reserved;
+                    cache->reserved += core.reserve_cached(room < cache->batch ? room : cache->batch);
+                }
+                if (cache->count == cache->reserved) {
+                    // Full, or the other caches hold the budget
+                    const std::size_t flushed = cache->count < cache->batch ? cache->count : cache->batch;
+                    if (flushed == 0) {
+                        core.push(&index, 1);
+                        return;
+                    }
+                    cache->count -= flushed;
+                    core.push(cache->slots + cache->count, flushed);
+                }
+            }
+            cache->slots[cache->count++] = index;
+        }
+    }
+
+    /** A pool of fixed size, cache line aligned packet buffers
+	 *
+	 *  Each slot holds a Protocol header followed by Payload_Bytes,
+	 *  rounded up to whole cache lines so packets built by different
+	 *  threads never share a line.  Slots are mapped once when the
+	 *  pool is created, optionally with huge pages.
+	 *
+	 *  Each thread allocates from and releases to its own cache of
+	 *  free slots, which exchanges slots in batches with the pool's
+	 *  lock free free list.  A cache holds at most an eighth of the
+	 *  slots, up to 64, and the caches hold at most a quarter of the
+	 *  slots between them, so allocate() only fails when at least
+	 *  three quarters of the buffers are allocated.  A buffer can be
+	 *  released on any thread, and is returned straight to the free
+	 *  list by a thread that hasn't allocated from the pool.  The
+	 *  pool must outlive its buffers.  A thread's cache of a
+	 *  destroyed pool holds its mapping until the thread exits or
+	 *  next creates a cache.
+	 *
+	 *  @tparam Protocol The ptl::protocol of the packets' header
+	 *  @tparam Payload_Bytes Number of bytes after the header
+	 */
+    template <class Protocol, std::size_t Payload_Bytes = 0>
+    class buffer_pool
+    {
+        public:
+
+            /// Number of bytes of a buffer's header
+            static constexpr std::size_t header_bytes = Protocol::traits::bytes;
+
+            /// Number of bytes of a buffer
+            static constexpr std::size_t buffer_bytes = header_bytes + Payload_Bytes;
+
+            /// Number of bytes between slots
+            static constexpr std::size_t slot_bytes =
+                (buffer_bytes + ptl::cache_line_bytes - 1) / ptl::cache_line_bytes * ptl::cache_line_bytes;
+
+            /// An allocated buffer, released to the pool when destroyed
+            class buffer
+            {
+                public:
+
+                    /// Creates an empty buffer
+                    buffer() noexcept : core_(nullptr), index_(0) {}
+
+                    buffer(buffer && other) noexcept :
+                        core_(other.core_),
+                        index_(other.index_)
+                    {
+                        other.core_ = nullptr;
+                    }
+
+                    buffer & operator=(buffer && other) noexcept {
+                        if (this != &other) {
+                            reset();
+                            core_ = other.core_;
+                            index_ = other.index_;
+                            other.core_ = nullptr;
+                        }
+                        return *this;
+                    }
+
+                    ~buffer() {
+                        reset();
+                    }
+
+                    /// Releases the buffer to the pool
+                    void reset() noexcept {
+                        if (core_ != nullptr) {
+                            ptl::detail::release_slot(*core_, index_);
+                            core_ = nullptr;
+                        }
+                    }
+
+                    /// Gives up the buffer without releasing it to the pool
+                    /**
+                     *  The returned slot can be queued to another thread,
+                     *  which takes the buffer back with buffer_pool::adopt.
+                     */
+                    std::uint32_t release() noexcept {
+                        core_ = nullptr;
+                        return index_;
+                    }
+
+                    /// Returns true if the buffer isn't empty
+                    explicit operator bool() const noexcept {
+                        return core_ != nullptr;
+                    }
+
+                    /// Returns the buffer's buffer_bytes bytes
+                    unsigned char * data() const noexcept {
+                        return core_->slot(index_);
+                    }
+
+                    /// Returns the buffer's header, which can be passed to Protocol's accessors
+                    unsigned char * header() const noexcept {
+                        return data();
+                    }
+
+                    /// Returns the buffer's Payload_Bytes bytes after the header
+                    unsigned char * payload() const noexcept {
+                        return data() + header_bytes;
+                    }
+
+                    /// Returns the buffer's slot in the pool
+                    std::uint32_t index() const noexcept {
+                        return index_;
+                    }
+
+                private:
+
+                    friend class buffer_pool;
+
+                    buffer(ptl::detail::buffer_pool_core * const core, const std::uint32_t index) noexcept :
+                        core_(core),
+                        index_(index)
+                    {}
+
+                    ptl::detail::buffer_pool_core * core_;
+                    std::uint32_t index_;
+            };
+
+            /// Creates a pool of slots buffers
+            /**
+             *  @param slots The number of buffers.
+             *  @param hugepages Maps the buffers with huge pages if
+             *  they're available, and advises the kernel to back them
+             *  with transparent huge pages otherwise.
+             *  @throws std::invalid_argument if slots is 0 or 2^32 or more.
+             *  @throws std::system_error if the buffers can't be mapped.
+             */
+            explicit buffer_pool(const std::size_t slots, const bool hugepages = false);
+
+            buffer_pool(buffer_pool const &) = delete;
+            buffer_pool & operator=(buffer_pool const &) = delete;
+
+            ~buffer_pool() {
+                core_->close();
+            }
+
+            /// Allocates a buffer from the calling thread's cache
+            /**
+             *  The buffer's bytes aren't cleared.
+             *
+             *  @return An empty buffer if every buffer is allocated
+             *  or held by other threads' caches.
+             */
+            buffer allocate();
+
+            /// Takes back a buffer given up by buffer::release
+            buffer adopt(const std::uint32_t index) noexcept {
+                return buffer(core_.get(), index);
+            }
+
+            /// Returns the number of buffers
+            std::size_t slots() const noexcept {
+                return core_->slots();
+            }
+
+            /// Returns true if the buffers are mapped with huge pages
+            bool hugepages() const noexcept {
+                return core_->hugepages();
+            }
+
+        private:
+
+            std::shared_ptr<ptl::detail::buffer_pool_core> core_;
+    };
+
+    template <class Protocol, std::size_t Payload_Bytes>
+    constexpr std::size_t buffer_pool<Protocol, Payload_Bytes>::header_bytes;
+
+    template <class Protocol, std::size_t Payload_Bytes>
+    constexpr std::size_t buffer_pool<Protocol, Payload_Bytes>::buffer_bytes;
+
+    template <class Protocol, std::size_t Payload_Bytes>
+    constexpr std::size_t buffer_pool<Protocol, Payload_Bytes>::slot_bytes;
+
+    template <class Protocol, std::size_t Payload_Bytes>
+    buffer_pool<Protocol, Payload_Bytes>::buffer_pool(const std::size_t slots, const bool hugepages)
+    {
+        if (slots == 0 || slots >= (static_cast<std::uint64_t>(1) << 32)) {
+            throw std::invalid_argument("A buffer pool must have between 1 and 2^32 - 1 buffers");
+        }
+        core_ = std::make_shared<ptl::detail::buffer_pool_core>(slots, slot_bytes, hugepages);
+    }
+
+    template <class Protocol, std::size_t Payload_Bytes>
+    typename buffer_pool<Protocol, Payload_Bytes>::buffer buffer_pool<Protocol, Payload_Bytes>::allocate()
+    {
+        ptl::detail::buffer_cache & cache = ptl::detail::thread_buffer_cache(*core_);
+        cache.allocates = true;
+        if (cache.count == 0) {
+            // One slot is allocated, the rest are kept in reserved room
+            if (cache.reserved + 1 < cache.batch) {
+                cache.reserved += core_->reserve_cached(cache.batch - cache.reserved - 1);
+            }
+            const std::size_t wanted = cache.reserved + 1 < cache.batch ? cache.reserved + 1 : cache.batch;
+            cache.count = core_->pop(cache.slots, wanted);
+            if (cache.count == 0) {
+                return buffer();
+            }
+        }
+        return buffer(core_.get(), cache.slots[--cache.count]);
+    }
+}
+
+#endif
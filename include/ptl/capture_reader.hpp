@@ -0,0 +1,548 @@
+#ifndef PTL_CAPTURE_READER_HPP
+#define PTL_CAPTURE_READER_HPP
+
+#include <cerrno>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <tuple>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "ptl.hpp"
+
+namespace ptl
+{
+    /// A packet record in a capture file
+    struct capture_record
+    {
+            /// Capture time in nanoseconds since the epoch
+            std::uint64_t timestamp;
+            /// Link layer type of the interface the packet was captured on
+            std::uint32_t link_type;
+            /// Number of bytes in the packet on the wire
+            std::uint32_t original_length;
+            /// The captured bytes
+            unsigned char const * data;
+            /// Number of captured bytes
+            std::size_t size;
+    };
+
+    namespace detail
+    {
+        template <ptl::byte_order Order>
+        using capture_u16 = ptl::field<16, std::uint16_t, Order>;
+
+        template <ptl::byte_order Order>
+        using capture_u32 = ptl::field<32, std::uint32_t, Order>;
+
+        /// pcap file header
+        template <ptl::byte_order Order>
+        using pcap_file_header = ptl::protocol<std::tuple<ptl::detail::capture_u32<Order>,   // Magic number
+                                                          ptl::detail::capture_u16<Order>,   // Major version
+                                                          ptl::detail::capture_u16<Order>,   // Minor version
+                                                          ptl::detail::capture_u32<Order>,   // Time zone
+                                                          ptl::detail::capture_u32<Order>,   // Timestamp accuracy
+                                                          ptl::detail::capture_u32<Order>,   // Snapshot length
+                                                          ptl::detail::capture_u32<Order>>>; // Link type
+
+        /// pcap record header
+        template <ptl::byte_order Order>
+        using pcap_record_header = ptl::protocol<std::tuple<ptl::detail::capture_u32<Order>,   // Seconds
+                                                            ptl::detail::capture_u32<Order>,   // Micro or nanoseconds
+                                                            ptl::detail::capture_u32<Order>,   // Captured length
+                                                            ptl::detail::capture_u32<Order>>>; // Original length
+
+        /// pcapng block header
+        template <ptl::byte_order Order>
+        using pcapng_block_header = ptl::protocol<std::tuple<ptl::detail::capture_u32<Order>,   // Block type
+                                                             ptl::detail::capture_u32<Order>>>; // Block length
+
+        /// pcapng interface description block body
+        template <ptl::byte_order Order>
+        using pcapng_interface = ptl::protocol<std::tuple<ptl::detail::capture_u16<Order>,   // Link type
+                                                          ptl::detail::capture_u16<Order>,   // Reserved
+                                                          ptl::detail::capture_u32<Order>>>; // Snapshot length
+
+        /// pcapng option header
+        template <ptl::byte_order Order>
+        using pcapng_option = ptl::protocol<std::tuple<ptl::detail::capture_u16<Order>,   // Option code
+                                                       ptl::detail::capture_u16<Order>>>; // Option length
+
+        /// pcapng enhanced packet block body
+        template <ptl::byte_order Order>
+        using pcapng_enhanced_packet = ptl::protocol<std::tuple<ptl::detail::capture_u32<Order>,   // Interface
+                                                                ptl::detail::capture_u32<Order>,   // Timestamp high
+                                                                ptl::detail::capture_u32<Order>,   // Timestamp low
+                                                                ptl::detail::capture_u32<Order>,   // Captured length
+                                                                ptl::detail::capture_u32<Order>>>; // Original length
+
+        /// pcapng simple packet block body
+        template <ptl::byte_order Order>
+        using pcapng_simple_packet = ptl::protocol<std::tuple<ptl::detail::capture_u32<Order>>>; // Original length
+
+        /// A pcapng interface's properties
+        struct pcapng_interface_info
+        {
+                std::uint32_t link_type;
+                std::uint32_t snap_length;
+                /// Timestamp units per second is 10^resolution, or 2^resolution if binary
+                std::uint8_t resolution;
+                bool binary;
+        };
+
+        /// Converts a timestamp in units of an interface's resolution to nanoseconds
+        inline std::uint64_t pcapng_nanoseconds(const std::uint64_t ts,
+                                                ptl::detail::pcapng_interface_info const & info) noexcept
+        {
+            if (info.binary) {
+                if (info.resolution >= 64) {
+                    return 0;
+                }
+                const std::uint64_t seconds = ts >> info.resolution;
+                const std::uint64_t fraction = ts - (seconds << info.resolution);
+                return seconds * 1000000000u +
+                    static_cast<std::uint64_t>((static_cast<long double>(fraction) * 1e9L) /
+                                               static_cast<long double>(static_cast<std::uint64_t>(1) << info.resolution));
+            }
+            std::uint64_t value = ts;
+            for (unsigned int r = info.resolution; r < 9; ++r) {
+                value *= 10;
+            }
+            for (unsigned int r = 9; r < info.resolution; ++r) {
+                value /= 10;
+            }
+            return value;
+        }
+    }
+
+    /** Reads the packet records of a pcap or pcapng capture file
+	 *
+	 *  The file is memory mapped and its records are read in place,
+	 *  so a record's bytes are valid for the reader's lifetime.
+	 *  The mapping is advised to be read sequentially, and the
+	 *  pages ahead of the current record are requested from the
+	 *  page cache while earlier records are being visited.
+	 *
+	 *  Records of pcap files in either byte order, and enhanced and
+	 *  simple packet blocks of pcapng files, are supported.  Reading
+	 *  stops at a record that's truncated.
+	 */
+    class capture_reader
+    {
+        public:
+
+            /// Capture file formats
+            enum class format
+            {
+                pcap,
+                pcapng
+            };
+
+            /// Number of bytes ahead of the current record that are prefetched
+            static constexpr std::size_t prefetch_distance = 1024;
+
+            /// Number of bytes of the mapping requested ahead of the current record
+            static constexpr std::size_t readahead_bytes = 16 * 1024 * 1024;
+
+            /// Maps a capture file
+            /**
+             *  @param path The capture file's path.
+             *  @throws std::system_error if the file can't be mapped.
+             *  @throws std::runtime_error if the file isn't a capture file.
+             */
+            explicit capture_reader(std::string const & path);
+
+            /// Reads a capture file that's already in memory
+            /**
+             *  @param data The capture file's bytes.
+             *  @param size The number of bytes.
+             *  @throws std::runtime_error if the bytes aren't a capture file.
+             */
+            capture_reader(unsigned char const * const data, const std::size_t size);
+
+            capture_reader(capture_reader const &) = delete;
+            capture_reader & operator=(capture_reader const &) = delete;
+
+            ~capture_reader();
+
+            /// Returns the capture file's format
+            format file_format() const noexcept {
+                return format_;
+            }
+
+            /// Returns the capture file's bytes
+            unsigned char const * data() const noexcept {
+                return data_;
+            }
+
+            /// Returns the number of bytes in the capture file
+            std::size_t size() const noexcept {
+                return size_;
+            }
+
+            /// Returns true if the last for_each stopped at a truncated record
+            bool truncated() const noexcept {
+                return truncated_;
+            }
+
+            /// Calls visit with a capture_record for each record
+            /**
+             *  @param visit Called with each record in file order.
+             *  @return The number of records visited.
+             */
+            template <class Visitor>
+            std::size_t for_each(Visitor && visit);
+
+            /// Calls visit with each record's Protocol buffer at offset
+            /**
+             *  Records with fewer than offset + Protocol::traits::bytes
+             *  captured bytes are skipped.  visit is called with the
+             *  capture_record and a pointer to the record's bytes at
+             *  offset, which can be passed to Protocol's accessors.
+             *
+             *  @tparam Protocol The ptl::protocol at offset
+             *  @param offset Byte offset of the protocol in each record.
+             *  @param visit Called with each record in file order.
+             *  @return The number of records visited.
+             */
+            template <class Protocol, class Visitor>
+            std::size_t for_each(const std::size_t offset, Visitor && visit);
+
+        private:
+
+            // Identifies the file format and byte order
+            void parse_header();
+
+            // Prefetches the bytes after pos, and requests the
+            // mapping's next pages when pos crosses into them
+            void prefetch(const std::size_t pos, std::size_t & next_readahead) const noexcept;
+
+            template <ptl::byte_order Order, class Visitor>
+            std::size_t for_each_pcap(Visitor & visit);
+
+            // Returns the position of the section's end
+            template <ptl::byte_order Order, class Visitor>
+            std::size_t for_each_pcapng_section(std::size_t pos, Visitor & visit, std::size_t & records);
+
+            template <class Visitor>
+            std::size_t for_each_pcapng(Visitor & visit);
+
+            void * map_;
+            unsigned char const * data_;
+            std::size_t size_;
+            format format_;
+            ptl::byte_order order_;
+            bool nanoseconds_;
+            bool truncated_;
+    };
+
+    inline capture_reader::capture_reader(std::string const & path) :
+        map_(nullptr),
+        data_(nullptr),
+        size_(0),
+        format_(format::pcap),
+        order_(ptl::byte_order::little),
+        nanoseconds_(false),
+        truncated_(false)
+    {
+        const int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::system_error(errno, std::generic_category(), "unable to open " + path);
+        }
+
+        struct stat st;
+        if (::fstat(fd, &st) != 0) {
+            const int error = errno;
+            ::close(fd);
+            throw std::system_error(error, std::generic_category(), "unable to stat " + path);
+        }
+        size_ = static_cast<std::size_t>(st.st_size);
+        if (size_ == 0) {
+            ::close(fd);
+            throw std::runtime_error(path + " is empty");
+        }
+
+        void * const map = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        const int error = errno;
+        ::close(fd);
+        if (map == MAP_FAILED) {
+            throw std::system_error(error, std::generic_category(), "unable to map " + path);
+        }
+        map_ = map;
+        data_ = static_cast<unsigned char const *>(map);
+
+        // Advice is a hint, so failures are ignored
+        ::madvise(map_, size_, MADV_SEQUENTIAL);
+#if defined(MADV_HUGEPAGE)
+        ::madvise(map_, size_, MADV_HUGEPAGE);
+#endif
+
+        try {
+            parse_header();
+        } catch (...) {
+            ::munmap(map_, size_);
+            throw;
+        }
+    }
+
+    inline capture_reader::capture_reader(unsigned char const * const data, const std::size_t size) :
+        map_(nullptr),
+        data_(data),
+        size_(size),
+        format_(format::pcap),
+        order_(ptl::byte_order::little),
+        nanoseconds_(false),
+        truncated_(false)
+    {
+        parse_header();
+    }
+
+    inline capture_reader::~capture_reader()
+    {
+        if (map_ != nullptr) {
+            ::munmap(map_, size_);
+        }
+    }
+
+    inline void capture_reader::parse_header()
+    {
+        using little_header = ptl::detail::pcap_file_header<ptl::byte_order::little>;
+        using big_header = ptl::detail::pcap_file_header<ptl::byte_order::big>;
+        using block = ptl::detail::pcapng_block_header<ptl::byte_order::little>;
+
+        if (size_ >= block::traits::bytes && block::field_value<0>(data_) == 0x0a0d0d0a) {
+            format_ = format::pcapng;
+            return;
+        }
+
+        if (size_ < little_header::traits::bytes) {
+            throw std::runtime_error("capture file is too short");
+        }
+
+        const std::uint32_t magic = little_header::field_value<0>(data_);
+        const std::uint32_t swapped = big_header::field_value<0>(data_);
+        if (magic == 0xa1b2c3d4 || magic == 0xa1b23c4d) {
+            order_ = ptl::byte_order::little;
+            nanoseconds_ = magic == 0xa1b23c4d;
+        } else if (swapped == 0xa1b2c3d4 || swapped == 0xa1b23c4d) {
+            order_ = ptl::byte_order::big;
+            nanoseconds_ = swapped == 0xa1b23c4d;
+        } else {
+            throw std::runtime_error("unrecognized capture file format");
+        }
+        format_ = format::pcap;
+    }
+
+    inline void capture_reader::prefetch(const std::size_t pos, std::size_t & next_readahead) const noexcept
+    {
+#if defined(__GNUC__)
+        if (pos + prefetch_distance < size_) {
+            __builtin_prefetch(data_ + pos + prefetch_distance);
+        }
+#endif
+        if (map_ != nullptr && pos >= next_readahead) {
+            // next_readahead is a multiple of readahead_bytes, so the
+            // advised address is page aligned
+            next_readahead += readahead_bytes;
+            if (next_readahead < size_) {
+                const std::size_t bytes = size_ - next_readahead < readahead_bytes ?
+                    size_ - next_readahead : readahead_bytes;
+                ::madvise(const_cast<unsigned char *>(data_) + next_readahead, bytes, MADV_WILLNEED);
+            }
+        }
+    }
+
+    template <ptl::byte_order Order, class Visitor>
+    std::size_t capture_reader::for_each_pcap(Visitor & visit)
+    {
+        using file_header = ptl::detail::pcap_file_header<Order>;
+        using record_header = ptl::detail::pcap_record_header<Order>;
+
+        const std::uint32_t link_type = file_header::template field_value<6>(data_);
+        const std::uint64_t fraction_ns = nanoseconds_ ? 1 : 1000;
+
+        std::size_t records = 0;
+        std::size_t next_readahead = 0;
+        std::size_t pos = file_header::traits::bytes;
+        while (pos + record_header::traits::bytes <= size_) {
+            unsigned char const * const header = data_ + pos;
+            const std::size_t captured = record_header::template field_value<2>(header);
+            if (captured > size_ - pos - record_header::traits::bytes) {
+                truncated_ = true;
+                break;
+            }
+            prefetch(pos, next_readahead);
+
+            const ptl::capture_record record = {
+                record_header::template field_value<0>(header) * static_cast<std::uint64_t>(1000000000u) +
+                record_header::template field_value<1>(header) * fraction_ns,
+                link_type,
+                record_header::template field_value<3>(header),
+                header + record_header::traits::bytes,
+                captured
+            };
+            pos += record_header::traits::bytes + captured;
+            visit(record);
+            ++records;
+        }
+        truncated_ = truncated_ || pos != size_;
+        return records;
+    }
+
+    template <ptl::byte_order Order, class Visitor>
+    std::size_t capture_reader::for_each_pcapng_section(std::size_t pos, Visitor & visit, std::size_t & records)
+    {
+        using block_header = ptl::detail::pcapng_block_header<Order>;
+        using interface = ptl::detail::pcapng_interface<Order>;
+        using option = ptl::detail::pcapng_option<Order>;
+        using enhanced_packet = ptl::detail::pcapng_enhanced_packet<Order>;
+        using simple_packet = ptl::detail::pcapng_simple_packet<Order>;
+
+        static constexpr std::uint32_t section_header_block = 0x0a0d0d0a;
+        static constexpr std::uint32_t interface_block = 1;
+        static constexpr std::uint32_t simple_packet_block = 3;
+        static constexpr std::uint32_t enhanced_packet_block = 6;
+        static constexpr std::uint16_t resolution_option = 9;
+        // Block header and trailing block length
+        static constexpr std::size_t block_overhead = block_header::traits::bytes + 4;
+
+        std::vector<ptl::detail::pcapng_interface_info> interfaces;
+        std::size_t next_readahead = pos - pos % readahead_bytes;
+        bool first = true;
+        while (pos + block_header::traits::bytes <= size_) {
+            unsigned char const * const block = data_ + pos;
+            // The section header block's type reads the same in either
+            // byte order, and the next section's length is read in its
+            // own byte order once its magic is read
+            const std::uint32_t type = block_header::template field_value<0>(block);
+            if (type == section_header_block && !first) {
+                return pos;
+            }
+            const std::size_t length = block_header::template field_value<1>(block);
+            if (length < block_overhead || length % 4 != 0 || length > size_ - pos) {
+                truncated_ = true;
+                return size_;
+            }
+            first = false;
+            prefetch(pos, next_readahead);
+
+            unsigned char const * const body = block + block_header::traits::bytes;
+            const std::size_t body_length = length - block_overhead;
+            if (type == enhanced_packet_block && body_length >= enhanced_packet::traits::bytes) {
+                const std::uint32_t id = enhanced_packet::template field_value<0>(body);
+                const std::size_t captured = enhanced_packet::template field_value<3>(body);
+                if (id < interfaces.size() && captured <= body_length - enhanced_packet::traits::bytes) {
+                    const std::uint64_t ts = (static_cast<std::uint64_t>(enhanced_packet::template field_value<1>(body)) << 32) |
+                        enhanced_packet::template field_value<2>(body);
+                    const ptl::capture_record record = {
+                        ptl::detail::pcapng_nanoseconds(ts, interfaces[id]),
+                        interfaces[id].link_type,
+                        enhanced_packet::template field_value<4>(body),
+                        body + enhanced_packet::traits::bytes,
+                        captured
+                    };
+                    visit(record);
+                    ++records;
+                }
+            } else if (type == simple_packet_block && body_length >= simple_packet::traits::bytes &&
+                       !interfaces.empty()) {
+                const std::uint32_t original = simple_packet::template field_value<0>(body);
+                std::size_t captured = body_length - simple_packet::traits::bytes;
+                captured = original < captured ? original : captured;
+                if (interfaces[0].snap_length != 0 && interfaces[0].snap_length < captured) {
+                    captured = interfaces[0].snap_length;
+                }
+                const ptl::capture_record record = {
+                    0,
+                    interfaces[0].link_type,
+                    original,
+                    body + simple_packet::traits::bytes,
+                    captured
+                };
+                visit(record);
+                ++records;
+            } else if (type == interface_block && body_length >= interface::traits::bytes) {
+                ptl::detail::pcapng_interface_info info = {
+                    interface::template field_value<0>(body),
+                    interface::template field_value<2>(body),
+                    6,
+                    false
+                };
+                // Options follow the fixed fields, each padded to 4 bytes
+                std::size_t offset = interface::traits::bytes;
+                while (offset + option::traits::bytes <= body_length) {
+                    const std::uint16_t code = option::template field_value<0>(body + offset);
+                    const std::size_t option_length = option::template field_value<1>(body + offset);
+                    if (code == 0 || offset + option::traits::bytes + option_length > body_length) {
+                        break;
+                    }
+                    if (code == resolution_option && option_length >= 1) {
+                        const unsigned char resolution = body[offset + option::traits::bytes];
+                        info.binary = (resolution & 0x80) != 0;
+                        info.resolution = resolution & 0x7f;
+                    }
+                    offset += option::traits::bytes + (option_length + 3) / 4 * 4;
+                }
+                interfaces.push_back(info);
+            }
+            pos += length;
+        }
+        truncated_ = truncated_ || pos != size_;
+        return size_;
+    }
+
+    template <class Visitor>
+    std::size_t capture_reader::for_each_pcapng(Visitor & visit)
+    {
+        using little_block = ptl::detail::pcapng_block_header<ptl::byte_order::little>;
+        // Section header block's byte order magic follows the block header
+        static constexpr std::size_t magic_offset = little_block::traits::bytes;
+
+        std::size_t records = 0;
+        std::size_t pos = 0;
+        while (pos + magic_offset + 4 <= size_) {
+            const std::uint32_t magic = ptl::protocol<std::tuple<ptl::detail::capture_u32<ptl::byte_order::little>>>::
+                field_value<0>(data_ + pos + magic_offset);
+            if (magic == 0x1a2b3c4d) {
+                pos = for_each_pcapng_section<ptl::byte_order::little>(pos, visit, records);
+            } else if (magic == 0x4d3c2b1a) {
+                pos = for_each_pcapng_section<ptl::byte_order::big>(pos, visit, records);
+            } else {
+                truncated_ = true;
+                break;
+            }
+        }
+        return records;
+    }
+
+    template <class Visitor>
+    std::size_t capture_reader::for_each(Visitor && visit)
+    {
+        truncated_ = false;
+        if (format_ == format::pcapng) {
+            return for_each_pcapng(visit);
+        }
+        return order_ == ptl::byte_order::little ?
+            for_each_pcap<ptl::byte_order::little>(visit) :
+            for_each_pcap<ptl::byte_order::big>(visit);
+    }
+
+    template <class Protocol, class Visitor>
+    std::size_t capture_reader::for_each(const std::size_t offset, Visitor && visit)
+    {
+        std::size_t records = 0;
+        for_each([offset, &visit, &records](ptl::capture_record const & record) {
+                if (record.size >= offset && record.size - offset >= Protocol::traits::bytes) {
+                    visit(record, record.data + offset);
+                    ++records;
+                }
+            });
+        return records;
+    }
+}
+
+#endif
@@ -0,0 +1,315 @@
+#ifndef PTL_CHECKSUM_HPP
+#define PTL_CHECKSUM_HPP
+
+#include <cstdint>
+#include <cstring>
+#include "ptl.hpp"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace ptl
+{
+    /** Returns the 16 bit one's complement sum of bytes
+	 *
+	 *  The sum is of the bytes as big endian 16 bit words, with an
+	 *  odd last byte padded with a zero byte, as RFC 1071 defines.
+	 *  Words are summed in the host's byte order, sixteen bytes at a
+	 *  time with SSE2 for buffers larger than a header, and the sum is
+	 *  swapped at the end.
+	 *
+	 *  @param data The bytes to sum
+	 *  @param bytes The number of bytes
+	 *  @param initial A sum to add to, such as a pseudo header's
+	 */
+    inline std::uint16_t ones_complement_sum(unsigned char const * data,
+                                             std::size_t bytes,
+                                             const std::uint16_t initial = 0) noexcept
+    {
+        std::uint64_t sum = 0;
+#if defined(__SSE2__)
+        // Headers are summed faster by the scalar loop, which the
+        // compiler can unroll when bytes is a constant
+        if (bytes >= 64) {
+            const __m128i zero = _mm_setzero_si128();
+            __m128i low = zero;
+            __m128i high = zero;
+            // Each 32 bit word is added to a 64 bit lane, which can't
+            // overflow for any buffer that fits in memory
+            for (; bytes >= 16; bytes -= 16, data += 16) {
+                const __m128i v = _mm_loadu_si128(reinterpret_cast<__m128i const *>(data));
+                low = _mm_add_epi64(low, _mm_unpacklo_epi32(v, zero));
+                high = _mm_add_epi64(high, _mm_unpackhi_epi32(v, zero));
+            }
+            // Folds each lane to 33 bits so the lanes can be added
+            const __m128i halves = _mm_set1_epi64x(0xffffffff);
+            low = _mm_add_epi64(_mm_srli_epi64(low, 32), _mm_and_si128(low, halves));
+            high = _mm_add_epi64(_mm_srli_epi64(high, 32), _mm_and_si128(high, halves));
+            low = _mm_add_epi64(low, high);
+            low = _mm_add_epi64(low, _mm_unpackhi_epi64(low, low));
+            sum = static_cast<std::uint64_t>(_mm_cvtsi128_si64(low));
+        }
+#endif
+        for (; bytes >= 4; bytes -= 4, data += 4) {
+            std::uint32_t word;
+            std::memcpy(&word, data, sizeof(word));
+            sum += word;
+        }
+        if (bytes > 0) {
+            // Zero padded, so the bytes keep their position in the word
+            unsigned char tail[4] = {};
+            std::memcpy(tail, data, bytes);
+            std::uint32_t word;
+            std::memcpy(&word, tail, sizeof(word));
+            sum += word;
+        }
+
+        // 2^16 is 1 modulo 0xffff, so folding 16 bit halves preserves the sum
+        sum = (sum >> 32) + (sum & 0xffffffff);
+        sum = (sum >> 32) + (sum & 0xffffffff);
+        sum = (sum >> 16) + (sum & 0xffff);
+        sum = (sum >> 16) + (sum & 0xffff);
+        sum = (sum >> 16) + (sum & 0xffff);
+
+        std::uint16_t folded = static_cast<std::uint16_t>(sum);
+#if !defined(__BYTE_ORDER__) || __BYTE_ORDER__ != __ORDER_BIG_ENDIAN__
+        folded = static_cast<std::uint16_t>((folded >> 8) | (folded << 8));
+#endif
+        const std::uint32_t total = static_cast<std::uint32_t>(folded) + initial;
+        return static_cast<std::uint16_t>((total >> 16) + (total & 0xffff));
+    }
+
+    /// Returns the RFC 1071 Internet checksum of bytes
+    inline std::uint16_t internet_checksum(unsigned char const * const data,
+                                           const std::size_t bytes,
+                                           const std::uint16_t initial = 0) noexcept
+    {
+        return static_cast<std::uint16_t>(~ptl::ones_complement_sum(data, bytes, initial));
+    }
+
+    namespace detail
+    {
+        /// Slicing by 8 tables of a non-reflected 32 bit CRC
+        template <std::uint32_t Polynomial>
+        struct crc32_tables
+        {
+                struct table_type
+                {
+                        std::uint32_t entries[8][256];
+                };
+
+            private:
+                static constexpr table_type make_tables() noexcept {
+                    table_type tables = {};
+                    for (std::uint32_t b = 0; b < 256; ++b) {
+                        std::uint32_t crc = b << 24;
+                        for (int bit = 0; bit < 8; ++bit) {
+                            crc = (crc & 0x80000000u) ? (crc << 1) ^ Polynomial : crc << 1;
+                        }
+                        tables.entries[0][b] = crc;
+                    }
+                    for (std::size_t k = 1; k < 8; ++k) {
+                        for (std::size_t b = 0; b < 256; ++b) {
+                            const std::uint32_t prev = tables.entries[k - 1][b];
+                            tables.entries[k][b] = (prev << 8) ^ tables.entries[0][prev >> 24];
+                        }
+                    }
+                    return tables;
+                }
+
+            public:
+                static constexpr table_type tables = make_tables();
+        };
+
+        template <std::uint32_t Polynomial>
+        constexpr typename crc32_tables<Polynomial>::table_type crc32_tables<Polynomial>::tables;
+    }
+
+    /** Returns the non-reflected 32 bit CRC of bytes
+	 *
+	 *  Eight bytes are processed per step with slicing by 8 tables
+	 *  computed at compile time.
+	 *
+	 *  @tparam Polynomial The CRC's generator polynomial
+	 *  @param data The bytes
+	 *  @param bytes The number of bytes
+	 *  @param crc The initial CRC, or the CRC of the preceding bytes
+	 */
+    template <std::uint32_t Polynomial>
+    inline std::uint32_t crc32(unsigned char const * data,
+                               std::size_t bytes,
+                               std::uint32_t crc = 0xffffffffu) noexcept
+    {
+        auto const & t = ptl::detail::crc32_tables<Polynomial>::tables.entries;
+        for (; bytes >= 8; bytes -= 8, data += 8) {
+            crc ^= static_cast<std::uint32_t>(ptl::load_word<4>(data) >> 32);
+            crc = t[7][crc >> 24] ^ t[6][(crc >> 16) & 0xff] ^ t[5][(crc >> 8) & 0xff] ^ t[4][crc & 0xff] ^
+                t[3][data[4]] ^ t[2][data[5]] ^ t[1][data[6]] ^ t[0][data[7]];
+        }
+        for (; bytes > 0; --bytes, ++data) {
+            crc = (crc << 8) ^ t[0][(crc >> 24) ^ *data];
+        }
+        return crc;
+    }
+
+    /// Generator polynomial of the MPEG-2 CRC_32 of PSI sections
+    static constexpr std::uint32_t crc32_mpeg2_polynomial = 0x04c11db7;
+
+    /// Returns the MPEG-2 CRC_32 of bytes, as used by PSI sections
+    inline std::uint32_t crc32_mpeg2(unsigned char const * const data, const std::size_t bytes) noexcept
+    {
+        return ptl::crc32<ptl::crc32_mpeg2_polynomial>(data, bytes);
+    }
+
+    /** An Internet checksum over a protocol's buffer
+	 *
+	 *  The checksum covers the protocol's bytes, and optionally bytes
+	 *  that follow them, with the checksum field taken to be zero.
+	 *
+	 *  @tparam Protocol The ptl::protocol the checksum covers
+	 *  @tparam Field Order number of the checksum field, a 16 bit
+	 *  field on a 16 bit boundary
+	 *  @tparam Zero_As_Ones Sends a checksum of zero as 0xffff, as
+	 *  UDP and UDP-Lite do because zero means no checksum there
+	 */
+    template <class Protocol, std::size_t Field, bool Zero_As_Ones = false>
+    class internet_checksum_field
+    {
+        private:
+
+            using tuple_type = typename Protocol::tuple_type;
+            using field_traits = ptl::field_protocol_traits<Field, tuple_type>;
+
+        public:
+
+            static_assert(field_traits::type::bits == 16 && field_traits::bit_offset % 16 == 0,
+                          "The checksum field must be 16 bits on a 16 bit boundary");
+
+            /// Returns the checksum of buf with the checksum field taken to be zero
+            /**
+             *  @param buf Protocol buffer.
+             *  @param bytes Number of bytes covered, at least the protocol's.
+             *  @param initial A sum to add to, such as a pseudo header's.
+             */
+            static std::uint16_t compute(unsigned char const * const buf,
+                                         const std::size_t bytes = Protocol::traits::bytes,
+                                         const std::uint16_t initial = 0) noexcept {
+                // The field is skipped.  The header's whole words are
+                // summed with constant sizes, so the sums are unrolled
+                static constexpr std::size_t field_byte = field_traits::byte_index;
+                static constexpr std::size_t words_end = Protocol::traits::bytes & ~static_cast<std::size_t>(1);
+                std::uint16_t sum = ptl::ones_complement_sum(buf, field_byte, initial);
+                sum = ptl::ones_complement_sum(buf + field_byte + 2, words_end - field_byte - 2, sum);
+                if (bytes > words_end) {
+                    sum = ptl::ones_complement_sum(buf + words_end, bytes - words_end, sum);
+                }
+                const std::uint16_t checksum = static_cast<std::uint16_t>(~sum);
+                return Zero_As_Ones && checksum == 0 ? 0xffff : checksum;
+            }
+
+            /// Returns true if buf's checksum field holds its checksum
+            static bool verify(unsigned char const * const buf,
+                               const std::size_t bytes = Protocol::traits::bytes,
+                               const std::uint16_t initial = 0) noexcept {
+                const std::uint16_t sum = ptl::ones_complement_sum(buf, bytes, initial);
+                return sum == 0xffff;
+            }
+
+            /// Sets buf's checksum field to its checksum
+            static void update(unsigned char * const buf,
+                               const std::size_t bytes = Protocol::traits::bytes,
+                               const std::uint16_t initial = 0) noexcept {
+                Protocol::template field_value<Field>(buf, compute(buf, bytes, initial));
+            }
+
+            /// Sets a field and incrementally updates the checksum
+            /**
+             *  The checksum is updated from the sums of the 16 bit
+             *  words the field spans before and after it's set, as
+             *  RFC 1624 describes, without summing the whole buffer.
+             *
+             *  @tparam I Order number of the field in the protocol tuple
+             *  @param buf Protocol buffer with a valid checksum.
+             *  @param value Value to set the field to.
+             */
+            template <std::size_t I>
+            static void field_value(unsigned char * const buf, const ptl::field_type<I, tuple_type> value) noexcept {
+                static_assert(I != Field,
+                              "The checksum field can't be incrementally updated");
+                using traits = ptl::field_protocol_traits<I, tuple_type>;
+                static constexpr std::size_t first = traits::byte_index & ~static_cast<std::size_t>(1);
+                // An odd protocol's last word is padded with a zero byte,
+                // which isn't read
+                static constexpr std::size_t word_last = ptl::field_last_byte<I, tuple_type>::value | 1;
+                static constexpr std::size_t last =
+                    word_last < Protocol::traits::bytes ? word_last : Protocol::traits::bytes - 1;
+                static constexpr std::size_t bytes = last + 1 - first;
+
+                const std::uint16_t old_sum = ptl::ones_complement_sum(buf + first, bytes);
+                Protocol::template field_value<I>(buf, value);
+                const std::uint16_t new_sum = ptl::ones_complement_sum(buf + first, bytes);
+
+                // HC' = ~(~HC + ~m + m')
+                std::uint32_t sum = static_cast<std::uint16_t>(~Protocol::template field_value<Field>(buf));
+                sum += static_cast<std::uint16_t>(~old_sum);
+                sum += new_sum;
+                sum = (sum >> 16) + (sum & 0xffff);
+                sum = (sum >> 16) + (sum & 0xffff);
+                const std::uint16_t checksum = static_cast<std::uint16_t>(~sum);
+                Protocol::template field_value<Field>(buf, Zero_As_Ones && checksum == 0 ? 0xffff : checksum);
+            }
+    };
+
+    /** An MPEG-2 CRC_32 over a protocol's buffer
+	 *
+	 *  The CRC covers the protocol's bytes, and optionally bytes that
+	 *  follow them, skipping the CRC field's bytes.
+	 *
+	 *  @tparam Protocol The ptl::protocol the CRC covers
+	 *  @tparam Field Order number of the CRC field, a 32 bit byte
+	 *  aligned field
+	 */
+    template <class Protocol, std::size_t Field>
+    class crc32_mpeg2_field
+    {
+        private:
+
+            using tuple_type = typename Protocol::tuple_type;
+            using field_traits = ptl::field_protocol_traits<Field, tuple_type>;
+
+            static constexpr std::size_t field_bytes = 4;
+
+        public:
+
+            static_assert(field_traits::type::bits == 32 && field_traits::byte_bit_offset == 0,
+                          "The CRC field must be 32 bits on a byte boundary");
+
+            /// Returns the CRC of buf, skipping the CRC field
+            /**
+             *  @param buf Protocol buffer.
+             *  @param bytes Number of bytes covered, at least the protocol's.
+             */
+            static std::uint32_t compute(unsigned char const * const buf,
+                                         const std::size_t bytes = Protocol::traits::bytes) noexcept {
+                const std::uint32_t crc = ptl::crc32<ptl::crc32_mpeg2_polynomial>(buf, field_traits::byte_index);
+                return ptl::crc32<ptl::crc32_mpeg2_polynomial>(buf + field_traits::byte_index + field_bytes,
+                                                               bytes - field_traits::byte_index - field_bytes,
+                                                               crc);
+            }
+
+            /// Returns true if buf's CRC field holds its CRC
+            static bool verify(unsigned char const * const buf,
+                               const std::size_t bytes = Protocol::traits::bytes) noexcept {
+                return Protocol::template field_value<Field>(buf) == compute(buf, bytes);
+            }
+
+            /// Sets buf's CRC field to its CRC
+            static void update(unsigned char * const buf,
+                               const std::size_t bytes = Protocol::traits::bytes) noexcept {
+                Protocol::template field_value<Field>(buf, compute(buf, bytes));
+            }
+    };
+}
+
+#endif
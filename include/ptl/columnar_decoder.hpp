@@ -0,0 +1,165 @@
+#ifndef PTL_COLUMNAR_DECODER_HPP
+#define PTL_COLUMNAR_DECODER_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <array>
+#include <tuple>
+#include <utility>
+#include "ptl.hpp"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace ptl
+{
+    /** Copies bytes with non-temporal stores where possible
+	 *
+	 *  The copied bytes bypass the cache, so copying large outputs
+	 *  doesn't evict the data being decoded.  ptl::stream_fence must
+	 *  be called before the copied bytes are read by another thread.
+	 *
+	 *  @param dst The destination bytes
+	 *  @param src The source bytes
+	 *  @param bytes The number of bytes to copy
+	 */
+    inline void stream_copy(void * const dst, void const * const src, const std::size_t bytes) noexcept
+    {
+#if defined(__SSE2__)
+        unsigned char * d = static_cast<unsigned char *>(dst);
+        unsigned char const * s = static_cast<unsigned char const *>(src);
+        std::size_t head = (16 - reinterpret_cast<std::uintptr_t>(d) % 16) % 16;
+        head = head < bytes ? head : bytes;
+        std::memcpy(d, s, head);
+        std::size_t i = head;
+        for (; i + 16 <= bytes; i += 16) {
+            _mm_stream_si128(reinterpret_cast<__m128i *>(d + i),
+                             _mm_loadu_si128(reinterpret_cast<__m128i const *>(s + i)));
+        }
+        std::memcpy(d + i, s + i, bytes - i);
+#else
+        std::memcpy(dst, src, bytes);
+#endif
+    }
+
+    /// Orders non-temporal stores before subsequent stores
+    inline void stream_fence() noexcept
+    {
+#if defined(__SSE2__)
+        _mm_sfence();
+#endif
+    }
+
+    /** Decodes fields of fixed stride records into per field columns
+	 *
+	 *  Records are decoded in chunks of chunk_records.  Each chunk's
+	 *  fields are unpacked into cache resident staging columns, which
+	 *  are then streamed to the output columns with non-temporal
+	 *  stores.
+	 *
+	 *  @tparam Protocol The ptl::protocol of the records
+	 *  @tparam Fields Order numbers of the decoded fields
+	 */
+    template <class Protocol, std::size_t... Fields>
+    class columnar_decoder
+    {
+        public:
+
+            static_assert(sizeof...(Fields) > 0,
+                          "At least one field must be decoded");
+
+            /// Number of records decoded per chunk
+            static constexpr std::size_t chunk_records = 512;
+
+            /// Type of a field's column elements
+            /**
+             *  @tparam I Order number of the field in the protocol tuple
+             */
+            template <std::size_t I>
+            using column_type = ptl::field_type<I, typename Protocol::tuple_type>;
+
+            /// Decodes count records into columns
+            /**
+             *  @param base First record's protocol buffer.
+             *  @param stride Number of bytes between records.
+             *  @param count Number of records.
+             *  @param columns One array of count values per field.
+             */
+            void decode(unsigned char const * base,
+                        const std::size_t stride,
+                        const std::size_t count,
+                        column_type<Fields> * const... columns) noexcept;
+
+        private:
+
+            using index_sequence = std::make_index_sequence<sizeof...(Fields)>;
+
+            template <std::size_t... C>
+            void decode_chunk(unsigned char const * base,
+                              const std::size_t stride,
+                              const std::size_t records,
+                              std::index_sequence<C...>) noexcept;
+
+            template <std::size_t... C>
+            void flush_chunk(std::tuple<column_type<Fields> *...> const & columns,
+                             const std::size_t offset,
+                             const std::size_t records,
+                             std::index_sequence<C...>) noexcept;
+
+            std::tuple<std::array<column_type<Fields>, chunk_records>...> staging_;
+    };
+
+    template <class Protocol, std::size_t... Fields>
+    void columnar_decoder<Protocol, Fields...>::decode(unsigned char const * base,
+                                                       const std::size_t stride,
+                                                       const std::size_t count,
+                                                       column_type<Fields> * const... columns) noexcept
+    {
+        const std::tuple<column_type<Fields> *...> column_tuple(columns...);
+        for (std::size_t offset = 0; offset < count; offset += chunk_records) {
+            const std::size_t records = count - offset < chunk_records ? count - offset : chunk_records;
+            decode_chunk(base + offset * stride, stride, records, index_sequence());
+            flush_chunk(column_tuple, offset, records, index_sequence());
+        }
+        ptl::stream_fence();
+    }
+
+    template <class Protocol, std::size_t... Fields>
+    template <std::size_t... C>
+    void columnar_decoder<Protocol, Fields...>::decode_chunk(unsigned char const * base,
+                                                             const std::size_t stride,
+                                                             const std::size_t records,
+                                                             std::index_sequence<C...>) noexcept
+    {
+        for (std::size_t r = 0; r < records; ++r, base += stride) {
+#if defined(__GNUC__)
+            if (r + 8 < records) {
+                __builtin_prefetch(base + 8 * stride);
+            }
+#endif
+            const auto values = Protocol::template unpack<Fields...>(base);
+            // Expands to one staging column store per field
+            const int expand[] = { (std::get<C>(staging_)[r] = std::get<C>(values), 0)... };
+            (void)expand;
+        }
+    }
+
+    template <class Protocol, std::size_t... Fields>
+    template <std::size_t... C>
+    void columnar_decoder<Protocol, Fields...>::flush_chunk(std::tuple<column_type<Fields> *...> const & columns,
+                                                            const std::size_t offset,
+                                                            const std::size_t records,
+                                                            std::index_sequence<C...>) noexcept
+    {
+        // Expands to one stream_copy per field
+        const int expand[] = {
+            (ptl::stream_copy(std::get<C>(columns) + offset,
+                              std::get<C>(staging_).data(),
+                              records * sizeof(typename std::tuple_element<C, std::tuple<column_type<Fields>...>>::type)), 0)...
+        };
+        (void)expand;
+    }
+}
+
+#endif
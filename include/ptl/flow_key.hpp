@@ -0,0 +1,372 @@
+#ifndef PTL_FLOW_KEY_HPP
+#define PTL_FLOW_KEY_HPP
+
+#include <array>
+#include <cstdint>
+#include <utility>
+#include "ptl.hpp"
+
+namespace ptl
+{
+    namespace detail
+    {
+        /// Slicing by 8 tables of a reflected 32 bit CRC
+        template <std::uint32_t Polynomial>
+        struct reflected_crc32_tables
+        {
+                struct table_type
+                {
+                        std::uint32_t entries[8][256];
+                };
+
+            private:
+                static constexpr table_type make_tables() noexcept {
+                    table_type tables = {};
+                    for (std::uint32_t b = 0; b < 256; ++b) {
+                        std::uint32_t crc = b;
+                        for (int bit = 0; bit < 8; ++bit) {
+                            crc = (crc & 1) ? (crc >> 1) ^ Polynomial : crc >> 1;
+                        }
+                        tables.entries[0][b] = crc;
+                    }
+                    for (std::size_t k = 1; k < 8; ++k) {
+                        for (std::size_t b = 0; b < 256; ++b) {
+                            const std::uint32_t prev = tables.entries[k - 1][b];
+                            tables.entries[k][b] = (prev >> 8) ^ tables.entries[0][prev & 0xff];
+                        }
+                    }
+                    return tables;
+                }
+
+            public:
+                static constexpr table_type tables = make_tables();
+        };
+
+        template <std::uint32_t Polynomial>
+        constexpr typename reflected_crc32_tables<Polynomial>::table_type reflected_crc32_tables<Polynomial>::tables;
+
+        /// Masks of the words of a protocol's buffer that hold a set of fields
+        template <class Tuple, std::size_t... Fields>
+        struct field_word_masks
+        {
+                static constexpr std::size_t buffer_words =
+                    (ptl::protocol_length<Tuple>::value + ptl::word_bits - 1) / ptl::word_bits;
+
+                // Returns the mask of the fields' bits in the buffer's word w
+                static constexpr ptl::word_type mask(const std::size_t w) noexcept {
+                    const std::size_t offsets[] = { ptl::field_bit_offset<Fields, Tuple>::value... };
+                    const std::size_t bits[] = { ptl::field_bits<Fields, Tuple>::value... };
+                    const std::size_t word_begin = w * ptl::word_bits;
+                    ptl::word_type mask = 0;
+                    for (std::size_t i = 0; i < sizeof...(Fields); ++i) {
+                        const std::size_t begin = offsets[i] > word_begin ? offsets[i] : word_begin;
+                        const std::size_t end = offsets[i] + bits[i] < word_begin + ptl::word_bits ?
+                            offsets[i] + bits[i] : word_begin + ptl::word_bits;
+                        if (begin < end) {
+                            mask |= ptl::msb_mask<ptl::word_type>(end - begin, begin - word_begin);
+                        }
+                    }
+                    return mask;
+                }
+
+                // Returns the number of words with any of the fields' bits
+                static constexpr std::size_t words() noexcept {
+                    std::size_t count = 0;
+                    for (std::size_t w = 0; w < buffer_words; ++w) {
+                        count += mask(w) != 0;
+                    }
+                    return count;
+                }
+
+                // Returns the buffer word of the k'th word with any of the fields' bits
+                static constexpr std::size_t word(const std::size_t k) noexcept {
+                    std::size_t w = 0;
+                    for (std::size_t count = 0; w < buffer_words; ++w) {
+                        if (mask(w) != 0 && count++ == k) {
+                            break;
+                        }
+                    }
+                    return w;
+                }
+        };
+    }
+
+    /// Reflected generator polynomial of CRC32C, the Castagnoli CRC
+    static constexpr std::uint32_t crc32c_polynomial = 0x82f63b78;
+
+    namespace detail
+    {
+        /// Returns the CRC32C of a word's bytes in little endian order with slicing by 8 tables
+        inline std::uint32_t crc32c_word_table(std::uint32_t crc, ptl::word_type word) noexcept
+        {
+            auto const & t = ptl::detail::reflected_crc32_tables<ptl::crc32c_polynomial>::tables.entries;
+            const std::uint32_t low = crc ^ static_cast<std::uint32_t>(word);
+            const std::uint32_t high = static_cast<std::uint32_t>(word >> 32);
+            return t[7][low & 0xff] ^ t[6][(low >> 8) & 0xff] ^ t[5][(low >> 16) & 0xff] ^ t[4][low >> 24] ^
+                t[3][high & 0xff] ^ t[2][(high >> 8) & 0xff] ^ t[1][(high >> 16) & 0xff] ^ t[0][high >> 24];
+        }
+
+        /// Computes CRC32C words with the tables
+        struct crc32c_table_step
+        {
+                static std::uint32_t word(std::uint32_t crc, ptl::word_type word) noexcept {
+                    return ptl::detail::crc32c_word_table(crc, word);
+                }
+        };
+
+#if defined(PTL_X86_DISPATCH)
+        /// Returns true if the CPU supports SSE4.2
+        inline bool has_sse42() noexcept
+        {
+#if defined(__SSE4_2__)
+            return true;
+#else
+            static const bool sse42 = (__builtin_cpu_init(), __builtin_cpu_supports("sse4.2") != 0);
+            return sse42;
+#endif
+        }
+
+        /// Computes CRC32C words with the SSE4.2 crc32 instruction
+        struct crc32c_sse42_step
+        {
+                __attribute__((target("sse4.2")))
+                static std::uint32_t word(std::uint32_t crc, ptl::word_type word) noexcept {
+#if defined(__x86_64__)
+                    return static_cast<std::uint32_t>(_mm_crc32_u64(crc, word));
+#else
+                    crc = _mm_crc32_u32(crc, static_cast<std::uint32_t>(word));
+                    return _mm_crc32_u32(crc, static_cast<std::uint32_t>(word >> 32));
+#endif
+                }
+        };
+#endif
+    }
+
+    /** Returns the CRC32C of a word's bytes in little endian order
+	 *
+	 *  Uses the SSE4.2 crc32 instruction when the CPU supports it,
+	 *  and slicing by 8 tables otherwise, which give the same CRC.
+	 *
+	 *  @param crc The CRC of the preceding words
+	 *  @param word The word
+	 */
+    inline std::uint32_t crc32c_word(std::uint32_t crc, ptl::word_type word) noexcept
+    {
+#if defined(PTL_X86_DISPATCH)
+        if (ptl::detail::has_sse42()) {
+            return ptl::detail::crc32c_sse42_step::word(crc, word);
+        }
+#endif
+        return ptl::detail::crc32c_word_table(crc, word);
+    }
+
+    /** A flow key of a protocol's fields, for hashing and comparing flows
+	 *
+	 *  The words of the protocol's buffer that hold the fields, and a
+	 *  mask of the fields' bits in each word, are found at compile
+	 *  time.  A key is the masked words, loaded with one load each,
+	 *  so extracting an IPv4 and UDP 5-tuple takes two loads and two
+	 *  ands.  Keys are hashed with CRC32C, with the SSE4.2 crc32
+	 *  instruction when the CPU supports it:
+	 *
+	 *      // Protocol, source and destination addresses and ports
+	 *      using five_tuple = ptl::flow_key<ipv4_udp, 9, 11, 12, 13, 14>;
+	 *
+	 *      const std::size_t worker = five_tuple::steer(five_tuple::hash(packet), workers);
+	 *
+	 *  @tparam Protocol The ptl::protocol of the headers
+	 *  @tparam Fields Order numbers of the key's fields
+	 */
+    template <class Protocol, std::size_t... Fields>
+    class flow_key
+    {
+        private:
+
+            using masks = ptl::detail::field_word_masks<typename Protocol::tuple_type, Fields...>;
+
+        public:
+
+            static_assert(sizeof...(Fields) > 0,
+                          "A flow key must have at least one field");
+
+            /// Number of words in a key
+            static constexpr std::size_t words = masks::words();
+
+            /// The fields' masked words
+            using key_type = std::array<ptl::word_type, words>;
+
+            /// Returns the mask of the fields' bits in a key's word k
+            static constexpr ptl::word_type mask(const std::size_t k) noexcept {
+                return masks::mask(masks::word(k));
+            }
+
+            /// Returns the byte offset in the header of a key's word k
+            static constexpr std::size_t offset(const std::size_t k) noexcept {
+                return masks::word(k) * sizeof(ptl::word_type);
+            }
+
+            /// Returns the key of a header
+            static key_type key(unsigned char const * const header) noexcept {
+                return key(header, std::make_index_sequence<words>());
+            }
+
+            /// Returns the hash of a key
+            /**
+             *  @param seed Selects one of a family of hashes.
+             */
+            static std::uint32_t hash(key_type const & key, const std::uint32_t seed = 0) noexcept {
+#if defined(PTL_X86_DISPATCH)
+                if (ptl::detail::has_sse42()) {
+                    return hash_sse42(key, seed);
+                }
+#endif
+                return hash_words<ptl::detail::crc32c_table_step>(key, seed);
+            }
+
+            /// Returns the hash of a header's key
+            static std::uint32_t hash(unsigned char const * const header, const std::uint32_t seed = 0) noexcept {
+#if defined(PTL_X86_DISPATCH)
+                if (ptl::detail::has_sse42()) {
+                    return hash_header_sse42(header, seed);
+                }
+#endif
+                return hash_words<ptl::detail::crc32c_table_step>(key(header), seed);
+            }
+
+            /// Hashes the keys of count headers stride bytes apart
+            /**
+             *  @param hashes The count headers' hashes.
+             */
+            static void hash(unsigned char const * const headers,
+                             const std::size_t stride,
+                             const std::size_t count,
+                             std::uint32_t * const hashes,
+                             const std::uint32_t seed = 0) noexcept {
+#if defined(PTL_X86_DISPATCH)
+                if (ptl::detail::has_sse42()) {
+                    hash_headers_sse42(headers, stride, count, hashes, seed);
+                    return;
+                }
+#endif
+                hash_headers<ptl::detail::crc32c_table_step>(headers, stride, count, hashes, seed);
+            }
+
+            /// Returns true if a header's key is key
+            static bool equal(unsigned char const * const header, key_type const & key) noexcept {
+                return equal(header, key, std::make_index_sequence<words>());
+            }
+
+            /// Returns true if two headers' keys are equal
+            static bool equal(unsigned char const * const header, unsigned char const * const other) noexcept {
+                return equal(header, key(other));
+            }
+
+            /// Maps a hash onto one of workers, evenly for uniform hashes
+            static constexpr std::size_t steer(const std::uint32_t hash, const std::size_t workers) noexcept {
+                return static_cast<std::size_t>((static_cast<std::uint64_t>(hash) * workers) >> 32);
+            }
+
+        private:
+
+            template <class Step>
+            static std::uint32_t hash_words(key_type const & key, const std::uint32_t seed) noexcept;
+
+            template <class Step>
+            static void hash_headers(unsigned char const * const headers,
+                                     const std::size_t stride,
+                                     const std::size_t count,
+                                     std::uint32_t * const hashes,
+                                     const std::uint32_t seed) noexcept;
+
+#if defined(PTL_X86_DISPATCH)
+            // The table free hashes are compiled for SSE4.2, so the
+            // crc32 instructions are inlined into them
+            __attribute__((target("sse4.2"), flatten))
+            static std::uint32_t hash_sse42(key_type const & key, const std::uint32_t seed) noexcept {
+                return hash_words<ptl::detail::crc32c_sse42_step>(key, seed);
+            }
+
+            __attribute__((target("sse4.2"), flatten))
+            static std::uint32_t hash_header_sse42(unsigned char const * const header, const std::uint32_t seed) noexcept {
+                return hash_words<ptl::detail::crc32c_sse42_step>(key(header), seed);
+            }
+
+            __attribute__((target("sse4.2"), flatten))
+            static void hash_headers_sse42(unsigned char const * const headers,
+                                           const std::size_t stride,
+                                           const std::size_t count,
+                                           std::uint32_t * const hashes,
+                                           const std::uint32_t seed) noexcept {
+                hash_headers<ptl::detail::crc32c_sse42_step>(headers, stride, count, hashes, seed);
+            }
+#endif
+
+            // Loads a key's word K, without reading past the header
+            template <std::size_t K>
+            static ptl::word_type load(unsigned char const * const header) noexcept {
+                static constexpr std::size_t remaining = Protocol::traits::bytes - offset(K);
+                static constexpr std::size_t bytes =
+                    remaining < sizeof(ptl::word_type) ? remaining : sizeof(ptl::word_type);
+                return ptl::load_word<bytes>(header + offset(K)) & mask(K);
+            }
+
+            template <std::size_t... K>
+            static key_type key(unsigned char const * const header, std::index_sequence<K...>) noexcept {
+                return key_type{{ load<K>(header)... }};
+            }
+
+            template <std::size_t... K>
+            static bool equal(unsigned char const * const header, key_type const & key, std::index_sequence<K...>) noexcept {
+                ptl::word_type differences = 0;
+                const int expand[] = { (differences |= load<K>(header) ^ key[K], 0)... };
+                (void)expand;
+                return differences == 0;
+            }
+    };
+
+    template <class Protocol, std::size_t... Fields>
+    template <class Step>
+    std::uint32_t flow_key<Protocol, Fields...>::hash_words(key_type const & key, const std::uint32_t seed) noexcept
+    {
+        std::uint32_t crc = ~seed;
+        for (std::size_t k = 0; k < words; ++k) {
+            crc = Step::word(crc, key[k]);
+        }
+        return ~crc;
+    }
+
+    template <class Protocol, std::size_t... Fields>
+    template <class Step>
+    void flow_key<Protocol, Fields...>::hash_headers(unsigned char const * const headers,
+                                                     const std::size_t stride,
+                                                     const std::size_t count,
+                                                     std::uint32_t * const hashes,
+                                                     const std::uint32_t seed) noexcept
+    {
+        // The CRCs of four headers are independent, so their
+        // latencies overlap
+        const std::size_t batched = count - count % 4;
+        for (std::size_t i = 0; i < batched; i += 4) {
+            const key_type k0 = key(headers + i * stride);
+            const key_type k1 = key(headers + (i + 1) * stride);
+            const key_type k2 = key(headers + (i + 2) * stride);
+            const key_type k3 = key(headers + (i + 3) * stride);
+            std::uint32_t c0 = ~seed, c1 = ~seed, c2 = ~seed, c3 = ~seed;
+            for (std::size_t k = 0; k < words; ++k) {
+                c0 = Step::word(c0, k0[k]);
+                c1 = Step::word(c1, k1[k]);
+                c2 = Step::word(c2, k2[k]);
+                c3 = Step::word(c3, k3[k]);
+            }
+            hashes[i] = ~c0;
+            hashes[i + 1] = ~c1;
+            hashes[i + 2] = ~c2;
+            hashes[i + 3] = ~c3;
+        }
+        for (std::size_t i = batched; i < count; ++i) {
+            hashes[i] = hash_words<Step>(key(headers + i * stride), seed);
+        }
+    }
+}
+
+#endif
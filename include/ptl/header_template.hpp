@@ -0,0 +1,201 @@
+#ifndef PTL_HEADER_TEMPLATE_HPP
+#define PTL_HEADER_TEMPLATE_HPP
+
+#include <cstdint>
+#include <tuple>
+#include <utility>
+#include "ptl.hpp"
+
+namespace ptl
+{
+    /** A protocol header whose fields are fixed except for a few dynamic fields
+	 *
+	 *  The fixed fields are held as protocol words with the dynamic
+	 *  fields' bits cleared.  Emitting a header copies the words into
+	 *  registers, ors in the dynamic fields' values, and stores each
+	 *  word once.  A header_template can be constructed at compile
+	 *  time:
+	 *
+	 *      constexpr ptl::header_template<rtp, 4, 6, 7> tmpl(2, false, false, 0, false, 96, 0, 0, ssrc);
+	 *
+	 *  @tparam Protocol The ptl::protocol of the header
+	 *  @tparam Dynamic Order numbers of the fields set when emitting
+	 */
+    template <class Protocol, std::size_t... Dynamic>
+    class header_template
+    {
+        private:
+
+            using tuple_type = typename Protocol::tuple_type;
+            using words = ptl::protocol_words<tuple_type>;
+
+            static constexpr std::size_t dynamic_fields = sizeof...(Dynamic);
+
+            // Returns the index of field i in Dynamic, or dynamic_fields
+            static constexpr std::size_t dynamic_index(const std::size_t i) noexcept {
+                const std::size_t fields[] = { Dynamic..., 0 };
+                for (std::size_t d = 0; d < dynamic_fields; ++d) {
+                    if (fields[d] == i) {
+                        return d;
+                    }
+                }
+                return dynamic_fields;
+            }
+
+            // Returns true if no field is in Dynamic twice
+            static constexpr bool unique_dynamic() noexcept {
+                const std::size_t fields[] = { Dynamic..., 0 };
+                for (std::size_t d = 0; d < dynamic_fields; ++d) {
+                    if (dynamic_index(fields[d]) != d) {
+                        return false;
+                    }
+                }
+                return true;
+            }
+
+        public:
+
+            static_assert(dynamic_fields > 0,
+                          "A header template must have at least one dynamic field");
+            static_assert(unique_dynamic(),
+                          "A dynamic field may only be given once");
+
+            /// Number of protocol words in the header
+            static constexpr std::size_t word_count = words::count;
+
+            /// std::tuple of the dynamic fields' value types
+            using dynamic_tuple = std::tuple<ptl::field_type<Dynamic, tuple_type>...>;
+
+            /// Creates a template from the values of all of the protocol's fields
+            /**
+             *  The dynamic fields' values are the values emit() without
+             *  arguments starts from.
+             *
+             *  @param values Values of the protocol's fields.
+             */
+            explicit constexpr header_template(typename Protocol::value_tuple const & values) noexcept :
+                header_template(values, std::make_index_sequence<std::tuple_size<tuple_type>::value>())
+            {}
+
+            /// Creates a template from the values of all of the protocol's fields
+            /**
+             *  @param values Values of the protocol's fields in field order.
+             */
+            template <class... Values,
+                      class = typename std::enable_if<sizeof...(Values) == std::tuple_size<tuple_type>::value &&
+                                                      (sizeof...(Values) > 1)>::type>
+            explicit constexpr header_template(Values const &... values) noexcept :
+                header_template(typename Protocol::value_tuple(values...))
+            {}
+
+            /// Writes the header with the dynamic fields set to values
+            /**
+             *  @param buf Protocol buffer.
+             *  @param values Values of the dynamic fields in Dynamic order.
+             */
+            void emit(unsigned char * const buf, ptl::field_type<Dynamic, tuple_type> const &... values) const noexcept {
+                typename words::array_type w;
+                for (std::size_t i = 0; i < word_count; ++i) {
+                    w[i] = words_[i];
+                }
+                // Expands to one words_field_value::set call per dynamic field
+                const int expand[] = {
+                    (ptl::words_field_value<ptl::field_bit_offset<Dynamic, tuple_type>::value,
+                                            ptl::field_bits<Dynamic, tuple_type>::value,
+                                            ptl::field_type<Dynamic, tuple_type>,
+                                            ptl::field_order<Dynamic, tuple_type>::value
+                                            >::set(w, values), 0)...
+                };
+                (void)expand;
+                words::store(buf, w);
+            }
+
+            /// Writes the header with the dynamic fields' current values
+            /**
+             *  @param buf Protocol buffer.
+             */
+            void emit(unsigned char * const buf) const noexcept {
+                emit_current(buf, std::make_index_sequence<dynamic_fields>());
+            }
+
+            /// Returns a dynamic field's current value
+            /**
+             *  @tparam I Order number of the field in the protocol tuple
+             */
+            template <std::size_t I>
+            ptl::field_type<I, tuple_type> get() const noexcept {
+                static_assert(dynamic_index(I) < dynamic_fields,
+                              "Only dynamic fields have a current value");
+                return std::get<dynamic_index(I)>(values_);
+            }
+
+            /// Sets a dynamic field's current value
+            /**
+             *  @tparam I Order number of the field in the protocol tuple
+             */
+            template <std::size_t I>
+            void set(const ptl::field_type<I, tuple_type> value) noexcept {
+                static_assert(dynamic_index(I) < dynamic_fields,
+                              "Only dynamic fields have a current value");
+                std::get<dynamic_index(I)>(values_) = value;
+            }
+
+            /// Adds step to a dynamic field's current value
+            /**
+             *  The value wraps around at the field's number of bits, as
+             *  RTP sequence numbers and timestamps do.
+             *
+             *  @tparam I Order number of the field in the protocol tuple
+             *  @param step The amount to add.
+             */
+            template <std::size_t I>
+            void advance(const ptl::field_type<I, tuple_type> step = 1) noexcept {
+                static_assert(dynamic_index(I) < dynamic_fields,
+                              "Only dynamic fields have a current value");
+                using value_type = ptl::field_type<I, tuple_type>;
+                static constexpr auto mask = ptl::lsb_mask<ptl::word_type>(ptl::field_bits<I, tuple_type>::value, 0);
+                value_type & value = std::get<dynamic_index(I)>(values_);
+                value = static_cast<value_type>((static_cast<ptl::word_type>(value) + step) & mask);
+            }
+
+            /// Returns protocol word i with the dynamic fields' bits cleared
+            constexpr ptl::word_type word(const std::size_t i) const noexcept {
+                return words_[i];
+            }
+
+        private:
+
+            template <std::size_t... I>
+            constexpr header_template(typename Protocol::value_tuple const & values, std::index_sequence<I...>) noexcept :
+                words_{},
+                values_(std::get<Dynamic>(values)...)
+            {
+                // Expands to one set_field call per field
+                const int expand[] = {
+                    (set_field<I>(std::get<I>(values)), 0)...
+                };
+                (void)expand;
+            }
+
+            // Sets a fixed field's bits in words_
+            template <std::size_t I>
+            constexpr void set_field(const ptl::field_type<I, tuple_type> value) noexcept {
+                using traits = ptl::field_protocol_traits<I, tuple_type>;
+                if (dynamic_index(I) < dynamic_fields) {
+                    return;
+                }
+                ptl::words_field_value<traits::bit_offset, traits::type::bits,
+                                       typename traits::type::value_type, traits::order>::set(words_, value);
+            }
+
+            template <std::size_t... D>
+            void emit_current(unsigned char * const buf, std::index_sequence<D...>) const noexcept {
+                emit(buf, std::get<D>(values_)...);
+            }
+
+            typename words::array_type words_;
+            dynamic_tuple values_;
+    };
+}
+
+#endif
@@ -0,0 +1,127 @@
+#ifndef PTL_MATCH_HPP
+#define PTL_MATCH_HPP
+
+#include <cstdint>
+#include "ptl.hpp"
+
+namespace ptl
+{
+    /** A predicate over a protocol's fields
+	 *
+	 *  Equality predicates on fields are folded into one mask and one
+	 *  compare value per protocol word, so evaluating a predicate is
+	 *  a load, and, and compare per word with no branches.
+	 *  Predicates are combined with operator&&:
+	 *
+	 *      using ts_match = ptl::match<ts_proto>;
+	 *      constexpr auto is_pat = ts_match::eq<mpeg2_ts::sync_byte>(0x47) &&
+	 *                              ts_match::eq<mpeg2_ts::pid>(0);
+	 *
+	 *  @tparam Protocol The ptl::protocol the predicate applies to
+	 */
+    template <class Protocol>
+    class match
+    {
+        private:
+
+            using tuple_type = typename Protocol::tuple_type;
+            using words = ptl::protocol_words<tuple_type>;
+
+        public:
+
+            /// Number of protocol words compared
+            static constexpr std::size_t word_count = words::count;
+
+            /// Returns a predicate that is true when field I equals value
+            /**
+             *  A value wider than the field is never matched.
+             *
+             *  @tparam I Order number of the field in the protocol tuple
+             *  @param value The value field I must equal
+             */
+            template <std::size_t I>
+            static constexpr match eq(const ptl::field_type<I, tuple_type> value) noexcept {
+                using traits = ptl::field_protocol_traits<I, tuple_type>;
+                match m;
+                m.impossible_ = traits::type::bits < ptl::word_bits &&
+                    (static_cast<ptl::word_type>(value) >> (traits::type::bits % ptl::word_bits)) != 0;
+                ptl::words_field_value<traits::bit_offset, traits::type::bits, ptl::word_type>::set(
+                    m.mask_, ~static_cast<ptl::word_type>(0));
+                ptl::words_field_value<traits::bit_offset, traits::type::bits,
+                                       typename traits::type::value_type, traits::order>::set(m.value_, value);
+                return m;
+            }
+
+            /// Returns a predicate that is true when both predicates are true
+            friend constexpr match operator&&(match const & lhs, match const & rhs) noexcept {
+                match m;
+                m.impossible_ = lhs.impossible_ | rhs.impossible_;
+                for (std::size_t i = 0; i < word_count; ++i) {
+                    // Both predicates constrain the same bits to different values
+                    m.impossible_ |= (lhs.mask_[i] & rhs.mask_[i] & (lhs.value_[i] ^ rhs.value_[i])) != 0;
+                    m.mask_[i] = lhs.mask_[i] | rhs.mask_[i];
+                    m.value_[i] = lhs.value_[i] | rhs.value_[i];
+                }
+                return m;
+            }
+
+            /// Returns true if the protocol buffer satisfies the predicate
+            bool operator()(unsigned char const * const buf) const noexcept {
+                const auto loaded = words::load(buf);
+                ptl::word_type diff = impossible_;
+                for (std::size_t i = 0; i < word_count; ++i) {
+                    diff |= (loaded[i] & mask_[i]) ^ value_[i];
+                }
+                return diff == 0;
+            }
+
+            /// Evaluates the predicate for an array of fixed stride records
+            /**
+             *  Bit i % 64 of bitmap[i / 64] is set to whether record i
+             *  satisfies the predicate.
+             *
+             *  @param base First record's protocol buffer.
+             *  @param stride Number of bytes between records.
+             *  @param count Number of records.
+             *  @param bitmap Array of (count + 63) / 64 words.
+             *  @return The number of records that satisfy the predicate.
+             */
+            std::size_t operator()(unsigned char const * base,
+                                   const std::size_t stride,
+                                   const std::size_t count,
+                                   std::uint64_t * const bitmap) const noexcept {
+                std::size_t matches = 0;
+                for (std::size_t i = 0; i < count; i += 64) {
+                    const std::size_t records = count - i < 64 ? count - i : 64;
+                    std::uint64_t bits = 0;
+                    for (std::size_t r = 0; r < records; ++r, base += stride) {
+                        const bool matched = (*this)(base);
+                        bits |= static_cast<std::uint64_t>(matched) << r;
+                        matches += matched;
+                    }
+                    bitmap[i / 64] = bits;
+                }
+                return matches;
+            }
+
+            /// Returns the mask applied to protocol word i
+            constexpr ptl::word_type mask(const std::size_t i) const noexcept {
+                return mask_[i];
+            }
+
+            /// Returns the value masked protocol word i is compared to
+            constexpr ptl::word_type value(const std::size_t i) const noexcept {
+                return value_[i];
+            }
+
+        private:
+
+            constexpr match() noexcept : mask_{}, value_{}, impossible_(0) {}
+
+            typename words::array_type mask_;
+            typename words::array_type value_;
+            ptl::word_type impossible_;
+    };
+}
+
+#endif
@@ -0,0 +1,387 @@
+#ifndef PTL_PACKED_VECTOR_HPP
+#define PTL_PACKED_VECTOR_HPP
+
+#include <cstdint>
+#include <iterator>
+#include <utility>
+#include <vector>
+#include "ptl.hpp"
+
+namespace ptl
+{
+    /** A vector of a field's values stored at exactly the field's bits each
+	 *
+	 *  Elements are stored back to back starting from the most
+	 *  significant bit of the first word, as a protocol's fields are,
+	 *  so a vector of 13 bit PIDs takes 13 bits per PID.  An element
+	 *  is read with at most two word loads, one shift and one mask.
+	 *
+	 *  Blocks of block_size elements are a whole number of words, so
+	 *  every element's offset in a block is a compile time constant.
+	 *  unpack and pack convert whole blocks with straight line code
+	 *  of constant shifts, which the compiler can vectorize.
+	 *
+	 *  Elements are stored as values, regardless of the field's byte
+	 *  order.  Iterators are read only, elements are written with set
+	 *  or pack.
+	 *
+	 *  @tparam Field The ptl::field of the elements
+	 */
+    template <class Field>
+    class packed_vector
+    {
+        public:
+
+            static_assert(Field::bits > 0 && Field::bits <= ptl::word_bits,
+                          "The field's bits must be between 1 and 64");
+
+            using field_type = Field;
+            using value_type = typename Field::value_type;
+            using size_type = std::size_t;
+
+            /// Number of bits per element
+            static constexpr std::size_t bits = Field::bits;
+
+            /// Number of elements in a block of bits words
+            static constexpr std::size_t block_size = ptl::word_bits;
+
+            class const_iterator;
+            using iterator = const_iterator;
+
+            /// Creates an empty vector
+            packed_vector() : words_(1, 0), size_(0) {}
+
+            /// Creates a vector of count elements of value
+            explicit packed_vector(const size_type count, const value_type value = value_type());
+
+            /// Returns element i
+            value_type get(const size_type i) const noexcept;
+
+            /// Sets element i to value
+            /**
+             *  Bits of value beyond the field's bits are discarded.
+             */
+            void set(const size_type i, const value_type value) noexcept;
+
+            /// Returns element i
+            value_type operator[](const size_type i) const noexcept {
+                return get(i);
+            }
+
+            /// Unpacks count elements starting at first into out
+            void unpack(const size_type first, const size_type count, value_type * const out) const noexcept;
+
+            /// Packs count elements starting at first from in
+            void pack(const size_type first, const size_type count, value_type const * const in) noexcept;
+
+            /// Appends value
+            void push_back(const value_type value);
+
+            /// Resizes the vector to count elements, new elements are value
+            void resize(const size_type count, const value_type value = value_type());
+
+            /// Reserves storage for count elements
+            void reserve(const size_type count) {
+                words_.reserve(words_for(count));
+            }
+
+            /// Removes every element
+            void clear() noexcept {
+                words_.assign(1, 0);
+                size_ = 0;
+            }
+
+            /// Returns the number of elements
+            size_type size() const noexcept {
+                return size_;
+            }
+
+            /// Returns true if there are no elements
+            bool empty() const noexcept {
+                return size_ == 0;
+            }
+
+            /// Returns the number of elements the storage holds
+            size_type capacity() const noexcept {
+                return (words_.capacity() - 1) * ptl::word_bits / bits;
+            }
+
+            /// Returns the number of bytes storing the elements
+            std::size_t bytes() const noexcept {
+                return words_.size() * sizeof(ptl::word_type);
+            }
+
+            /// Returns the words storing the elements
+            ptl::word_type const * data() const noexcept {
+                return words_.data();
+            }
+
+            const_iterator begin() const noexcept {
+                return const_iterator(this, 0);
+            }
+
+            const_iterator end() const noexcept {
+                return const_iterator(this, size_);
+            }
+
+            const_iterator cbegin() const noexcept {
+                return begin();
+            }
+
+            const_iterator cend() const noexcept {
+                return end();
+            }
+
+        private:
+
+            // Mask of the field's bits aligned to a word's most significant bit
+            static constexpr ptl::word_type value_mask = ptl::msb_mask<ptl::word_type>(bits, 0);
+
+            // Returns the words storing count elements, and one more so
+            // an element is always read with two loads
+            static std::size_t words_for(const size_type count) noexcept {
+                return (count * bits + ptl::word_bits - 1) / ptl::word_bits + 1;
+            }
+
+            // Returns the element at bit offset of words
+            static value_type read(ptl::word_type const * const words, const std::size_t offset) noexcept {
+                const std::size_t w = offset / ptl::word_bits;
+                const std::size_t s = offset % ptl::word_bits;
+                // The second word's shift is split so s == 0 shifts out every bit
+                const ptl::word_type v = (words[w] << s) | ((words[w + 1] >> 1) >> (ptl::word_bits - 1 - s));
+                return static_cast<value_type>(v >> (ptl::word_bits - bits));
+            }
+
+            template <std::size_t... J>
+            static void unpack_block(ptl::word_type const * const words,
+                                     value_type * const out,
+                                     std::index_sequence<J...>) noexcept {
+                const int expand[] = { (out[J] = read(words, J * bits), 0)... };
+                (void)expand;
+            }
+
+            template <std::size_t... J>
+            static void pack_block(ptl::word_type * const words,
+                                   value_type const * const in,
+                                   std::index_sequence<J...>) noexcept;
+
+            std::vector<ptl::word_type> words_;
+            size_type size_;
+    };
+
+    /// A read only random access iterator of a ptl::packed_vector
+    template <class Field>
+    class packed_vector<Field>::const_iterator
+    {
+        public:
+
+            using iterator_category = std::random_access_iterator_tag;
+            using value_type = typename packed_vector<Field>::value_type;
+            using difference_type = std::ptrdiff_t;
+            using pointer = void;
+            using reference = value_type;
+
+            const_iterator() noexcept : vector_(nullptr), i_(0) {}
+
+            const_iterator(packed_vector const * const vector, const size_type i) noexcept :
+                vector_(vector),
+                i_(i)
+            {}
+
+            value_type operator*() const noexcept {
+                return vector_->get(i_);
+            }
+
+            value_type operator[](const difference_type n) const noexcept {
+                return vector_->get(i_ + n);
+            }
+
+            const_iterator & operator++() noexcept {
+                ++i_;
+                return *this;
+            }
+
+            const_iterator operator++(int) noexcept {
+                const_iterator previous = *this;
+                ++i_;
+                return previous;
+            }
+
+            const_iterator & operator--() noexcept {
+                --i_;
+                return *this;
+            }
+
+            const_iterator operator--(int) noexcept {
+                const_iterator previous = *this;
+                --i_;
+                return previous;
+            }
+
+            const_iterator & operator+=(const difference_type n) noexcept {
+                i_ += n;
+                return *this;
+            }
+
+            const_iterator & operator-=(const difference_type n) noexcept {
+                i_ -= n;
+                return *this;
+            }
+
+            const_iterator operator+(const difference_type n) const noexcept {
+                return const_iterator(vector_, i_ + n);
+            }
+
+            const_iterator operator-(const difference_type n) const noexcept {
+                return const_iterator(vector_, i_ - n);
+            }
+
+            difference_type operator-(const_iterator const & other) const noexcept {
+                return static_cast<difference_type>(i_) - static_cast<difference_type>(other.i_);
+            }
+
+            bool operator==(const_iterator const & other) const noexcept {
+                return i_ == other.i_;
+            }
+
+            bool operator!=(const_iterator const & other) const noexcept {
+                return i_ != other.i_;
+            }
+
+            bool operator<(const_iterator const & other) const noexcept {
+                return i_ < other.i_;
+            }
+
+            bool operator>(const_iterator const & other) const noexcept {
+                return i_ > other.i_;
+            }
+
+            bool operator<=(const_iterator const & other) const noexcept {
+                return i_ <= other.i_;
+            }
+
+            bool operator>=(const_iterator const & other) const noexcept {
+                return i_ >= other.i_;
+            }
+
+        private:
+
+            packed_vector const * vector_;
+            size_type i_;
+    };
+
+    template <class Field>
+    packed_vector<Field>::packed_vector(const size_type count, const value_type value) :
+        words_(1, 0),
+        size_(0)
+    {
+        resize(count, value);
+    }
+
+    template <class Field>
+    typename packed_vector<Field>::value_type packed_vector<Field>::get(const size_type i) const noexcept
+    {
+        return read(words_.data(), i * bits);
+    }
+
+    template <class Field>
+    void packed_vector<Field>::set(const size_type i, const value_type value) noexcept
+    {
+        const std::size_t offset = i * bits;
+        const std::size_t w = offset / ptl::word_bits;
+        const std::size_t s = offset % ptl::word_bits;
+        const ptl::word_type aligned = (static_cast<ptl::word_type>(value) << (ptl::word_bits - bits)) & value_mask;
+        words_[w] = (words_[w] & ~(value_mask >> s)) | (aligned >> s);
+        if (s + bits > ptl::word_bits) {
+            // The element's last bits start the next word
+            const std::size_t rest = s + bits - ptl::word_bits;
+            words_[w + 1] = (words_[w + 1] & (~static_cast<ptl::word_type>(0) >> rest)) |
+                (aligned << (bits - rest));
+        }
+    }
+
+    template <class Field>
+    template <std::size_t... J>
+    void packed_vector<Field>::pack_block(ptl::word_type * const words,
+                                          value_type const * const in,
+                                          std::index_sequence<J...>) noexcept
+    {
+        // A block's words only hold the block's elements, so they're
+        // built from zero without reading them
+        ptl::word_type block[bits + 1] = {};
+        const int expand[] = {
+            (block[J * bits / ptl::word_bits] |=
+             ((static_cast<ptl::word_type>(in[J]) << (ptl::word_bits - bits)) & value_mask) >> (J * bits % ptl::word_bits),
+             block[J * bits / ptl::word_bits + 1] |=
+             (((static_cast<ptl::word_type>(in[J]) << (ptl::word_bits - bits)) & value_mask) << 1) <<
+             (ptl::word_bits - 1 - J * bits % ptl::word_bits), 0)...
+        };
+        (void)expand;
+        for (std::size_t w = 0; w < bits; ++w) {
+            words[w] = block[w];
+        }
+    }
+
+    template <class Field>
+    void packed_vector<Field>::unpack(const size_type first, const size_type count, value_type * out) const noexcept
+    {
+        size_type i = first;
+        const size_type last = first + count;
+        for (; i < last && i % block_size != 0; ++i) {
+            *out++ = get(i);
+        }
+        for (; i + block_size <= last; i += block_size, out += block_size) {
+            unpack_block(words_.data() + i / block_size * bits, out, std::make_index_sequence<block_size>());
+        }
+        for (; i < last; ++i) {
+            *out++ = get(i);
+        }
+    }
+
+    template <class Field>
+    void packed_vector<Field>::pack(const size_type first, const size_type count, value_type const * in) noexcept
+    {
+        size_type i = first;
+        const size_type last = first + count;
+        for (; i < last && i % block_size != 0; ++i) {
+            set(i, *in++);
+        }
+        for (; i + block_size <= last; i += block_size, in += block_size) {
+            pack_block(words_.data() + i / block_size * bits, in, std::make_index_sequence<block_size>());
+        }
+        for (; i < last; ++i) {
+            set(i, *in++);
+        }
+    }
+
+    template <class Field>
+    void packed_vector<Field>::push_back(const value_type value)
+    {
+        const std::size_t words = words_for(size_ + 1);
+        if (words > words_.size()) {
+            words_.resize(words, 0);
+        }
+        set(size_++, value);
+    }
+
+    template <class Field>
+    void packed_vector<Field>::resize(const size_type count, const value_type value)
+    {
+        if (count < size_) {
+            // Clears the removed elements' bits, so appended elements
+            // and their padding start from zero
+            for (size_type i = count; i < size_; ++i) {
+                set(i, value_type());
+            }
+            size_ = count;
+            words_.resize(words_for(count));
+            return;
+        }
+        words_.resize(words_for(count), 0);
+        for (; size_ < count; ++size_) {
+            set(size_, value);
+        }
+    }
+}
+
+#endif
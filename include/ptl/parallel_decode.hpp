@@ -0,0 +1,230 @@
+#ifndef PTL_PARALLEL_DECODE_HPP
+#define PTL_PARALLEL_DECODE_HPP
+
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace ptl
+{
+    namespace detail
+    {
+        /// A worker's range of chunks
+        struct chunk_range
+        {
+                std::mutex mutex;
+                std::size_t next;
+                std::size_t end;
+                // Keeps neighbouring ranges off of each other's cache lines
+                char padding[64];
+        };
+
+        /// A chunk's Result, padded so neighbouring Results never
+        /// share a cache line, or a word as std::vector<bool>'s would
+        template <class Result>
+        struct chunk_result
+        {
+                Result value;
+                char padding[64];
+        };
+
+        /** Takes the next chunk of a worker's range, or steals the
+	 *  last chunk of another worker's range
+	 *
+	 *  @return False if every range is empty
+	 */
+        inline bool take_chunk(ptl::detail::chunk_range * const ranges,
+                               const std::size_t workers,
+                               const std::size_t self,
+                               std::size_t & chunk)
+        {
+            {
+                std::lock_guard<std::mutex> lock(ranges[self].mutex);
+                if (ranges[self].next < ranges[self].end) {
+                    chunk = ranges[self].next++;
+                    return true;
+                }
+            }
+            for (std::size_t i = 1; i < workers; ++i) {
+                ptl::detail::chunk_range & victim = ranges[(self + i) % workers];
+                std::lock_guard<std::mutex> lock(victim.mutex);
+                if (victim.next < victim.end) {
+                    chunk = --victim.end;
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        /** Calls decode_chunk for each of count records' chunks on threads workers
+	 *
+	 *  Each worker starts with a contiguous range of chunks, and
+	 *  steals from the end of other workers' ranges once its own
+	 *  range is empty.  Each chunk is decoded into its own Result,
+	 *  and the Results are merged in chunk order.
+	 */
+        template <class Result, class Decode_Chunk, class Merge>
+        Result parallel_chunks(const std::size_t count,
+                               std::size_t threads,
+                               Decode_Chunk decode_chunk,
+                               Merge merge)
+        {
+            static constexpr std::size_t chunks_per_thread = 16;
+
+            if (threads == 0) {
+                threads = std::thread::hardware_concurrency();
+                threads = threads == 0 ? 1 : threads;
+            }
+
+            std::size_t chunks = threads * chunks_per_thread;
+            chunks = chunks < count ? chunks : count;
+            chunks = chunks == 0 ? 1 : chunks;
+            threads = threads < chunks ? threads : chunks;
+            const std::size_t chunk_records = (count + chunks - 1) / chunks;
+            chunks = count == 0 ? 1 : (count + chunk_records - 1) / chunk_records;
+
+            std::unique_ptr<ptl::detail::chunk_result<Result>[]> results(
+                new ptl::detail::chunk_result<Result>[chunks]());
+            std::unique_ptr<ptl::detail::chunk_range[]> ranges(new ptl::detail::chunk_range[threads]);
+            for (std::size_t t = 0; t < threads; ++t) {
+                ranges[t].next = chunks * t / threads;
+                ranges[t].end = chunks * (t + 1) / threads;
+            }
+
+            std::exception_ptr error;
+            std::mutex error_mutex;
+            auto work = [&](const std::size_t self) {
+                std::size_t chunk;
+                while (ptl::detail::take_chunk(ranges.get(), threads, self, chunk)) {
+                    const std::size_t begin = chunk * chunk_records;
+                    const std::size_t end = begin + chunk_records < count ? begin + chunk_records : count;
+                    try {
+                        // Decoded into a local, as the padded results are
+                        // only written once
+                        Result result{};
+                        decode_chunk(result, begin, end);
+                        results[chunk].value = std::move(result);
+                    } catch (...) {
+                        std::lock_guard<std::mutex> lock(error_mutex);
+                        if (!error) {
+                            error = std::current_exception();
+                        }
+                        // Empty every range so the other workers stop
+                        for (std::size_t t = 0; t < threads; ++t) {
+                            std::lock_guard<std::mutex> range_lock(ranges[t].mutex);
+                            ranges[t].end = ranges[t].next;
+                        }
+                    }
+                }
+            };
+
+            std::vector<std::thread> workers;
+            workers.reserve(threads - 1);
+            for (std::size_t t = 1; t < threads; ++t) {
+                try {
+                    workers.emplace_back(work, t);
+                } catch (std::system_error const &) {
+                    // The ranges of threads that couldn't be started
+                    // are stolen by the started threads
+                    break;
+                }
+            }
+            try {
+                work(0);
+            } catch (...) {
+                // Joinable threads can't be destroyed
+                for (auto & worker : workers) {
+                    worker.join();
+                }
+                throw;
+            }
+            for (auto & worker : workers) {
+                worker.join();
+            }
+
+            if (error) {
+                std::rethrow_exception(error);
+            }
+
+            Result result = std::move(results[0].value);
+            for (std::size_t c = 1; c < chunks; ++c) {
+                merge(result, std::move(results[c].value));
+            }
+            return result;
+        }
+    }
+
+    /** Decodes fixed stride records on multiple threads
+	 *
+	 *  The records are split into chunks that are decoded by a work
+	 *  stealing pool of threads.  visit is called with each chunk's
+	 *  Result and each of the chunk's records, and the chunks'
+	 *  Results are merged in record order, so the merged Result
+	 *  doesn't depend on the number of threads or their scheduling
+	 *  as long as merge is associative.
+	 *
+	 *  visit is called concurrently from multiple threads, and merge
+	 *  from the calling thread.  An exception thrown by visit stops
+	 *  the decoding and is rethrown.
+	 *
+	 *  @tparam Result Default constructible type of a chunk's result
+	 *  @param base First record's protocol buffer.
+	 *  @param stride Number of bytes between records.
+	 *  @param count Number of records.
+	 *  @param visit Called as visit(Result &, unsigned char const * record).
+	 *  @param merge Called as merge(Result & result, Result && next) to
+	 *  append the next chunk's Result to result.
+	 *  @param threads Number of threads, or 0 for the hardware's.
+	 *  @return The merged Result.
+	 */
+    template <class Result, class Visitor, class Merge>
+    Result parallel_decode(unsigned char const * const base,
+                           const std::size_t stride,
+                           const std::size_t count,
+                           Visitor visit,
+                           Merge merge,
+                           const std::size_t threads = 0)
+    {
+        return ptl::detail::parallel_chunks<Result>(
+            count, threads,
+            [base, stride, &visit](Result & result, const std::size_t begin, const std::size_t end) {
+                unsigned char const * record = base + begin * stride;
+                for (std::size_t r = begin; r < end; ++r, record += stride) {
+                    visit(result, record);
+                }
+            },
+            merge);
+    }
+
+    /** Decodes framed records on multiple threads
+	 *
+	 *  The same as the fixed stride parallel_decode, for records
+	 *  whose positions were found by framing a stream, such as the
+	 *  packets yielded by ptl::ts_framer or ptl::capture_reader.
+	 *
+	 *  @param records Array of count pointers to records' protocol buffers.
+	 */
+    template <class Result, class Visitor, class Merge>
+    Result parallel_decode(unsigned char const * const * const records,
+                           const std::size_t count,
+                           Visitor visit,
+                           Merge merge,
+                           const std::size_t threads = 0)
+    {
+        return ptl::detail::parallel_chunks<Result>(
+            count, threads,
+            [records, &visit](Result & result, const std::size_t begin, const std::size_t end) {
+                for (std::size_t r = begin; r < end; ++r) {
+                    visit(result, records[r]);
+                }
+            },
+            merge);
+    }
+}
+
+#endif
@@ -0,0 +1,255 @@
+#ifndef PTL_SEGMENTED_HEADER_HPP
+#define PTL_SEGMENTED_HEADER_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <tuple>
+#include <utility>
+#include <sys/uio.h>
+#include "ptl.hpp"
+
+namespace ptl
+{
+    /** A protocol header whose bytes may be split across segments
+	 *
+	 *  Provides a protocol's accessors over a header in chained
+	 *  buffers, such as iovecs, a ring buffer that wraps around or
+	 *  fragmented reads, without copying the header first.
+	 *
+	 *  The header's first two segments are found when the header is
+	 *  created.  A header within one segment is accessed with
+	 *  Protocol::field_value.  Otherwise each field is read from
+	 *  whichever of them holds all of its bytes, decided from
+	 *  ptl::field_first_byte and ptl::field_last_byte, through the
+	 *  same accessor Protocol::field_value uses.  Only fields that
+	 *  straddle a boundary are assembled from their bytes.
+	 *
+	 *  Bytes past the end of the segments read as zero, and writes to
+	 *  them are dropped; complete() is false for such headers.
+	 *
+	 *  @tparam Protocol The ptl::protocol of the header
+	 */
+    template <class Protocol>
+    class segmented_header
+    {
+        public:
+
+            using tuple_type = typename Protocol::tuple_type;
+            using value_tuple = typename Protocol::value_tuple;
+
+            /// Number of bytes in the header
+            static constexpr std::size_t bytes = Protocol::traits::bytes;
+
+            /// Finds a header at offset bytes into segments
+            /**
+             *  @param segments The segments, which must outlive the header.
+             *  @param count The number of segments.
+             *  @param offset The header's byte offset in the segments.
+             */
+            segmented_header(struct iovec const * const segments,
+                             const std::size_t count,
+                             std::size_t offset = 0) noexcept;
+
+            /// Returns true if the segments hold every byte of the header
+            bool complete() const noexcept {
+                return available_ == bytes;
+            }
+
+            /// Returns true if the header is within one segment
+            bool contiguous() const noexcept {
+                return first_bytes_ == bytes;
+            }
+
+            /// Returns the value of field I
+            template <std::size_t I>
+            ptl::field_type<I, tuple_type> field_value() const noexcept;
+
+            /// Sets the value of field I
+            template <std::size_t I>
+            void field_value(const ptl::field_type<I, tuple_type> value) const noexcept;
+
+            /// Returns the values of all of the header's fields
+            /**
+             *  A contiguous header is unpacked with Protocol::unpack,
+             *  otherwise each field is read with field_value.
+             */
+            value_tuple unpack() const noexcept;
+
+            /// Copies the header's bytes to out
+            void gather(unsigned char * const out) const noexcept {
+                copy(0, bytes, out);
+            }
+
+        private:
+
+            template <std::size_t I>
+            using accessor = ptl::field_accessor<typename ptl::field_element<I, tuple_type>::type,
+                                                 ptl::field_byte_offset(ptl::field_bit_offset<I, tuple_type>::value)>;
+
+            // Returns the bytes of a field at pos if they're within
+            // one of the first two segments, nullptr otherwise
+            unsigned char * find(const std::size_t pos, const std::size_t size) const noexcept {
+                if (pos + size <= first_bytes_) {
+                    return first_ + pos;
+                }
+                if (pos >= first_bytes_ && pos + size <= first_bytes_ + second_bytes_) {
+                    return second_ + (pos - first_bytes_);
+                }
+                return nullptr;
+            }
+
+            // Copies size bytes at pos to out, zero filled past the segments
+            void copy(std::size_t pos, std::size_t size, unsigned char * out) const noexcept;
+
+            // Assembles a field's size bytes at pos, which don't fit in one segment
+            void assemble(const std::size_t pos, const std::size_t size, unsigned char * const out) const noexcept {
+                // Fields straddling the first two segments are the common case
+                if (pos < first_bytes_ && pos + size <= first_bytes_ + second_bytes_) {
+                    std::memcpy(out, first_ + pos, first_bytes_ - pos);
+                    std::memcpy(out + (first_bytes_ - pos), second_, pos + size - first_bytes_);
+                } else {
+                    copy(pos, size, out);
+                }
+            }
+
+            // Copies size bytes from in to pos, dropping bytes past the segments
+            void scatter(std::size_t pos, std::size_t size, unsigned char const * in) const noexcept;
+
+            template <std::size_t... I>
+            value_tuple unpack_fields(std::index_sequence<I...>) const noexcept {
+                return value_tuple(field_value<I>()...);
+            }
+
+            struct iovec const * segment_;
+            struct iovec const * end_;
+            // The header's offset in its first segment
+            std::size_t start_;
+            unsigned char * first_;
+            std::size_t first_bytes_;
+            unsigned char * second_;
+            std::size_t second_bytes_;
+            std::size_t available_;
+    };
+
+    template <class Protocol>
+    segmented_header<Protocol>::segmented_header(struct iovec const * const segments,
+                                                 const std::size_t count,
+                                                 std::size_t offset) noexcept :
+        segment_(segments),
+        end_(segments + count),
+        start_(0),
+        first_(nullptr),
+        first_bytes_(0),
+        second_(nullptr),
+        second_bytes_(0),
+        available_(0)
+    {
+        // Empty segments and the segments before the header are skipped
+        while (segment_ != end_ && offset >= segment_->iov_len) {
+            offset -= segment_->iov_len;
+            ++segment_;
+        }
+        if (segment_ == end_) {
+            return;
+        }
+        start_ = offset;
+        first_ = static_cast<unsigned char *>(segment_->iov_base) + offset;
+        first_bytes_ = segment_->iov_len - offset < bytes ? segment_->iov_len - offset : bytes;
+        available_ = first_bytes_;
+
+        for (struct iovec const * s = segment_ + 1; s != end_ && available_ < bytes; ++s) {
+            const std::size_t taken = s->iov_len < bytes - available_ ? s->iov_len : bytes - available_;
+            if (second_ == nullptr && taken > 0) {
+                second_ = static_cast<unsigned char *>(s->iov_base);
+                second_bytes_ = taken;
+            }
+            available_ += taken;
+        }
+    }
+
+    template <class Protocol>
+    template <std::size_t I>
+    ptl::field_type<I, typename Protocol::tuple_type> segmented_header<Protocol>::field_value() const noexcept
+    {
+        static constexpr std::size_t first = ptl::field_first_byte<I, tuple_type>::value;
+        static constexpr std::size_t size = ptl::field_last_byte<I, tuple_type>::value - first + 1;
+        if (contiguous()) {
+            return Protocol::template field_value<I>(first_);
+        }
+        unsigned char const * const field = find(first, size);
+        if (field != nullptr) {
+            return accessor<I>::get(field);
+        }
+        unsigned char assembled[size];
+        assemble(first, size, assembled);
+        return accessor<I>::get(assembled);
+    }
+
+    template <class Protocol>
+    template <std::size_t I>
+    void segmented_header<Protocol>::field_value(const ptl::field_type<I, tuple_type> value) const noexcept
+    {
+        static constexpr std::size_t first = ptl::field_first_byte<I, tuple_type>::value;
+        static constexpr std::size_t size = ptl::field_last_byte<I, tuple_type>::value - first + 1;
+        if (contiguous()) {
+            Protocol::template field_value<I>(first_, value);
+            return;
+        }
+        unsigned char * const field = find(first, size);
+        if (field != nullptr) {
+            accessor<I>::set(field, value);
+            return;
+        }
+        // The field's first and last bytes may hold other fields' bits
+        unsigned char assembled[size];
+        assemble(first, size, assembled);
+        accessor<I>::set(assembled, value);
+        scatter(first, size, assembled);
+    }
+
+    template <class Protocol>
+    typename Protocol::value_tuple segmented_header<Protocol>::unpack() const noexcept
+    {
+        if (contiguous()) {
+            return Protocol::unpack(first_);
+        }
+        return unpack_fields(std::make_index_sequence<Protocol::traits::fields>());
+    }
+
+    template <class Protocol>
+    void segmented_header<Protocol>::copy(std::size_t pos, std::size_t size, unsigned char * out) const noexcept
+    {
+        std::size_t skip = start_ + pos;
+        for (struct iovec const * s = segment_; s != end_ && size > 0; ++s) {
+            if (skip >= s->iov_len) {
+                skip -= s->iov_len;
+                continue;
+            }
+            const std::size_t taken = s->iov_len - skip < size ? s->iov_len - skip : size;
+            std::memcpy(out, static_cast<unsigned char const *>(s->iov_base) + skip, taken);
+            out += taken;
+            size -= taken;
+            skip = 0;
+        }
+        std::memset(out, 0, size);
+    }
+
+    template <class Protocol>
+    void segmented_header<Protocol>::scatter(std::size_t pos, std::size_t size, unsigned char const * in) const noexcept
+    {
+        std::size_t skip = start_ + pos;
+        for (struct iovec const * s = segment_; s != end_ && size > 0; ++s) {
+            if (skip >= s->iov_len) {
+                skip -= s->iov_len;
+                continue;
+            }
+            const std::size_t taken = s->iov_len - skip < size ? s->iov_len - skip : size;
+            std::memcpy(static_cast<unsigned char *>(s->iov_base) + skip, in, taken);
+            in += taken;
+            size -= taken;
+            skip = 0;
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,497 @@
+#ifndef PTL_SEQUENCE_TRACKER_HPP
+#define PTL_SEQUENCE_TRACKER_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <vector>
+#include "ptl.hpp"
+
+namespace ptl
+{
+    /// A stream's sequence statistics
+    struct sequence_stats
+    {
+            /// Number of packets received, including duplicates
+            std::uint64_t received;
+            /// Number of sequence numbers not received
+            std::uint64_t lost;
+            /// Number of packets whose sequence number was already received
+            std::uint64_t duplicates;
+            /// Number of packets received after a later sequence number
+            std::uint64_t reordered;
+            /// Number of packets too far behind the highest sequence
+            /// number to tell a duplicate from a reordered packet
+            std::uint64_t late;
+            /// Most sequence numbers a reordered packet arrived behind
+            std::uint64_t max_reorder_depth;
+            /// Number of times the sequence number wrapped around
+            std::uint64_t wraps;
+    };
+
+    namespace detail
+    {
+        /// A stream's state in a sequence_tracker's table, one cache line
+        struct sequence_entry
+        {
+                std::atomic<std::uint64_t> key;
+                // Extended sequence numbers, which start a cycle above
+                // the first sequence number so they can move back
+                std::atomic<std::uint64_t> base;
+                std::atomic<std::uint64_t> highest;
+                // Bit i is set if highest - i was received
+                std::atomic<std::uint64_t> window;
+                std::atomic<std::uint64_t> received;
+                std::atomic<std::uint64_t> duplicates;
+                std::atomic<std::uint64_t> reordered;
+                std::atomic<std::uint32_t> late;
+                // Less than the window's 64 bits
+                std::atomic<std::uint16_t> max_reorder_depth;
+                std::atomic<std::uint16_t> used;
+        };
+
+        static_assert(sizeof(sequence_entry) == 64,
+                      "A sequence entry must fit in a cache line");
+
+        // Adds value to an atomic only written by the calling thread
+        template <class T>
+        inline void add_relaxed(std::atomic<T> & counter, const T value) noexcept
+        {
+            counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+        }
+    }
+
+    /** Tracks the loss, duplication and reordering of many streams' packets
+	 *
+	 *  Streams are keyed by a protocol field, such as an RTP SSRC or
+	 *  a transport stream PID, and sequenced by another, such as the
+	 *  RTP sequence number or the continuity counter.  Each stream's
+	 *  state is a cache line in an open addressing table, which
+	 *  remembers the 64 sequence numbers below the highest received.
+	 *  Packets further behind are counted as late.
+	 *
+	 *  The tracker has a table per shard, each updated by a single
+	 *  thread, such as a core's receive thread, without locks.  A
+	 *  stream is tracked by the first shard that updates it, as its
+	 *  sequence numbers can't be merged across shards, so each stream
+	 *  should be updated by one shard, such as the receive queue its
+	 *  flow is hashed to.  Its packets updated by other shards are
+	 *  counted by untracked().  stats() may be called from any thread
+	 *  while the shards are updated.
+	 *
+	 *  A shard's table has a fixed capacity, so it's never moved
+	 *  while it's read.  Streams beyond the capacity aren't tracked,
+	 *  and their packets are counted by untracked().
+	 *
+	 *  @tparam Protocol The ptl::protocol of the packets' header
+	 *  @tparam Key_Field Order number of the field that identifies a stream
+	 *  @tparam Sequence_Field Order number of the sequence number field
+	 */
+    template <class Protocol, std::size_t Key_Field, std::size_t Sequence_Field>
+    class sequence_tracker
+    {
+        private:
+
+            using tuple_type = typename Protocol::tuple_type;
+
+            static constexpr std::size_t sequence_bits = ptl::field_bits<Sequence_Field, tuple_type>::value;
+
+        public:
+
+            static_assert(sequence_bits < ptl::word_bits,
+                          "The sequence number must be narrower than a word");
+
+            using key_type = ptl::field_type<Key_Field, tuple_type>;
+            using sequence_type = ptl::field_type<Sequence_Field, tuple_type>;
+
+            /// Number of packets ahead of the current packet whose table entries are prefetched
+            static constexpr std::size_t batch_size = 16;
+
+            /// Creates a tracker of shards tables of at least streams streams each
+            /**
+             *  @throw std::invalid_argument If shards is 0.
+             */
+            sequence_tracker(const std::size_t shards, const std::size_t streams);
+
+            /// Updates a stream's state with a received sequence number
+            /**
+             *  Called by the shard's thread.
+             */
+            void update(const std::size_t shard, const key_type key, const sequence_type sequence) noexcept;
+
+            /// Updates a stream's state from a packet's header
+            void update(const std::size_t shard, unsigned char const * const header) noexcept {
+                update(shard,
+                       Protocol::template field_value<Key_Field>(header),
+                       Protocol::template field_value<Sequence_Field>(header));
+            }
+
+            /// Updates a stream's state from an unpacked header
+            void update(const std::size_t shard, typename Protocol::value_tuple const & values) noexcept {
+                update(shard, std::get<Key_Field>(values), std::get<Sequence_Field>(values));
+            }
+
+            /// Updates count streams' states from keys and sequence numbers
+            /**
+             *  Each key's table entry is prefetched batch_size keys
+             *  before it's updated, so the table's cache misses
+             *  overlap.  The arrays can be filled by Protocol::extract.
+             */
+            void update(const std::size_t shard,
+                        key_type const * const keys,
+                        sequence_type const * const sequences,
+                        const std::size_t count) noexcept;
+
+            /// Updates count streams' states from headers stride bytes apart
+            void update(const std::size_t shard,
+                        unsigned char const * const headers,
+                        const std::size_t stride,
+                        const std::size_t count) noexcept;
+
+            /// Returns a stream's statistics from the shard that tracks it
+            /**
+             *  While the stream is updated the statistics may be off
+             *  by the packets being counted.
+             *
+             *  @return All zero statistics if the stream isn't tracked.
+             */
+            ptl::sequence_stats stats(const key_type key) const noexcept;
+
+            /// Calls visit(key, stats) for each stream a shard tracks
+            template <class Visitor>
+            void for_each(const std::size_t shard, Visitor && visit) const;
+
+            /// Returns the number of shards
+            std::size_t shards() const noexcept {
+                return shards_.size();
+            }
+
+            /// Returns the number of streams a shard's table holds
+            std::size_t capacity() const noexcept {
+                return max_streams_;
+            }
+
+            /// Returns the number of streams a shard tracks
+            std::size_t streams(const std::size_t shard) const noexcept {
+                return shards_[shard]->streams.load(std::memory_order_relaxed);
+            }
+
+            /// Returns the number of packets of streams that didn't fit in
+            /// their shard or are tracked by another shard
+            std::uint64_t untracked() const noexcept;
+
+        private:
+
+            static constexpr std::uint64_t modulus = static_cast<std::uint64_t>(1) << sequence_bits;
+            static constexpr std::size_t window_bits = 64;
+
+            struct shard_table
+            {
+                    // Entries aligned to cache lines in storage
+                    std::unique_ptr<unsigned char[]> storage;
+                    ptl::detail::sequence_entry * entries;
+                    std::atomic<std::size_t> streams;
+                    std::atomic<std::uint64_t> untracked;
+                    // Keeps neighbouring shards off of each other's cache lines
+                    char padding[64];
+            };
+
+            std::size_t slot(const key_type key) const noexcept {
+                // Fibonacci hashing spreads sequential keys, such as PIDs
+                return static_cast<std::size_t>((static_cast<std::uint64_t>(key) * 0x9e3779b97f4a7c15ull) >> shift_);
+            }
+
+            // Prefetches key's first entry in table for writing
+            void prefetch(shard_table const & table, const key_type key) const noexcept {
+#if defined(__GNUC__)
+                __builtin_prefetch(table.entries + slot(key), 1);
+#else
+                (void)table;
+                (void)key;
+#endif
+            }
+
+            // Returns key's entry in table, adding it if there's room
+            ptl::detail::sequence_entry * find_or_add(shard_table & table, const key_type key) noexcept;
+
+            // Returns key's entry in table or nullptr
+            ptl::detail::sequence_entry const * find(shard_table const & table, const key_type key) const noexcept;
+
+            // Returns a published entry's statistics
+            static ptl::sequence_stats entry_stats(ptl::detail::sequence_entry const & entry) noexcept;
+
+            std::vector<std::unique_ptr<shard_table>> shards_;
+            std::size_t mask_;
+            std::size_t shift_;
+            std::size_t max_streams_;
+    };
+
+    template <class Protocol, std::size_t Key_Field, std::size_t Sequence_Field>
+    sequence_tracker<Protocol, Key_Field, Sequence_Field>::sequence_tracker(const std::size_t shards,
+                                                                            const std::size_t streams)
+    {
+        if (shards == 0) {
+            throw std::invalid_argument("A sequence tracker must have at least one shard");
+        }
+
+        // At most three quarters full, so probes stay short
+        std::size_t capacity = 2;
+        std::size_t bits = 1;
+        while (capacity / 4 * 3 < streams) {
+            capacity <<= 1;
+            ++bits;
+        }
+        mask_ = capacity - 1;
+        shift_ = ptl::word_bits - bits;
+        max_streams_ = capacity / 4 * 3;
+        if (max_streams_ == 0) {
+            max_streams_ = 1;
+        }
+
+        static constexpr std::size_t line = sizeof(ptl::detail::sequence_entry);
+        shards_.reserve(shards);
+        for (std::size_t s = 0; s < shards; ++s) {
+            std::unique_ptr<shard_table> table(new shard_table);
+            table->storage.reset(new unsigned char[capacity * line + line]);
+            const std::uintptr_t address = reinterpret_cast<std::uintptr_t>(table->storage.get());
+            table->entries = reinterpret_cast<ptl::detail::sequence_entry *>(
+                table->storage.get() + (line - address % line) % line);
+            // Every field is initialised, as a reader may load any of
+            // them while the entry is being added
+            for (std::size_t i = 0; i < capacity; ++i) {
+                ptl::detail::sequence_entry * const entry = new (table->entries + i) ptl::detail::sequence_entry;
+                entry->key.store(0, std::memory_order_relaxed);
+                entry->base.store(0, std::memory_order_relaxed);
+                entry->highest.store(0, std::memory_order_relaxed);
+                entry->window.store(0, std::memory_order_relaxed);
+                entry->received.store(0, std::memory_order_relaxed);
+                entry->duplicates.store(0, std::memory_order_relaxed);
+                entry->reordered.store(0, std::memory_order_relaxed);
+                entry->late.store(0, std::memory_order_relaxed);
+                entry->max_reorder_depth.store(0, std::memory_order_relaxed);
+                entry->used.store(0, std::memory_order_relaxed);
+            }
+            table->streams.store(0, std::memory_order_relaxed);
+            table->untracked.store(0, std::memory_order_relaxed);
+            shards_.push_back(std::move(table));
+        }
+    }
+
+    template <class Protocol, std::size_t Key_Field, std::size_t Sequence_Field>
+    ptl::detail::sequence_entry *
+    sequence_tracker<Protocol, Key_Field, Sequence_Field>::find_or_add(shard_table & table, const key_type key) noexcept
+    {
+        const std::uint64_t wanted = static_cast<std::uint64_t>(key);
+        for (std::size_t i = slot(key); ; i = (i + 1) & mask_) {
+            ptl::detail::sequence_entry & entry = table.entries[i];
+            if (entry.used.load(std::memory_order_relaxed) == 0) {
+                const std::size_t streams = table.streams.load(std::memory_order_relaxed);
+                if (streams == max_streams_) {
+                    return nullptr;
+                }
+                for (auto const & other : shards_) {
+                    if (other.get() != &table && find(*other, key) != nullptr) {
+                        return nullptr;
+                    }
+                }
+                table.streams.store(streams + 1, std::memory_order_relaxed);
+                entry.key.store(wanted, std::memory_order_relaxed);
+                entry.received.store(0, std::memory_order_relaxed);
+                entry.duplicates.store(0, std::memory_order_relaxed);
+                entry.reordered.store(0, std::memory_order_relaxed);
+                entry.late.store(0, std::memory_order_relaxed);
+                entry.max_reorder_depth.store(0, std::memory_order_relaxed);
+                // The key is published to find(), the statistics are
+                // published with the rest of the first update
+                entry.used.store(2, std::memory_order_release);
+                return &entry;
+            }
+            if (entry.key.load(std::memory_order_relaxed) == wanted) {
+                return &entry;
+            }
+        }
+    }
+
+    template <class Protocol, std::size_t Key_Field, std::size_t Sequence_Field>
+    ptl::detail::sequence_entry const *
+    sequence_tracker<Protocol, Key_Field, Sequence_Field>::find(shard_table const & table, const key_type key) const noexcept
+    {
+        const std::uint64_t wanted = static_cast<std::uint64_t>(key);
+        std::size_t i = slot(key);
+        for (std::size_t probe = 0; probe <= mask_; ++probe, i = (i + 1) & mask_) {
+            ptl::detail::sequence_entry const & entry = table.entries[i];
+            if (entry.used.load(std::memory_order_acquire) == 0) {
+                return nullptr;
+            }
+            if (entry.key.load(std::memory_order_relaxed) == wanted) {
+                return &entry;
+            }
+        }
+        return nullptr;
+    }
+
+    template <class Protocol, std::size_t Key_Field, std::size_t Sequence_Field>
+    void sequence_tracker<Protocol, Key_Field, Sequence_Field>::update(const std::size_t shard,
+                                                                       const key_type key,
+                                                                       const sequence_type sequence) noexcept
+    {
+        using ptl::detail::add_relaxed;
+        static constexpr auto relaxed = std::memory_order_relaxed;
+
+        shard_table & table = *shards_[shard];
+        ptl::detail::sequence_entry * const entry = find_or_add(table, key);
+        if (entry == nullptr) {
+            add_relaxed<std::uint64_t>(table.untracked, 1);
+            return;
+        }
+
+        const std::uint64_t number = static_cast<std::uint64_t>(sequence) & (modulus - 1);
+        if (entry->used.load(relaxed) == 2) {
+            entry->base.store(modulus + number, relaxed);
+            entry->highest.store(modulus + number, relaxed);
+            entry->window.store(1, relaxed);
+            entry->received.store(1, relaxed);
+            entry->used.store(1, std::memory_order_release);
+            return;
+        }
+
+        add_relaxed<std::uint64_t>(entry->received, 1);
+        std::uint64_t highest = entry->highest.load(relaxed);
+        std::uint64_t window = entry->window.load(relaxed);
+        const std::uint64_t delta = (number - highest) & (modulus - 1);
+        if (delta == 0) {
+            add_relaxed<std::uint64_t>(entry->duplicates, 1);
+        } else if (delta < modulus / 2) {
+            // Ahead of the highest, any skipped numbers are lost until they arrive
+            highest += delta;
+            window = delta >= window_bits ? 1 : (window << delta) | 1;
+            entry->highest.store(highest, relaxed);
+            entry->window.store(window, relaxed);
+        } else if (modulus - delta >= window_bits) {
+            // Behind the window, so it's unknown whether it was received
+            add_relaxed<std::uint32_t>(entry->late, 1);
+        } else {
+            const std::uint64_t behind = modulus - delta;
+            const std::uint64_t base = entry->base.load(relaxed);
+            if (behind > highest - base) {
+                // Earlier than the first number received
+                entry->base.store(highest - behind, relaxed);
+            }
+            const std::uint64_t bit = static_cast<std::uint64_t>(1) << behind;
+            if ((window & bit) != 0) {
+                add_relaxed<std::uint64_t>(entry->duplicates, 1);
+            } else {
+                entry->window.store(window | bit, relaxed);
+                add_relaxed<std::uint64_t>(entry->reordered, 1);
+                const std::uint16_t depth = static_cast<std::uint16_t>(behind);
+                if (depth > entry->max_reorder_depth.load(relaxed)) {
+                    entry->max_reorder_depth.store(depth, relaxed);
+                }
+            }
+        }
+    }
+
+    template <class Protocol, std::size_t Key_Field, std::size_t Sequence_Field>
+    void sequence_tracker<Protocol, Key_Field, Sequence_Field>::update(const std::size_t shard,
+                                                                       key_type const * const keys,
+                                                                       sequence_type const * const sequences,
+                                                                       const std::size_t count) noexcept
+    {
+        shard_table const & table = *shards_[shard];
+        const std::size_t ahead = count < batch_size ? count : batch_size;
+        for (std::size_t i = 0; i < ahead; ++i) {
+            prefetch(table, keys[i]);
+        }
+        // Each entry is prefetched batch_size packets before it's updated
+        for (std::size_t i = 0; i < count; ++i) {
+            if (i + batch_size < count) {
+                prefetch(table, keys[i + batch_size]);
+            }
+            update(shard, keys[i], sequences[i]);
+        }
+    }
+
+    template <class Protocol, std::size_t Key_Field, std::size_t Sequence_Field>
+    void sequence_tracker<Protocol, Key_Field, Sequence_Field>::update(const std::size_t shard,
+                                                                       unsigned char const * const headers,
+                                                                       const std::size_t stride,
+                                                                       const std::size_t count) noexcept
+    {
+        shard_table const & table = *shards_[shard];
+        const std::size_t ahead = count < batch_size ? count : batch_size;
+        for (std::size_t i = 0; i < ahead; ++i) {
+            prefetch(table, Protocol::template field_value<Key_Field>(headers + i * stride));
+        }
+        for (std::size_t i = 0; i < count; ++i) {
+            if (i + batch_size < count) {
+                unsigned char const * const next = headers + (i + batch_size) * stride;
+                prefetch(table, Protocol::template field_value<Key_Field>(next));
+            }
+            update(shard, headers + i * stride);
+        }
+    }
+
+    template <class Protocol, std::size_t Key_Field, std::size_t Sequence_Field>
+    ptl::sequence_stats
+    sequence_tracker<Protocol, Key_Field, Sequence_Field>::entry_stats(ptl::detail::sequence_entry const & entry) noexcept
+    {
+        static constexpr auto relaxed = std::memory_order_relaxed;
+
+        const std::uint64_t received = entry.received.load(relaxed);
+        const std::uint64_t duplicates = entry.duplicates.load(relaxed);
+        const std::uint64_t late = entry.late.load(relaxed);
+        const std::uint64_t highest = entry.highest.load(relaxed);
+        const std::uint64_t expected = highest - entry.base.load(relaxed) + 1;
+        const std::uint64_t unique = received - duplicates - late;
+
+        ptl::sequence_stats stats;
+        stats.received = received;
+        stats.lost = expected > unique ? expected - unique : 0;
+        stats.duplicates = duplicates;
+        stats.reordered = entry.reordered.load(relaxed);
+        stats.late = late;
+        stats.max_reorder_depth = entry.max_reorder_depth.load(relaxed);
+        stats.wraps = highest / modulus - 1;
+        return stats;
+    }
+
+    template <class Protocol, std::size_t Key_Field, std::size_t Sequence_Field>
+    ptl::sequence_stats sequence_tracker<Protocol, Key_Field, Sequence_Field>::stats(const key_type key) const noexcept
+    {
+        for (auto const & table : shards_) {
+            ptl::detail::sequence_entry const * const entry = find(*table, key);
+            if (entry != nullptr && entry->used.load(std::memory_order_acquire) == 1) {
+                return entry_stats(*entry);
+            }
+        }
+        return ptl::sequence_stats{0, 0, 0, 0, 0, 0, 0};
+    }
+
+    template <class Protocol, std::size_t Key_Field, std::size_t Sequence_Field>
+    template <class Visitor>
+    void sequence_tracker<Protocol, Key_Field, Sequence_Field>::for_each(const std::size_t shard,
+                                                                         Visitor && visit) const
+    {
+        shard_table const & table = *shards_[shard];
+        for (std::size_t i = 0; i <= mask_; ++i) {
+            if (table.entries[i].used.load(std::memory_order_acquire) == 1) {
+                const key_type key = static_cast<key_type>(table.entries[i].key.load(std::memory_order_relaxed));
+                visit(key, entry_stats(table.entries[i]));
+            }
+        }
+    }
+
+    template <class Protocol, std::size_t Key_Field, std::size_t Sequence_Field>
+    std::uint64_t sequence_tracker<Protocol, Key_Field, Sequence_Field>::untracked() const noexcept
+    {
+        std::uint64_t total = 0;
+        for (auto const & table : shards_) {
+            total += table->untracked.load(std::memory_order_relaxed);
+        }
+        return total;
+    }
+}
+
+#endif
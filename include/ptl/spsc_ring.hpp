@@ -0,0 +1,168 @@
+#ifndef PTL_SPSC_RING_HPP
+#define PTL_SPSC_RING_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+namespace ptl
+{
+    /** A bounded lock free queue of one producer thread and one consumer thread
+	 *
+	 *  The producer and the consumer each keep a copy of the other's
+	 *  index, and only load the other's index when the copy says the
+	 *  ring is full or empty, so they rarely share cache lines.
+	 *
+	 *  @tparam T Type of the queued values, such as a packet pointer
+	 */
+    template <class T>
+    class spsc_ring
+    {
+        public:
+
+            /// Creates a ring of at least capacity values, rounded up to a power of two
+            explicit spsc_ring(const std::size_t capacity);
+
+            spsc_ring(spsc_ring const &) = delete;
+            spsc_ring & operator=(spsc_ring const &) = delete;
+
+            /// Adds value to the ring, called by the producer
+            /**
+             *  @return False if the ring is full.
+             */
+            bool try_push(T const & value) noexcept;
+
+            /// Removes the oldest value from the ring, called by the consumer
+            /**
+             *  @return False if the ring is empty.
+             */
+            bool try_pop(T & value) noexcept;
+
+            /// Removes and visits up to max values, called by the consumer
+            /**
+             *  The values are released to the producer once they've
+             *  all been visited.
+             *
+             *  @param visit Called with each value in queue order.
+             *  @param max The most values to remove.
+             *  @return The number of values removed.
+             */
+            template <class Visitor>
+            std::size_t consume(Visitor && visit, const std::size_t max = static_cast<std::size_t>(-1));
+
+            /// Returns the number of values the ring holds
+            std::size_t capacity() const noexcept {
+                return mask_ + 1;
+            }
+
+            /// Returns the number of values in the ring, which may be stale
+            std::size_t size() const noexcept {
+                // The tail is loaded first so it's never past the head,
+                // and the values pushed since are clamped to capacity
+                const std::size_t tail = tail_.load(std::memory_order_acquire);
+                const std::size_t size = head_.load(std::memory_order_acquire) - tail;
+                return size < capacity() ? size : capacity();
+            }
+
+            /// Returns the most values the ring has held, called by the producer
+            std::size_t high_water() const noexcept {
+                return high_water_;
+            }
+
+        private:
+
+            const std::size_t mask_;
+            std::unique_ptr<T[]> slots_;
+
+            // Written by the producer
+            char producer_padding_[64];
+            std::atomic<std::size_t> head_;
+            std::size_t tail_cache_;
+            std::size_t high_water_;
+
+            // Written by the consumer
+            char consumer_padding_[64];
+            std::atomic<std::size_t> tail_;
+            std::size_t head_cache_;
+            char end_padding_[64];
+    };
+
+    namespace detail
+    {
+        // Returns the smallest power of two >= value
+        inline std::size_t ceil_power_of_two(const std::size_t value) noexcept
+        {
+            std::size_t power = 1;
+            while (power < value) {
+                power <<= 1;
+            }
+            return power;
+        }
+    }
+
+    template <class T>
+    spsc_ring<T>::spsc_ring(const std::size_t capacity) :
+        mask_(ptl::detail::ceil_power_of_two(capacity == 0 ? 1 : capacity) - 1),
+        slots_(new T[mask_ + 1]),
+        head_(0),
+        tail_cache_(0),
+        high_water_(0),
+        tail_(0),
+        head_cache_(0)
+    {}
+
+    template <class T>
+    bool spsc_ring<T>::try_push(T const & value) noexcept
+    {
+        const std::size_t head = head_.load(std::memory_order_relaxed);
+        if (head - tail_cache_ > mask_) {
+            tail_cache_ = tail_.load(std::memory_order_acquire);
+            if (head - tail_cache_ > mask_) {
+                return false;
+            }
+        }
+        slots_[head & mask_] = value;
+        head_.store(head + 1, std::memory_order_release);
+
+        // The cached tail overstates the size, so it's only reloaded
+        // when the size may be a new high water mark
+        if (head + 1 - tail_cache_ > high_water_) {
+            tail_cache_ = tail_.load(std::memory_order_acquire);
+            const std::size_t size = head + 1 - tail_cache_;
+            high_water_ = size > high_water_ ? size : high_water_;
+        }
+        return true;
+    }
+
+    template <class T>
+    bool spsc_ring<T>::try_pop(T & value) noexcept
+    {
+        const std::size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail == head_cache_) {
+            head_cache_ = head_.load(std::memory_order_acquire);
+            if (tail == head_cache_) {
+                return false;
+            }
+        }
+        value = slots_[tail & mask_];
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    template <class T>
+    template <class Visitor>
+    std::size_t spsc_ring<T>::consume(Visitor && visit, const std::size_t max)
+    {
+        const std::size_t tail = tail_.load(std::memory_order_relaxed);
+        head_cache_ = head_.load(std::memory_order_acquire);
+        const std::size_t available = head_cache_ - tail;
+        const std::size_t count = available < max ? available : max;
+        for (std::size_t i = 0; i < count; ++i) {
+            visit(slots_[(tail + i) & mask_]);
+        }
+        tail_.store(tail + count, std::memory_order_release);
+        return count;
+    }
+}
+
+#endif
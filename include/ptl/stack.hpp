@@ -0,0 +1,275 @@
+#ifndef PTL_STACK_HPP
+#define PTL_STACK_HPP
+
+#include <array>
+#include <cstdint>
+#include <tuple>
+#include <utility>
+#include "ptl.hpp"
+
+namespace ptl
+{
+    /** A stack layer whose size is only known at run time
+	 *
+	 *  Extra_Bytes provides the number of bytes the layer has beyond
+	 *  its protocol's fields, such as an IPv4 header's options:
+	 *
+	 *      struct ipv4_options
+	 *      {
+	 *              static std::size_t extra_bytes(unsigned char const * header) noexcept {
+	 *                  return ipv4::field_value<1>(header) * 4 - ipv4::traits::bytes;
+	 *              }
+	 *      };
+	 *
+	 *  @tparam Protocol The ptl::protocol of the layer's fixed fields
+	 *  @tparam Extra_Bytes Type with a static extra_bytes(layer buffer)
+	 */
+    template <class Protocol, class Extra_Bytes>
+    struct variable_layer
+    {
+            using protocol_type = Protocol;
+    };
+
+    /// Provides a stack layer's protocol and size
+    template <class Layer>
+    struct layer_traits
+    {
+            using protocol_type = Layer;
+            static constexpr bool variable = false;
+
+            static constexpr std::size_t extra_bytes(unsigned char const * const) noexcept {
+                return 0;
+            }
+    };
+
+    template <class Protocol, class Extra_Bytes>
+    struct layer_traits<ptl::variable_layer<Protocol, Extra_Bytes>>
+    {
+            using protocol_type = Protocol;
+            static constexpr bool variable = true;
+
+            static std::size_t extra_bytes(unsigned char const * const layer) noexcept {
+                return Extra_Bytes::extra_bytes(layer);
+            }
+    };
+
+    namespace detail
+    {
+        /// The field tuple of every layer's fields in layer order
+        template <class... Layers>
+        struct stacked_tuple
+        {
+                using type = decltype(std::tuple_cat(
+                                          std::declval<typename ptl::layer_traits<Layers>::protocol_type::tuple_type>()...));
+        };
+
+        /// Prefix sums of the layers' field counts and bits
+        template <class... Layers>
+        struct layer_offsets
+        {
+                static constexpr std::size_t count = sizeof...(Layers);
+
+                static constexpr std::size_t first_field(const std::size_t n) noexcept {
+                    const std::size_t fields[] = { ptl::layer_traits<Layers>::protocol_type::traits::fields..., 0 };
+                    std::size_t sum = 0;
+                    for (std::size_t i = 0; i < n; ++i) {
+                        sum += fields[i];
+                    }
+                    return sum;
+                }
+
+                static constexpr std::size_t bit_offset(const std::size_t n) noexcept {
+                    const std::size_t bits[] = { ptl::layer_traits<Layers>::protocol_type::traits::bits..., 0 };
+                    std::size_t sum = 0;
+                    for (std::size_t i = 0; i < n; ++i) {
+                        sum += bits[i];
+                    }
+                    return sum;
+                }
+
+                // Returns the layer of stacked field i
+                static constexpr std::size_t layer_of(const std::size_t i) noexcept {
+                    std::size_t n = 0;
+                    while (n + 1 < count && first_field(n + 1) <= i) {
+                        ++n;
+                    }
+                    return n;
+                }
+
+                static constexpr bool byte_aligned() noexcept {
+                    const std::size_t bits[] = { ptl::layer_traits<Layers>::protocol_type::traits::bits..., 0 };
+                    for (std::size_t i = 0; i < count; ++i) {
+                        if (bits[i] % ptl::bits_per_byte != 0) {
+                            return false;
+                        }
+                    }
+                    return true;
+                }
+
+                static constexpr bool variable() noexcept {
+                    const bool variable[] = { ptl::layer_traits<Layers>::variable..., false };
+                    for (std::size_t i = 0; i < count; ++i) {
+                        if (variable[i]) {
+                            return true;
+                        }
+                    }
+                    return false;
+                }
+        };
+    }
+
+    /** A protocol of stacked layers, such as Ethernet, IPv4, UDP and RTP
+	 *
+	 *  The layers' field tuples are concatenated into one protocol, so
+	 *  every field's bit offset across the layers is known at compile
+	 *  time and a whole stack is unpacked with one set of word loads.
+	 *  A stack is a ptl::protocol of the concatenated fields, and a
+	 *  layer's fields are addressed with layer<N>::field<I>:
+	 *
+	 *      using rtp_stack = ptl::stack<ethernet, ipv4, udp, rtp>;
+	 *      auto ssrc = rtp_stack::field_value<rtp_stack::layer<3>::field<8>>(buf);
+	 *
+	 *  A ptl::variable_layer's extra bytes shift the layers after it.
+	 *  The shifts are found at run time by shifts(), and the overloads
+	 *  taking them address the shifted layers.  A stack without extra
+	 *  bytes is still unpacked with the fused loads.
+	 *
+	 *  @tparam Layers The layers' ptl::protocols or ptl::variable_layers
+	 */
+    template <class... Layers>
+    class stack : public ptl::protocol<typename ptl::detail::stacked_tuple<Layers...>::type>
+    {
+        private:
+
+            using offsets = ptl::detail::layer_offsets<Layers...>;
+            using base_protocol = ptl::protocol<typename ptl::detail::stacked_tuple<Layers...>::type>;
+
+            template <std::size_t N>
+            using layer_type = typename std::tuple_element<N, std::tuple<Layers...>>::type;
+
+        public:
+
+            static_assert(sizeof...(Layers) > 0,
+                          "A stack must have at least one layer");
+            static_assert(offsets::byte_aligned(),
+                          "Every layer must be a whole number of bytes");
+
+            using typename base_protocol::tuple_type;
+            using typename base_protocol::traits;
+            using typename base_protocol::value_tuple;
+            using base_protocol::field_value;
+            using base_protocol::unpack;
+
+            /// Number of layers
+            static constexpr std::size_t layers = sizeof...(Layers);
+
+            /// True if a layer has extra bytes at run time
+            static constexpr bool variable = offsets::variable();
+
+            /// Extra bytes before each layer, and after the last layer
+            using shift_type = std::array<std::size_t, sizeof...(Layers) + 1>;
+
+            /// A layer of the stack
+            /**
+             *  @tparam N The layer's order number
+             */
+            template <std::size_t N>
+            struct layer
+            {
+                    static_assert(N < sizeof...(Layers),
+                                  "The layer is not in the stack");
+
+                    /// The layer's ptl::protocol
+                    using protocol_type = typename ptl::layer_traits<layer_type<N>>::protocol_type;
+
+                    /// Order number of the layer's first field in the stack
+                    static constexpr std::size_t first_field = offsets::first_field(N);
+
+                    /// Bit offset of the layer in the stack, without extra bytes
+                    static constexpr std::size_t bit_offset = offsets::bit_offset(N);
+
+                    /// Byte offset of the layer in the stack, without extra bytes
+                    static constexpr std::size_t byte_offset = bit_offset / ptl::bits_per_byte;
+
+                    /// Order number in the stack of the layer's field I
+                    template <std::size_t I>
+                    static constexpr std::size_t field = first_field + I;
+
+                    /// Returns the value of the layer's field I
+                    template <std::size_t I>
+                    static constexpr ptl::field_type<I, typename protocol_type::tuple_type>
+                    field_value(unsigned char const * const buf) noexcept {
+                        return base_protocol::template field_value<first_field + I>(buf);
+                    }
+
+                    /// Returns the value of the layer's field I, shifted by the extra bytes before it
+                    template <std::size_t I>
+                    static ptl::field_type<I, typename protocol_type::tuple_type>
+                    field_value(unsigned char const * const buf, shift_type const & shifts) noexcept {
+                        return base_protocol::template field_value<first_field + I>(buf + shifts[N]);
+                    }
+
+                    /// Returns the layer's buffer, shifted by the extra bytes before it
+                    static unsigned char const * data(unsigned char const * const buf, shift_type const & shifts) noexcept {
+                        return buf + byte_offset + shifts[N];
+                    }
+            };
+
+            /// Returns the extra bytes before each layer of buf
+            /**
+             *  Calls each variable layer's extra_bytes hook with the
+             *  layer's buffer.
+             */
+            static shift_type shifts(unsigned char const * const buf) noexcept {
+                shift_type shifts{};
+                add_shifts(buf, shifts, std::make_index_sequence<sizeof...(Layers)>());
+                return shifts;
+            }
+
+            /// Returns the number of bytes of buf's stack
+            static std::size_t bytes(shift_type const & shifts) noexcept {
+                return traits::bytes + shifts[sizeof...(Layers)];
+            }
+
+            /// Returns the value of stacked field I, shifted by the extra bytes before its layer
+            template <std::size_t I>
+            static ptl::field_type<I, tuple_type> field_value(unsigned char const * const buf,
+                                                              shift_type const & shifts) noexcept {
+                return base_protocol::template field_value<I>(buf + shifts[offsets::layer_of(I)]);
+            }
+
+            /// Returns the values of all of the stack's fields, shifted by the extra bytes before their layers
+            /**
+             *  Without extra bytes, the stack is unpacked with one set
+             *  of word loads, otherwise each layer is unpacked from its
+             *  shifted buffer.
+             */
+            static value_tuple unpack(unsigned char const * const buf, shift_type const & shifts) noexcept {
+                if (shifts[sizeof...(Layers) - 1] == 0) {
+                    return base_protocol::unpack(buf);
+                }
+                return unpack_layers(buf, shifts, std::make_index_sequence<sizeof...(Layers)>());
+            }
+
+        private:
+
+            template <std::size_t... N>
+            static void add_shifts(unsigned char const * const buf, shift_type & shifts, std::index_sequence<N...>) noexcept {
+                // Expands to one extra_bytes call per layer, in layer order
+                const int expand[] = {
+                    (shifts[N + 1] = shifts[N] +
+                     ptl::layer_traits<layer_type<N>>::extra_bytes(buf + layer<N>::byte_offset + shifts[N]), 0)...
+                };
+                (void)expand;
+            }
+
+            template <std::size_t... N>
+            static value_tuple unpack_layers(unsigned char const * const buf,
+                                             shift_type const & shifts,
+                                             std::index_sequence<N...>) noexcept {
+                return std::tuple_cat(layer<N>::protocol_type::unpack(layer<N>::data(buf, shifts))...);
+            }
+    };
+}
+
+#endif
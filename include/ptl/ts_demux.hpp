@@ -0,0 +1,188 @@
+#ifndef PTL_TS_DEMUX_HPP
+#define PTL_TS_DEMUX_HPP
+
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+#include "ptl.hpp"
+#include "ptl/spsc_ring.hpp"
+#include "ptl/ts_framer.hpp"
+
+namespace ptl
+{
+    /** Demultiplexes transport stream packets by PID onto consumer queues
+	 *
+	 *  Each PID is looked up in a flat table of every PID's consumer,
+	 *  and the packet's pointer is pushed onto the consumer's queue,
+	 *  a ptl::spsc_ring read by the consumer's thread.  Packets aren't
+	 *  copied, so the demultiplexed bytes must stay valid until the
+	 *  consumers have processed them.
+	 *
+	 *  A ts_demux is used by a single producer thread, and each of its
+	 *  queues by a single consumer thread.  A packet whose queue is
+	 *  full is dropped and counted.
+	 *
+	 *  @tparam Protocol The ptl::protocol of the packets' header
+	 *  @tparam Pid_Field Order number of the 13 bit PID field
+	 */
+    template <class Protocol, std::size_t Pid_Field>
+    class ts_demux
+    {
+        public:
+
+            static_assert(ptl::field_bits<Pid_Field, typename Protocol::tuple_type>::value == 13,
+                          "The PID field must be 13 bits");
+
+            using queue_type = ptl::spsc_ring<unsigned char const *>;
+
+            /// Number of PIDs
+            static constexpr std::size_t pid_count = 8192;
+
+            /// Creates a demultiplexer of consumers queues of queue_capacity packets
+            /**
+             *  No PID is routed to a consumer until route is called.
+             *
+             *  @throw std::invalid_argument If consumers is 0 or more
+             *  than 65534, 0xffff marks an unrouted PID.
+             */
+            ts_demux(const std::size_t consumers, const std::size_t queue_capacity);
+
+            /// Routes pid's packets to consumer's queue
+            /**
+             *  @throw std::out_of_range If pid or consumer is out of range.
+             */
+            void route(const std::uint16_t pid, const std::size_t consumer);
+
+            /// Stops routing pid's packets
+            void unroute(const std::uint16_t pid) noexcept {
+                if (pid < pid_count) {
+                    routes_[pid] = unrouted;
+                }
+            }
+
+            /// Queues a packet for its PID's consumer
+            /**
+             *  @param packet A packet's bytes, starting with the sync byte.
+             *  @return False if the packet was dropped or its PID isn't routed.
+             */
+            bool push(unsigned char const * const packet) noexcept;
+
+            /// Queues count packets stride bytes apart
+            /**
+             *  @return The number of packets queued.
+             */
+            std::size_t demux(unsigned char const * const packets,
+                              const std::size_t stride,
+                              const std::size_t count) noexcept;
+
+            /// Queues a packet yielded by ptl::ts_framer
+            bool operator()(ptl::ts_packet<Protocol> const & packet) noexcept {
+                return push(packet.data());
+            }
+
+            /// Returns consumer's queue
+            queue_type & queue(const std::size_t consumer) noexcept {
+                return *consumers_[consumer].queue;
+            }
+
+            /// Returns the number of consumers
+            std::size_t consumers() const noexcept {
+                return queues_.size();
+            }
+
+            /// Returns the number of packets queued for consumer
+            std::uint64_t delivered(const std::size_t consumer) const noexcept {
+                return consumers_[consumer].delivered;
+            }
+
+            /// Returns the number of consumer's packets dropped because its queue was full
+            std::uint64_t dropped(const std::size_t consumer) const noexcept {
+                return consumers_[consumer].dropped;
+            }
+
+            /// Returns the most packets consumer's queue has held
+            std::size_t high_water(const std::size_t consumer) const noexcept {
+                return consumers_[consumer].queue->high_water();
+            }
+
+            /// Returns the number of packets whose PID isn't routed
+            std::uint64_t unrouted_packets() const noexcept {
+                return unrouted_packets_;
+            }
+
+        private:
+
+            // Route of an unrouted PID
+            static constexpr std::uint16_t unrouted = 0xffff;
+
+            // The producer's view of a consumer
+            struct consumer_state
+            {
+                    queue_type * queue;
+                    std::uint64_t delivered;
+                    std::uint64_t dropped;
+            };
+
+            std::unique_ptr<std::uint16_t[]> routes_;
+            std::vector<std::unique_ptr<queue_type>> queues_;
+            std::vector<consumer_state> consumers_;
+            std::uint64_t unrouted_packets_;
+    };
+
+    template <class Protocol, std::size_t Pid_Field>
+    ts_demux<Protocol, Pid_Field>::ts_demux(const std::size_t consumers, const std::size_t queue_capacity) :
+        routes_(new std::uint16_t[pid_count]),
+        unrouted_packets_(0)
+    {
+        if (consumers == 0 || consumers >= unrouted) {
+            throw std::invalid_argument("A demultiplexer must have between 1 and 65534 consumers");
+        }
+        for (std::size_t pid = 0; pid < pid_count; ++pid) {
+            routes_[pid] = unrouted;
+        }
+        queues_.reserve(consumers);
+        consumers_.reserve(consumers);
+        for (std::size_t c = 0; c < consumers; ++c) {
+            queues_.emplace_back(new queue_type(queue_capacity));
+            consumers_.push_back(consumer_state{queues_.back().get(), 0, 0});
+        }
+    }
+
+    template <class Protocol, std::size_t Pid_Field>
+    void ts_demux<Protocol, Pid_Field>::route(const std::uint16_t pid, const std::size_t consumer)
+    {
+        if (pid >= pid_count || consumer >= queues_.size()) {
+            throw std::out_of_range("The PID or consumer is out of range");
+        }
+        routes_[pid] = static_cast<std::uint16_t>(consumer);
+    }
+
+    template <class Protocol, std::size_t Pid_Field>
+    bool ts_demux<Protocol, Pid_Field>::push(unsigned char const * const packet) noexcept
+    {
+        const std::uint16_t route = routes_[Protocol::template field_value<Pid_Field>(packet)];
+        if (route == unrouted) {
+            ++unrouted_packets_;
+            return false;
+        }
+        consumer_state & consumer = consumers_[route];
+        const bool queued = consumer.queue->try_push(packet);
+        ++(queued ? consumer.delivered : consumer.dropped);
+        return queued;
+    }
+
+    template <class Protocol, std::size_t Pid_Field>
+    std::size_t ts_demux<Protocol, Pid_Field>::demux(unsigned char const * const packets,
+                                                     const std::size_t stride,
+                                                     const std::size_t count) noexcept
+    {
+        std::size_t queued = 0;
+        for (std::size_t i = 0; i < count; ++i) {
+            queued += push(packets + i * stride);
+        }
+        return queued;
+    }
+}
+
+#endif
@@ -0,0 +1,317 @@
+#ifndef PTL_TS_FRAMER_HPP
+#define PTL_TS_FRAMER_HPP
+
+#include <cstdint>
+#include "ptl.hpp"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace ptl
+{
+    /// Number of bytes in an MPEG-2 transport stream packet
+    static constexpr std::size_t ts_packet_bytes = 188;
+
+    /// Spacing of transport stream packets in a byte stream
+    enum class ts_packet_size : std::size_t
+    {
+        /// Detected from the stream
+        detect = 0,
+        /// Plain transport stream packets
+        ts = 188,
+        /// Packets preceded by a four byte timestamp, as in M2TS
+        m2ts = 192,
+        /// Packets followed by sixteen Reed-Solomon parity bytes
+        fec = 204
+    };
+
+    /** A transport stream packet within a framed byte stream
+	 *
+	 *  The packet isn't copied, so it's only valid while the framed
+	 *  bytes are.
+	 *
+	 *  @tparam Protocol The ptl::protocol of the packet's header
+	 */
+    template <class Protocol>
+    class ts_packet
+    {
+        public:
+
+            static_assert(Protocol::traits::bytes <= ptl::ts_packet_bytes,
+                          "The header protocol must fit in a transport stream packet");
+
+            explicit ts_packet(unsigned char const * const data) noexcept : data_(data) {}
+
+            /// Returns the packet's bytes, starting with the sync byte
+            unsigned char const * data() const noexcept {
+                return data_;
+            }
+
+            /// Returns the number of bytes in the packet
+            static constexpr std::size_t size() noexcept {
+                return ptl::ts_packet_bytes;
+            }
+
+            /// Returns the value of a header field
+            /**
+             *  @tparam I Order number of the field in the protocol tuple
+             */
+            template <std::size_t I>
+            ptl::field_type<I, typename Protocol::tuple_type> field_value() const noexcept {
+                return Protocol::template field_value<I>(data_);
+            }
+
+            /// Returns the values of all of the header's fields
+            typename Protocol::value_tuple unpack() const noexcept {
+                return Protocol::unpack(data_);
+            }
+
+        private:
+
+            unsigned char const * data_;
+    };
+
+    /** Splits a transport stream byte stream into packets
+	 *
+	 *  Until the framer is synchronized, the input is scanned for
+	 *  sync_confirmations consecutive sync bytes one packet apart.
+	 *  Sixteen candidate positions are checked at a time with SSE2
+	 *  compares.  Once synchronized, each packet's sync byte is
+	 *  checked and a mismatch starts a new scan at that byte.
+	 *
+	 *  @tparam Protocol The ptl::protocol of the packets' headers
+	 */
+    template <class Protocol>
+    class ts_framer
+    {
+        public:
+
+            using packet_type = ptl::ts_packet<Protocol>;
+
+            /// The byte that starts every transport stream packet
+            static constexpr unsigned char sync_byte = 0x47;
+
+            /// Number of consecutive sync bytes required to synchronize
+            static constexpr std::size_t sync_confirmations = 4;
+
+            /// Creates a framer for packets of the given spacing
+            explicit ts_framer(const ptl::ts_packet_size packet_size = ptl::ts_packet_size::detect) noexcept;
+
+            /// Calls visit with a packet_type for each packet in data
+            /**
+             *  Bytes that can't be framed yet, such as a partial last
+             *  packet, are not consumed and must be passed again at
+             *  the start of the next call's data.  A 192 byte packet's
+             *  timestamp and a 204 byte packet's parity bytes are
+             *  consumed but aren't part of the yielded packets.
+             *
+             *  @param data The stream's bytes.
+             *  @param size The number of bytes.
+             *  @param visit Called with each packet in stream order.
+             *  @return The number of bytes consumed.
+             */
+            template <class Visitor>
+            std::size_t frame(unsigned char const * const data, const std::size_t size, Visitor && visit);
+
+            /// Returns true if the framer is synchronized to the stream
+            bool synced() const noexcept {
+                return synced_;
+            }
+
+            /// Returns the number of bytes between sync bytes, 0 if unknown
+            std::size_t packet_size() const noexcept {
+                return packet_size_;
+            }
+
+            /// Returns the number of bytes skipped while unsynchronized
+            std::size_t skipped_bytes() const noexcept {
+                return skipped_bytes_;
+            }
+
+            /// Returns the number of times synchronization was lost
+            std::size_t sync_losses() const noexcept {
+                return sync_losses_;
+            }
+
+            /// Returns the framer to the unsynchronized state
+            void reset() noexcept;
+
+        private:
+
+            // Returns the first confirmed sync position at or after
+            // pos, or the first position that can't be confirmed yet
+            std::size_t find_sync(unsigned char const * const data,
+                                  std::size_t pos,
+                                  const std::size_t size) noexcept;
+
+            // Returns a bitmask of the positions [pos, pos + 16) that
+            // are followed by confirmed syncs stride bytes apart
+            static unsigned int sync_mask(unsigned char const * const data,
+                                          const std::size_t pos,
+                                          const std::size_t stride) noexcept;
+
+            // Returns true if pos is followed by confirmed syncs
+            // stride bytes apart
+            static bool is_sync(unsigned char const * const data,
+                                const std::size_t pos,
+                                const std::size_t stride) noexcept;
+
+            ptl::ts_packet_size configured_size_;
+            std::size_t packet_size_;
+            bool synced_;
+            // Offset of the next sync byte into the next frame call's data
+            std::size_t next_sync_;
+            std::size_t skipped_bytes_;
+            std::size_t sync_losses_;
+    };
+
+    template <class Protocol>
+    ts_framer<Protocol>::ts_framer(const ptl::ts_packet_size packet_size) noexcept :
+        configured_size_(packet_size),
+        packet_size_(static_cast<std::size_t>(packet_size)),
+        synced_(false),
+        next_sync_(0),
+        skipped_bytes_(0),
+        sync_losses_(0)
+    {}
+
+    template <class Protocol>
+    void ts_framer<Protocol>::reset() noexcept
+    {
+        packet_size_ = static_cast<std::size_t>(configured_size_);
+        synced_ = false;
+        next_sync_ = 0;
+    }
+
+    template <class Protocol>
+    template <class Visitor>
+    std::size_t ts_framer<Protocol>::frame(unsigned char const * const data,
+                                           const std::size_t size,
+                                           Visitor && visit)
+    {
+        std::size_t pos = synced_ ? next_sync_ : 0;
+        for (;;) {
+            if (!synced_) {
+                const std::size_t sync = find_sync(data, pos, size);
+                skipped_bytes_ += sync - pos;
+                pos = sync;
+                if (!synced_) {
+                    return pos;
+                }
+            }
+
+            for (; pos + ptl::ts_packet_bytes <= size; pos += packet_size_) {
+                if (data[pos] != sync_byte) {
+                    synced_ = false;
+                    ++sync_losses_;
+                    break;
+                }
+                visit(packet_type(data + pos));
+            }
+
+            if (synced_) {
+                // The bytes before the next sync byte, such as the last
+                // packet's parity bytes, may not all be in data yet
+                next_sync_ = pos > size ? pos - size : 0;
+                return pos > size ? size : pos;
+            }
+        }
+    }
+
+    template <class Protocol>
+    bool ts_framer<Protocol>::is_sync(unsigned char const * const data,
+                                      const std::size_t pos,
+                                      const std::size_t stride) noexcept
+    {
+        for (std::size_t k = 0; k < sync_confirmations; ++k) {
+            if (data[pos + k * stride] != sync_byte) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    template <class Protocol>
+    unsigned int ts_framer<Protocol>::sync_mask(unsigned char const * const data,
+                                                const std::size_t pos,
+                                                const std::size_t stride) noexcept
+    {
+#if defined(__SSE2__)
+        const __m128i sync = _mm_set1_epi8(static_cast<char>(sync_byte));
+        unsigned int mask = 0xffff;
+        for (std::size_t k = 0; k < sync_confirmations && mask != 0; ++k) {
+            const __m128i v = _mm_loadu_si128(reinterpret_cast<__m128i const *>(data + pos + k * stride));
+            mask &= static_cast<unsigned int>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, sync)));
+        }
+        return mask;
+#else
+        unsigned int mask = 0;
+        for (unsigned int i = 0; i < 16; ++i) {
+            mask |= static_cast<unsigned int>(is_sync(data, pos + i, stride)) << i;
+        }
+        return mask;
+#endif
+    }
+
+    template <class Protocol>
+    std::size_t ts_framer<Protocol>::find_sync(unsigned char const * const data,
+                                               std::size_t pos,
+                                               const std::size_t size) noexcept
+    {
+        static constexpr std::size_t detected_sizes[] = {
+            static_cast<std::size_t>(ptl::ts_packet_size::ts),
+            static_cast<std::size_t>(ptl::ts_packet_size::m2ts),
+            static_cast<std::size_t>(ptl::ts_packet_size::fec)
+        };
+        static constexpr std::size_t detected_count = sizeof(detected_sizes) / sizeof(detected_sizes[0]);
+        static constexpr std::size_t window = 16;
+
+        const bool detect = configured_size_ == ptl::ts_packet_size::detect;
+        const std::size_t configured = static_cast<std::size_t>(configured_size_);
+        std::size_t const * const sizes = detect ? detected_sizes : &configured;
+        const std::size_t count = detect ? detected_count : 1;
+        const std::size_t span = (sync_confirmations - 1) * sizes[count - 1] + 1;
+
+        // Whole windows of candidate positions
+        for (; pos + window - 1 + span <= size; pos += window) {
+            unsigned int masks[detected_count];
+            unsigned int any = 0;
+            for (std::size_t s = 0; s < count; ++s) {
+                masks[s] = sync_mask(data, pos, sizes[s]);
+                any |= masks[s];
+            }
+            if (any != 0) {
+#if defined(__GNUC__)
+                const unsigned int offset = static_cast<unsigned int>(__builtin_ctz(any));
+#else
+                unsigned int offset = 0;
+                while ((any & (1u << offset)) == 0) {
+                    ++offset;
+                }
+#endif
+                std::size_t s = 0;
+                while ((masks[s] & (1u << offset)) == 0) {
+                    ++s;
+                }
+                packet_size_ = sizes[s];
+                synced_ = true;
+                return pos + offset;
+            }
+        }
+
+        // Remaining candidate positions
+        for (; pos + span <= size; ++pos) {
+            for (std::size_t s = 0; s < count; ++s) {
+                if (is_sync(data, pos, sizes[s])) {
+                    packet_size_ = sizes[s];
+                    synced_ = true;
+                    return pos;
+                }
+            }
+        }
+        return pos;
+    }
+}
+
+#endif
@@ -0,0 +1,522 @@
+#ifndef PTL_UDP_BATCH_IO_HPP
+#define PTL_UDP_BATCH_IO_HPP
+
+#include <array>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <system_error>
+#include <utility>
+#include <vector>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include "ptl.hpp"
+#include "ptl/buffer_pool.hpp"
+
+namespace ptl
+{
+    /** Receives and sends bursts of UDP datagrams with one system call
+	 *
+	 *  Up to Burst datagrams are received with one recvmmsg into
+	 *  buffers of a ptl::buffer_pool, and handed to a visitor as a
+	 *  batch whose datagrams start with a Protocol header.  Datagrams
+	 *  are sent with sendmmsg in bursts of up to Burst:
+	 *
+	 *      ptl::buffer_pool<rtp, 1388> pool(4096);
+	 *      ptl::udp_batch_io<rtp, 1388> io(fd, pool);
+	 *
+	 *      io.receive([](decltype(io)::batch & datagrams) {
+	 *          datagrams.for_each([](unsigned char const * header, std::size_t bytes) {
+	 *              ssrcs.insert(rtp::field_value<8>(header));
+	 *          });
+	 *      });
+	 *
+	 *  With enable_gro, the kernel may coalesce datagrams of a flow
+	 *  into one message, which is split back into its datagrams.
+	 *  send_segments sends datagrams of equal size from one buffer
+	 *  with UDP GSO where it's available.
+	 *
+	 *  The socket isn't closed by the adaptor, and the pool must
+	 *  outlive it.
+	 *
+	 *  @tparam Protocol The ptl::protocol at the start of each datagram
+	 *  @tparam Payload_Bytes Number of bytes after the header of each buffer
+	 *  @tparam Burst Most messages received or sent with one system call
+	 */
+    template <class Protocol, std::size_t Payload_Bytes, std::size_t Burst = 32>
+    class udp_batch_io
+    {
+        public:
+
+            static_assert(Burst > 0 && Burst <= UIO_MAXIOV,
+                          "A burst must have between 1 and UIO_MAXIOV messages");
+
+            using pool_type = ptl::buffer_pool<Protocol, Payload_Bytes>;
+            using buffer = typename pool_type::buffer;
+
+            /// Most messages received or sent with one system call
+            static constexpr std::size_t burst = Burst;
+
+            /// Number of bytes of a buffer, and so the largest message received
+            static constexpr std::size_t buffer_bytes = pool_type::buffer_bytes;
+
+            /// Number of bytes of a buffer needed to receive coalesced datagrams
+            static constexpr std::size_t gro_bytes = 65535;
+
+            /// The datagrams received by one call to receive
+            class batch
+            {
+                public:
+
+                    /// Returns the number of datagrams
+                    std::size_t size() const noexcept {
+                        return io_->datagrams_.size();
+                    }
+
+                    /// Returns datagram i, which can be passed to Protocol's accessors
+                    unsigned char * data(const std::size_t i) const noexcept {
+                        return io_->datagrams_[i].data;
+                    }
+
+                    /// Returns the number of bytes received of datagram i
+                    std::size_t bytes(const std::size_t i) const noexcept {
+                        return io_->datagrams_[i].bytes;
+                    }
+
+                    /// Returns true if datagram i was longer than its buffer
+                    bool truncated(const std::size_t i) const noexcept {
+                        return io_->datagrams_[i].truncated;
+                    }
+
+                    /// Returns true if datagram i holds a whole Protocol header
+                    bool complete(const std::size_t i) const noexcept {
+                        return !truncated(i) && bytes(i) >= Protocol::traits::bytes;
+                    }
+
+                    /// Returns the address datagram i was sent from
+                    struct sockaddr_storage const & source(const std::size_t i) const noexcept {
+                        return io_->names_[io_->datagrams_[i].message];
+                    }
+
+                    /// Returns the value of field I of datagram i's header
+                    /**
+                     *  The field is read from the buffer even if the
+                     *  datagram is shorter than the header.
+                     */
+                    template <std::size_t I>
+                    ptl::field_type<I, typename Protocol::tuple_type> field_value(const std::size_t i) const noexcept {
+                        return Protocol::template field_value<I>(data(i));
+                    }
+
+                    /// Calls visit with each complete datagram's header and bytes
+                    /**
+                     *  @return The number of datagrams visited.
+                     */
+                    template <class Visitor>
+                    std::size_t for_each(Visitor && visit) const;
+
+                    /// Takes the buffer holding datagram i
+                    /**
+                     *  The buffer outlives the batch, and is replaced with
+                     *  a newly allocated buffer by the next receive.  The
+                     *  buffer also holds the datagrams coalesced with
+                     *  datagram i, whose data stays valid with it.
+                     *
+                     *  @return An empty buffer if it was already taken.
+                     */
+                    buffer take(const std::size_t i) noexcept {
+                        return std::move(io_->buffers_[io_->datagrams_[i].message]);
+                    }
+
+                private:
+
+                    friend class udp_batch_io;
+
+                    explicit batch(udp_batch_io * const io) noexcept : io_(io) {}
+
+                    udp_batch_io * io_;
+            };
+
+            /// Creates an adaptor of a UDP socket
+            /**
+             *  @param fd The socket, which is blocking or non blocking.
+             *  @param pool The pool the datagrams are received into.
+             */
+            udp_batch_io(const int fd, pool_type & pool);
+
+            udp_batch_io(udp_batch_io const &) = delete;
+            udp_batch_io & operator=(udp_batch_io const &) = delete;
+
+            /// Returns the socket
+            int socket() const noexcept {
+                return fd_;
+            }
+
+            /// Asks the kernel to coalesce received datagrams
+            /**
+             *  @return False if UDP GRO isn't available, or a buffer
+             *  is smaller than gro_bytes.
+             */
+            bool enable_gro();
+
+            /// Returns true if received datagrams may be coalesced
+            bool gro() const noexcept {
+                return gro_;
+            }
+
+            /// Receives a burst of datagrams and calls visit with them
+            /**
+             *  A blocking socket waits for the first datagram, the
+             *  rest of the burst is the datagrams already queued.
+             *
+             *  @param visit Called with the batch of datagrams, unless
+             *  none were received.
+             *  @return The number of datagrams received, 0 if a non
+             *  blocking socket had none, the call was interrupted or
+             *  the pool has no free buffers.
+             *  @throws std::system_error if receiving fails.
+             */
+            template <class Visitor>
+            std::size_t receive(Visitor && visit);
+
+            /// Sends count datagrams in bursts
+            /**
+             *  @param datagrams The datagrams' bytes.
+             *  @param bytes The datagrams' sizes.
+             *  @param to The destination, or nullptr for a connected socket.
+             *  @return The number of datagrams sent, fewer than count
+             *  if a non blocking socket's send buffer is full.
+             *  @throws std::system_error if sending fails.
+             */
+            std::size_t send(unsigned char const * const * const datagrams,
+                             std::size_t const * const bytes,
+                             const std::size_t count,
+                             struct sockaddr const * const to = nullptr,
+                             const socklen_t to_bytes = 0);
+
+            /// Sends bytes as datagrams of segment_bytes, the last may be shorter
+            /**
+             *  Sent as messages of up to 64 datagrams and 65507 bytes
+             *  with UDP GSO where it's available, otherwise each
+             *  datagram is sent in bursts.
+             *
+             *  @return The number of datagrams sent.
+             *  @throws std::system_error if sending fails.
+             */
+            std::size_t send_segments(unsigned char const * const data,
+                                      const std::size_t bytes,
+                                      const std::size_t segment_bytes,
+                                      struct sockaddr const * const to = nullptr,
+                                      const socklen_t to_bytes = 0);
+
+        private:
+
+            struct datagram
+            {
+                    unsigned char * data;
+                    std::size_t bytes;
+                    std::size_t message;
+                    bool truncated;
+            };
+
+            // Room for a message's segment size, an int received or a
+            // 16 bit size sent
+            union control
+            {
+                    char bytes[CMSG_SPACE(sizeof(int))];
+                    struct cmsghdr align;
+            };
+
+            // Returns the segment size of a received message, 0 if it wasn't coalesced
+            std::size_t gro_segment_bytes(struct msghdr const & message) const noexcept;
+
+            // Sends the first count of send_messages_, returns the number sent
+            std::size_t send_messages(const std::size_t count,
+                                      struct sockaddr const * const to,
+                                      const socklen_t to_bytes);
+
+            int fd_;
+            pool_type & pool_;
+            bool gro_;
+            std::array<buffer, Burst> buffers_;
+            std::array<struct mmsghdr, Burst> messages_;
+            std::array<struct iovec, Burst> iovecs_;
+            std::array<struct sockaddr_storage, Burst> names_;
+            std::array<control, Burst> controls_;
+            std::vector<datagram> datagrams_;
+            std::array<struct mmsghdr, Burst> send_messages_;
+            std::array<struct iovec, Burst> send_iovecs_;
+    };
+
+    template <class Protocol, std::size_t Payload_Bytes, std::size_t Burst>
+    constexpr std::size_t udp_batch_io<Protocol, Payload_Bytes, Burst>::burst;
+
+    template <class Protocol, std::size_t Payload_Bytes, std::size_t Burst>
+    constexpr std::size_t udp_batch_io<Protocol, Payload_Bytes, Burst>::buffer_bytes;
+
+    template <class Protocol, std::size_t Payload_Bytes, std::size_t Burst>
+    constexpr std::size_t udp_batch_io<Protocol, Payload_Bytes, Burst>::gro_bytes;
+
+    template <class Protocol, std::size_t Payload_Bytes, std::size_t Burst>
+    template <class Visitor>
+    std::size_t udp_batch_io<Protocol, Payload_Bytes, Burst>::batch::for_each(Visitor && visit) const
+    {
+        std::size_t visited = 0;
+        for (std::size_t i = 0; i < size(); ++i) {
+            if (complete(i)) {
+                visit(static_cast<unsigned char const *>(data(i)), bytes(i));
+                ++visited;
+            }
+        }
+        return visited;
+    }
+
+    template <class Protocol, std::size_t Payload_Bytes, std::size_t Burst>
+    udp_batch_io<Protocol, Payload_Bytes, Burst>::udp_batch_io(const int fd, pool_type & pool) :
+        fd_(fd),
+        pool_(pool),
+        gro_(false)
+    {
+        std::memset(messages_.data(), 0, sizeof(messages_));
+        std::memset(send_messages_.data(), 0, sizeof(send_messages_));
+        datagrams_.reserve(Burst);
+    }
+
+    template <class Protocol, std::size_t Payload_Bytes, std::size_t Burst>
+    bool udp_batch_io<Protocol, Payload_Bytes, Burst>::enable_gro()
+    {
+#if defined(UDP_GRO)
+        // Coalesced datagrams longer than a buffer would be truncated
+        if (buffer_bytes < gro_bytes) {
+            return false;
+        }
+        const int on = 1;
+        if (::setsockopt(fd_, SOL_UDP, UDP_GRO, &on, sizeof(on)) != 0) {
+            return false;
+        }
+        // A message coalesces at most 64 datagrams
+        datagrams_.reserve(Burst * 64);
+        gro_ = true;
+#endif
+        return gro_;
+    }
+
+    template <class Protocol, std::size_t Payload_Bytes, std::size_t Burst>
+    std::size_t udp_batch_io<Protocol, Payload_Bytes, Burst>::gro_segment_bytes(struct msghdr const & message) const noexcept
+    {
+#if defined(UDP_GRO)
+        if (!gro_) {
+            return 0;
+        }
+        for (struct cmsghdr const * c = CMSG_FIRSTHDR(&message); c != nullptr;
+             c = CMSG_NXTHDR(const_cast<struct msghdr *>(&message), const_cast<struct cmsghdr *>(c))) {
+            if (c->cmsg_level == SOL_UDP && c->cmsg_type == UDP_GRO) {
+                int size;
+                std::memcpy(&size, CMSG_DATA(c), sizeof(size));
+                return size > 0 ? static_cast<std::size_t>(size) : 0;
+            }
+        }
+#else
+        (void)message;
+#endif
+        return 0;
+    }
+
+    template <class Protocol, std::size_t Payload_Bytes, std::size_t Burst>
+    template <class Visitor>
+    std::size_t udp_batch_io<Protocol, Payload_Bytes, Burst>::receive(Visitor && visit)
+    {
+        // Buffers taken by the last batch are replaced, a burst is
+        // as many messages as there are buffers
+        std::size_t ready = 0;
+        for (; ready < Burst; ++ready) {
+            if (!buffers_[ready] && !(buffers_[ready] = pool_.allocate())) {
+                break;
+            }
+            iovecs_[ready].iov_base = buffers_[ready].data();
+            iovecs_[ready].iov_len = buffer_bytes;
+            struct msghdr & header = messages_[ready].msg_hdr;
+            header.msg_name = &names_[ready];
+            header.msg_namelen = sizeof(names_[ready]);
+            header.msg_iov = &iovecs_[ready];
+            header.msg_iovlen = 1;
+            header.msg_control = gro_ ? controls_[ready].bytes : nullptr;
+            header.msg_controllen = gro_ ? sizeof(controls_[ready].bytes) : 0;
+            header.msg_flags = 0;
+        }
+        if (ready == 0) {
+            return 0;
+        }
+
+        const int received = ::recvmmsg(fd_, messages_.data(), static_cast<unsigned int>(ready), MSG_WAITFORONE, nullptr);
+        if (received < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+                return 0;
+            }
+            throw std::system_error(errno, std::generic_category(), "unable to receive datagrams");
+        }
+
+        datagrams_.clear();
+        for (std::size_t m = 0; m < static_cast<std::size_t>(received); ++m) {
+            unsigned char * const data = buffers_[m].data();
+            const std::size_t bytes = messages_[m].msg_len;
+            const bool truncated = (messages_[m].msg_hdr.msg_flags & MSG_TRUNC) != 0;
+            const std::size_t segment = gro_segment_bytes(messages_[m].msg_hdr);
+            if (segment == 0 || segment >= bytes) {
+                datagrams_.push_back({data, bytes, m, truncated});
+                continue;
+            }
+            // A coalesced message is split into its datagrams
+            for (std::size_t pos = 0; pos < bytes; pos += segment) {
+                datagrams_.push_back({data + pos, bytes - pos < segment ? bytes - pos : segment, m, truncated});
+            }
+        }
+
+        batch datagrams(this);
+        visit(datagrams);
+        return datagrams_.size();
+    }
+
+    template <class Protocol, std::size_t Payload_Bytes, std::size_t Burst>
+    std::size_t udp_batch_io<Protocol, Payload_Bytes, Burst>::send_messages(const std::size_t count,
+                                                                            struct sockaddr const * const to,
+                                                                            const socklen_t to_bytes)
+    {
+        for (std::size_t m = 0; m < count; ++m) {
+            struct msghdr & header = send_messages_[m].msg_hdr;
+            header.msg_name = const_cast<struct sockaddr *>(to);
+            header.msg_namelen = to == nullptr ? 0 : to_bytes;
+            header.msg_iov = &send_iovecs_[m];
+            header.msg_iovlen = 1;
+            header.msg_control = nullptr;
+            header.msg_controllen = 0;
+        }
+
+        std::size_t sent = 0;
+        while (sent < count) {
+            const int n = ::sendmmsg(fd_, send_messages_.data() + sent, static_cast<unsigned int>(count - sent), 0);
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    break;
+                }
+                throw std::system_error(errno, std::generic_category(), "unable to send datagrams");
+            }
+            sent += static_cast<std::size_t>(n);
+        }
+        return sent;
+    }
+
+    template <class Protocol, std::size_t Payload_Bytes, std::size_t Burst>
+    std::size_t udp_batch_io<Protocol, Payload_Bytes, Burst>::send(unsigned char const * const * const datagrams,
+                                                                   std::size_t const * const bytes,
+                                                                   const std::size_t count,
+                                                                   struct sockaddr const * const to,
+                                                                   const socklen_t to_bytes)
+    {
+        std::size_t sent = 0;
+        while (sent < count) {
+            const std::size_t chunk = count - sent < Burst ? count - sent : Burst;
+            for (std::size_t m = 0; m < chunk; ++m) {
+                send_iovecs_[m].iov_base = const_cast<unsigned char *>(datagrams[sent + m]);
+                send_iovecs_[m].iov_len = bytes[sent + m];
+            }
+            const std::size_t n = send_messages(chunk, to, to_bytes);
+            sent += n;
+            if (n < chunk) {
+                break;
+            }
+        }
+        return sent;
+    }
+
+    template <class Protocol, std::size_t Payload_Bytes, std::size_t Burst>
+    std::size_t udp_batch_io<Protocol, Payload_Bytes, Burst>::send_segments(unsigned char const * const data,
+                                                                            const std::size_t bytes,
+                                                                            const std::size_t segment_bytes,
+                                                                            struct sockaddr const * const to,
+                                                                            const socklen_t to_bytes)
+    {
+        if (bytes == 0 || segment_bytes == 0) {
+            return 0;
+        }
+        const std::size_t segments = (bytes + segment_bytes - 1) / segment_bytes;
+        std::size_t sent = 0;
+
+#if defined(UDP_SEGMENT)
+        // The kernel splits a message into at most 64 datagrams, and a
+        // message is at most the 65507 bytes of a UDP datagram
+        static constexpr std::size_t gso_segments = 64;
+        static constexpr std::size_t gso_bytes = 65507;
+        const std::size_t per_message = segment_bytes > gso_bytes / 2 ? 1 :
+            gso_bytes / segment_bytes < gso_segments ? gso_bytes / segment_bytes : gso_segments;
+
+        bool gso = per_message > 1;
+        while (gso && segments - sent > 1) {
+            const std::size_t count = segments - sent < per_message ? segments - sent : per_message;
+            const std::size_t pos = sent * segment_bytes;
+            struct iovec iov = {const_cast<unsigned char *>(data + pos),
+                                bytes - pos < count * segment_bytes ? bytes - pos : count * segment_bytes};
+            control segment;
+            std::memset(&segment, 0, sizeof(segment));
+
+            struct msghdr message;
+            std::memset(&message, 0, sizeof(message));
+            message.msg_name = const_cast<struct sockaddr *>(to);
+            message.msg_namelen = to == nullptr ? 0 : to_bytes;
+            message.msg_iov = &iov;
+            message.msg_iovlen = 1;
+            message.msg_control = segment.bytes;
+            message.msg_controllen = CMSG_SPACE(sizeof(std::uint16_t));
+
+            struct cmsghdr * const c = CMSG_FIRSTHDR(&message);
+            c->cmsg_level = SOL_UDP;
+            c->cmsg_type = UDP_SEGMENT;
+            c->cmsg_len = CMSG_LEN(sizeof(std::uint16_t));
+            const std::uint16_t size = static_cast<std::uint16_t>(segment_bytes);
+            std::memcpy(CMSG_DATA(c), &size, sizeof(size));
+
+            for (;;) {
+                if (::sendmsg(fd_, &message, 0) >= 0) {
+                    sent += count;
+                    break;
+                }
+                if (errno == EINTR) {
+                    continue;
+                }
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    return sent;
+                }
+                // Kernels, devices and paths without UDP GSO, or with a
+                // smaller limit, send each datagram
+                if (errno != EIO && errno != EINVAL && errno != ENOPROTOOPT && errno != EMSGSIZE) {
+                    throw std::system_error(errno, std::generic_category(), "unable to send datagrams");
+                }
+                gso = false;
+                break;
+            }
+        }
+#endif
+
+        while (sent < segments) {
+            const std::size_t chunk = segments - sent < Burst ? segments - sent : Burst;
+            for (std::size_t m = 0; m < chunk; ++m) {
+                const std::size_t pos = (sent + m) * segment_bytes;
+                send_iovecs_[m].iov_base = const_cast<unsigned char *>(data + pos);
+                send_iovecs_[m].iov_len = bytes - pos < segment_bytes ? bytes - pos : segment_bytes;
+            }
+            const std::size_t n = send_messages(chunk, to, to_bytes);
+            sent += n;
+            if (n < chunk) {
+                break;
+            }
+        }
+        return sent;
+    }
+}
+
+#endif